@@ -0,0 +1,188 @@
+#include "autotune.h"
+#include "parallel.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <fstream>
+#include <numeric>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+/* The knot spans of x flattened into one number (mixed radix) */
+static size_t span_key(BSplineGeometry const& geometry, knot_t const& x)
+{
+	size_t key = 0;
+	for (size_t s = 0; s < geometry.get_n_kdims(); s++) {
+		size_t n_spans = geometry.get_knot_vector(s).size();
+		key = geometry.find_span(s, x[s]) + n_spans * key;
+	}
+	return key;
+}
+
+std::vector<ctrl_t> evaluate_with_plan(BSplineGeometry& geometry, 
+		std::vector<knot_t> const& x, EvaluationPlan const& plan)
+{
+	if (plan.n_threads == 0 || plan.n_threads > geometry.get_n_threads()) {
+		error("plan uses more threads than the geometry provides");
+	}
+	if (geometry.get_block_size() != plan.block_size) {
+		geometry.set_block_size(plan.block_size);
+	}
+	size_t n = x.size();
+	size_t n_threads = plan.n_threads;
+
+	/* Regroup the points by knot spans (stably, so the grouping is deterministic) */
+	std::vector<size_t> order;
+	std::vector<knot_t> grouped;
+	if (plan.group_by_span) {
+		std::vector<size_t> keys(n);
+		parallel_for(n_threads, n, [&](size_t, size_t i) {
+			keys[i] = span_key(geometry, x[i]);
+		});
+		order.resize(n);
+		std::iota(order.begin(), order.end(), 0);
+		std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+			return keys[a] < keys[b];
+		});
+		grouped.resize(n);
+		for (size_t i = 0; i < n; i++) {
+			grouped[i] = x[order[i]];
+		}
+	}
+	std::vector<knot_t> const& points = plan.group_by_span ? grouped : x;
+
+	std::vector<ctrl_t> y(n);
+	parallel_for(n_threads, n_threads, [&](size_t tid, size_t block) {
+		size_t begin = n * block / n_threads, end = n * (block + 1) / n_threads;
+		if (plan.pipelined) {
+			geometry.evaluate(points, begin, end, y, tid);
+		} else {
+			for (size_t i = begin; i < end; i++) {
+				y[i] = geometry.evaluate(points[i], tid);
+			}
+		}
+	});
+
+	if (plan.group_by_span) {
+		std::vector<ctrl_t> result(n);
+		for (size_t i = 0; i < n; i++) {
+			result[order[i]].swap(y[i]);
+		}
+		return result;
+	}
+	return y;
+}
+
+EvaluationTuner::EvaluationTuner(std::string const& cache_file)
+	: cache_file(cache_file)
+{
+	std::ifstream file(cache_file);
+	std::string line;
+	while (std::getline(file, line)) {
+		std::istringstream in(line);
+		std::string key;
+		EvaluationPlan plan;
+		if (in >> key >> plan.n_threads >> plan.block_size >> plan.group_by_span >> plan.pipelined) {
+			plans[key] = plan;
+		}
+	}
+}
+
+std::string EvaluationTuner::key(BSplineGeometry const& geometry, std::vector<knot_t> const& x) const
+{
+	char host[256] = "unknown";
+	gethostname(host, sizeof(host) - 1);
+
+	/* Whether consecutive points (among the first 1024) mostly share their spans */
+	size_t n = std::min(x.size(), size_t(1024)), shared = 0;
+	for (size_t i = 1; i < n; i++) {
+		shared += span_key(geometry, x[i]) == span_key(geometry, x[i - 1]);
+	}
+	bool coherent = 2 * shared >= n;
+
+	std::ostringstream key;
+	key << host << ";cores=" << std::thread::hardware_concurrency()
+		<< ";threads=" << geometry.get_n_threads()
+		<< ";k=" << geometry.get_n_kdims() << ";c=" << geometry.get_n_cdims() << ";p=";
+	for (size_t s = 0; s < geometry.get_n_kdims(); s++) {
+		key << (s ? "," : "") << geometry.get_degree(s);
+	}
+	key << ";net=2^" << size_t(std::log2(geometry.get_n_control_points()))
+		<< ";batch=2^" << size_t(std::log2(std::max(x.size(), size_t(1))))
+		<< ";" << (coherent ? "coherent" : "scattered");
+	return key.str();
+}
+
+EvaluationPlan EvaluationTuner::calibrate(BSplineGeometry& geometry, std::vector<knot_t> const& x) const
+{
+	/* An evenly strided sample of the batch */
+	size_t n = std::min(x.size(), size_t(8192));
+	std::vector<knot_t> sample(n);
+	for (size_t i = 0; i < n; i++) {
+		sample[i] = x[i * x.size() / n];
+	}
+
+	std::vector<size_t> thread_counts{1};
+	if (geometry.get_n_threads() > 1) {
+		thread_counts.push_back(geometry.get_n_threads());
+	}
+	std::vector<size_t> block_sizes{0, geometry.get_n_kdims() >= 3 ? size_t(4) : size_t(8)};
+
+	/* The fastest of two runs of every candidate (block size outermost, as switching copies the net) */
+	size_t original_block_size = geometry.get_block_size();
+	EvaluationPlan best{1, 0, false, false};
+	double best_time = -1;
+	for (size_t block_size : block_sizes) {
+		for (size_t n_threads : thread_counts) {
+			for (bool group_by_span : {false, true}) {
+				for (bool pipelined : {false, true}) {
+					EvaluationPlan plan{n_threads, block_size, group_by_span, pipelined};
+					double time = -1;
+					for (size_t run = 0; run < 2; run++) {
+						auto start = std::chrono::steady_clock::now();
+						evaluate_with_plan(geometry, sample, plan);
+						std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+						if (time < 0 || elapsed.count() < time) {
+							time = elapsed.count();
+						}
+					}
+					if (best_time < 0 || time < best_time) {
+						best = plan;
+						best_time = time;
+					}
+				}
+			}
+		}
+	}
+
+	/* Leave the layout as the caller had it */
+	if (geometry.get_block_size() != original_block_size) {
+		geometry.set_block_size(original_block_size);
+	}
+	return best;
+}
+
+EvaluationPlan EvaluationTuner::plan(BSplineGeometry& geometry, std::vector<knot_t> const& x)
+{
+	std::string k = key(geometry, x);
+	auto found = plans.find(k);
+	if (found != plans.end() && found->second.n_threads <= geometry.get_n_threads()) {
+		return found->second;
+	}
+
+	EvaluationPlan plan = calibrate(geometry, x);
+	plans[k] = plan;
+	std::ofstream file(cache_file, std::ios::app);
+	file << k << " " << plan.n_threads << " " << plan.block_size << " " 
+		<< plan.group_by_span << " " << plan.pipelined << "\n";
+	return plan;
+}
+
+std::vector<ctrl_t> EvaluationTuner::evaluate(BSplineGeometry& geometry, std::vector<knot_t> const& x)
+{
+	return evaluate_with_plan(geometry, x, plan(geometry, x));
+}
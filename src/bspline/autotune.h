@@ -0,0 +1,62 @@
+#ifndef BSPLINE_AUTOTUNE_H
+#define BSPLINE_AUTOTUNE_H
+
+#include "geometry.h"
+#include <cstddef>
+#include <map>
+#include <string>
+#include <vector>
+
+/* A way of evaluating a batch of parametric points */
+struct EvaluationPlan {
+	/* The number of threads (at most the geometry's n_threads) */
+	size_t n_threads;
+	/* The control point block size (see BSplineGeometry::set_block_size()) */
+	size_t block_size;
+	/* Evaluate the points grouped by knot spans rather than in input order */
+	bool group_by_span;
+	/* Use the prefetching map operation rather than evaluating point by point */
+	bool pipelined;
+};
+
+/*
+ * Evaluate the geometry at x following the plan. The geometry's
+ * block size is switched to the plan's if they differ. Each thread
+ * evaluates a contiguous range of the (possibly regrouped) points.
+ */
+std::vector<ctrl_t> evaluate_with_plan(BSplineGeometry& geometry, 
+		std::vector<knot_t> const& x, EvaluationPlan const& plan);
+
+/*
+ * Chooses an EvaluationPlan by timing the candidates on a sample
+ * of the batch, and remembers the choice.
+ *
+ * Choices are keyed by the host, the geometry's dimensions,
+ * degrees and threads, the orders of magnitude of the net and
+ * batch sizes, and whether consecutive points of the batch tend to
+ * share knot spans (as for structured grids) or not (scattered
+ * points). They are kept in a text file, one "key plan" line each,
+ * so later runs on the same host skip the calibration. Calibration
+ * tries every block size on the geometry and then restores the one
+ * it had.
+ */
+class EvaluationTuner {
+private:
+	std::string cache_file;
+	std::map<std::string, EvaluationPlan> plans;
+
+	std::string key(BSplineGeometry const& geometry, std::vector<knot_t> const& x) const;
+	EvaluationPlan calibrate(BSplineGeometry& geometry, std::vector<knot_t> const& x) const;
+
+public:
+	/* Read earlier choices from cache_file, if it exists */
+	EvaluationTuner(std::string const& cache_file = "bspline_tuning.txt");
+
+	/* The plan for evaluating geometry at x, calibrating if it is not known yet */
+	EvaluationPlan plan(BSplineGeometry& geometry, std::vector<knot_t> const& x);
+
+	/* Evaluate geometry at x with plan(geometry, x) */
+	std::vector<ctrl_t> evaluate(BSplineGeometry& geometry, std::vector<knot_t> const& x);
+};
+
+#endif
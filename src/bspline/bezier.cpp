@@ -0,0 +1,135 @@
+#include "bezier.h"
+#include "linalg.h"
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+/*
+ * Call fiber(base, stride) for every line of coefficients along
+ * dimension s: the entries base + i * stride, 0 <= i <= degrees[s].
+ */
+template <typename Fiber>
+static void for_each_fiber(std::vector<size_t> const& degrees, size_t s, Fiber fiber)
+{
+	size_t n_kdims = degrees.size();
+	size_t stride = 1;
+	for (size_t r = s + 1; r < n_kdims; r++) {
+		stride *= degrees[r] + 1;
+	}
+	size_t outer = 1;
+	for (size_t r = 0; r < s; r++) {
+		outer *= degrees[r] + 1;
+	}
+	size_t len = degrees[s] + 1;
+	for (size_t o = 0; o < outer; o++) {
+		for (size_t i = 0; i < stride; i++) {
+			fiber(o * len * stride + i, stride);
+		}
+	}
+}
+
+BezierPatch bezier_interpolate(std::vector<size_t> const& degrees, std::vector<ctrl_t> const& values)
+{
+	size_t n_coef = 1;
+	for (size_t d : degrees) {
+		n_coef *= d + 1;
+	}
+	if (values.size() != n_coef) {
+		error("incorrect number of values for Bezier interpolation");
+	}
+
+	BezierPatch patch{degrees, values};
+	size_t n_cdims = values.empty() ? 0 : values[0].size();
+	for (size_t s = 0; s < degrees.size(); s++) {
+		size_t d = degrees[s];
+		if (d == 0) continue;
+
+		/* Inverse of the Bernstein collocation matrix at i / d */
+		std::vector<scalar_t> M((d + 1) * (d + 1));
+		for (size_t i = 0; i <= d; i++) {
+			scalar_t t = scalar_t(i) / d;
+			/* B_j^d(t) by the triangular recurrence */
+			std::vector<scalar_t> B(d + 1, 0);
+			B[0] = 1;
+			for (size_t q = 1; q <= d; q++) {
+				for (size_t j = q; j > 0; j--) {
+					B[j] = (1 - t) * B[j] + t * B[j - 1];
+				}
+				B[0] *= (1 - t);
+			}
+			std::copy(B.begin(), B.end(), M.begin() + i * (d + 1));
+		}
+		std::vector<scalar_t> Minv = inverse(M, d + 1);
+
+		for_each_fiber(degrees, s, [&](size_t base, size_t stride) {
+			std::vector<ctrl_t> fiber(d + 1);
+			for (size_t i = 0; i <= d; i++) {
+				fiber[i] = patch.coefficients[base + i * stride];
+			}
+			for (size_t i = 0; i <= d; i++) {
+				ctrl_t& c = patch.coefficients[base + i * stride];
+				std::fill(c.begin(), c.end(), 0);
+				for (size_t j = 0; j <= d; j++) {
+					for (size_t r = 0; r < n_cdims; r++) {
+						c[r] += Minv[i * (d + 1) + j] * fiber[j][r];
+					}
+				}
+			}
+		});
+	}
+	return patch;
+}
+
+void bezier_subdivide(BezierPatch const& patch, size_t s, scalar_t t, 
+		BezierPatch& left, BezierPatch& right)
+{
+	left = patch;
+	right = patch;
+	size_t d = patch.degrees[s];
+	for_each_fiber(patch.degrees, s, [&](size_t base, size_t stride) {
+		std::vector<ctrl_t> work(d + 1);
+		for (size_t i = 0; i <= d; i++) {
+			work[i] = patch.coefficients[base + i * stride];
+		}
+		size_t n_cdims = work[0].size();
+
+		/* de Casteljau: left gets the first entry of every level, right the last */
+		left.coefficients[base] = work[0];
+		right.coefficients[base + d * stride] = work[d];
+		for (size_t q = 1; q <= d; q++) {
+			for (size_t i = 0; i + q <= d; i++) {
+				for (size_t r = 0; r < n_cdims; r++) {
+					work[i][r] = (1 - t) * work[i][r] + t * work[i + 1][r];
+				}
+			}
+			left.coefficients[base + q * stride] = work[0];
+			right.coefficients[base + (d - q) * stride] = work[d - q];
+		}
+	});
+}
+
+void bezier_bounds(BezierPatch const& patch, ctrl_t& lo, ctrl_t& hi)
+{
+	lo = hi = patch.coefficients[0];
+	for (ctrl_t const& c : patch.coefficients) {
+		for (size_t r = 0; r < c.size(); r++) {
+			lo[r] = std::min(lo[r], c[r]);
+			hi[r] = std::max(hi[r], c[r]);
+		}
+	}
+}
+
+std::vector<ctrl_t> bezier_corners(BezierPatch const& patch)
+{
+	size_t n_kdims = patch.degrees.size();
+	std::vector<ctrl_t> corners;
+	for (size_t mask = 0; mask < (size_t(1) << n_kdims); mask++) {
+		size_t I = 0;
+		for (size_t s = 0; s < n_kdims; s++) {
+			size_t bit = (mask >> (n_kdims - 1 - s)) & 1;
+			I = bit * patch.degrees[s] + (patch.degrees[s] + 1) * I;
+		}
+		corners.push_back(patch.coefficients[I]);
+	}
+	return corners;
+}
@@ -0,0 +1,51 @@
+#ifndef BSPLINE_BEZIER_H
+#define BSPLINE_BEZIER_H
+
+#include "geometry.h"
+#include <cstddef>
+#include <vector>
+
+/*
+ * A tensor product Bezier patch over the unit box [0, 1]^k.
+ *
+ * The coefficients are ordered lexicographically like the
+ * control points of a BSplineGeometry (the last dimension
+ * varies fastest), with degrees[s] + 1 coefficients along
+ * dimension s. Each coefficient is a point in R^c; scalar
+ * polynomials use c = 1.
+ */
+struct BezierPatch {
+	std::vector<size_t> degrees;
+	std::vector<ctrl_t> coefficients;
+};
+
+/*
+ * The Bezier patch of the given degrees that interpolates values
+ * on the uniform tensor grid of nodes i / degrees[s] (the single
+ * node 1/2 in dimensions of degree zero), with values ordered
+ * like the coefficients. The interpolant is exact if the values
+ * come from a polynomial of at most those degrees.
+ */
+BezierPatch bezier_interpolate(std::vector<size_t> const& degrees, std::vector<ctrl_t> const& values);
+
+/*
+ * Split the patch at parameter t along dimension s by de
+ * Casteljau's algorithm. left and right are reparametrized
+ * over the unit box.
+ */
+void bezier_subdivide(BezierPatch const& patch, size_t s, scalar_t t, 
+		BezierPatch& left, BezierPatch& right);
+
+/*
+ * Componentwise bounds of the coefficients. By the convex hull
+ * property, the patch lies in the box [lo, hi] over [0, 1]^k.
+ */
+void bezier_bounds(BezierPatch const& patch, ctrl_t& lo, ctrl_t& hi);
+
+/*
+ * The coefficients at the 2^k corners of the patch, which equal
+ * the values of the patch at the corners of the unit box.
+ */
+std::vector<ctrl_t> bezier_corners(BezierPatch const& patch);
+
+#endif
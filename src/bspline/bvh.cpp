@@ -0,0 +1,499 @@
+#include "bvh.h"
+#include "bezier.h"
+#include "parallel.h"
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+bool AABB::overlaps(AABB const& other) const
+{
+	for (size_t r = 0; r < lo.size(); r++) {
+		if (hi[r] < other.lo[r] || other.hi[r] < lo[r]) return false;
+	}
+	return true;
+}
+
+scalar_t AABB::distance(ctrl_t const& y) const
+{
+	scalar_t d2 = 0;
+	for (size_t r = 0; r < lo.size(); r++) {
+		scalar_t d = std::max<scalar_t>({lo[r] - y[r], 0, y[r] - hi[r]});
+		d2 += d * d;
+	}
+	return std::sqrt(d2);
+}
+
+bool AABB::clip_ray(ctrl_t const& origin, ctrl_t const& direction, 
+		scalar_t& t_in, scalar_t& t_out) const
+{
+	t_in = 0;
+	t_out = HUGE_VAL;
+	for (size_t r = 0; r < lo.size(); r++) {
+		if (direction[r] == 0) {
+			if (origin[r] < lo[r] || origin[r] > hi[r]) return false;
+			continue;
+		}
+		scalar_t t1 = (lo[r] - origin[r]) / direction[r];
+		scalar_t t2 = (hi[r] - origin[r]) / direction[r];
+		t_in = std::max(t_in, std::min(t1, t2));
+		t_out = std::min(t_out, std::max(t1, t2));
+	}
+	return t_in <= t_out;
+}
+
+bool AABB::crosses_plane(ctrl_t const& origin, ctrl_t const& normal) const
+{
+	/* The range of the signed distance over the corners */
+	scalar_t low = 0, high = 0;
+	for (size_t r = 0; r < normal.size() && r < lo.size(); r++) {
+		scalar_t a = normal[r] * (lo[r] - origin[r]), b = normal[r] * (hi[r] - origin[r]);
+		low += std::min(a, b);
+		high += std::max(a, b);
+	}
+	return low <= 0 && high >= 0;
+}
+
+/* Grow a so that it contains b */
+static void merge(AABB& a, AABB const& b)
+{
+	for (size_t r = 0; r < a.lo.size(); r++) {
+		a.lo[r] = std::min(a.lo[r], b.lo[r]);
+		a.hi[r] = std::max(a.hi[r], b.hi[r]);
+	}
+}
+
+AABB image_bounds(BSplineGeometry const& geometry, knot_t const& lo, knot_t const& hi,
+		size_t subdivisions)
+{
+	size_t k = geometry.get_n_kdims(), n_cdims = geometry.get_n_cdims();
+	if (lo.size() != k || hi.size() != k) {
+		error("parametric box has incorrect dimension");
+	}
+
+	/* The elements first[s] ... last[s] overlapping the box along each dimension */
+	std::vector<std::vector<scalar_t>> breaks(k);
+	std::vector<std::vector<size_t>> spans(k);
+	std::vector<size_t> first(k), last(k), degrees(k);
+	for (size_t s = 0; s < k; s++) {
+		breaks[s] = geometry.get_breakpoints(s);
+		spans[s] = geometry.get_spans(s);
+		degrees[s] = geometry.get_degree(s);
+		if (lo[s] > hi[s] || lo[s] < breaks[s].front() || hi[s] > breaks[s].back()) {
+			error("parametric box out of bounds");
+		}
+		size_t n_elem = spans[s].size();
+		size_t a = std::upper_bound(breaks[s].begin(), breaks[s].end(), lo[s]) - breaks[s].begin();
+		size_t b = std::lower_bound(breaks[s].begin(), breaks[s].end(), hi[s]) - breaks[s].begin();
+		first[s] = std::min(a > 0 ? a - 1 : 0, n_elem - 1);
+		last[s] = std::max(first[s], std::min(b > 0 ? b - 1 : 0, n_elem - 1));
+	}
+
+	AABB box;
+	auto add = [&](ctrl_t const& a, ctrl_t const& b) {
+		if (box.lo.empty()) {
+			box.lo = a;
+			box.hi = b;
+		}
+		else {
+			merge(box, AABB{a, b});
+		}
+	};
+
+	if (subdivisions == 0) {
+		std::vector<size_t> from(k), to(k), pos(k);
+		for (size_t s = 0; s < k; s++) {
+			from[s] = pos[s] = spans[s][first[s]] - degrees[s];
+			to[s] = spans[s][last[s]];
+		}
+		while (true) {
+			size_t I = 0;
+			for (size_t s = 0; s < k; s++) {
+				I = pos[s] + geometry.get_n_ctrl(s) * I;
+			}
+			scalar_t const* P = geometry.get_control_point(I);
+			ctrl_t point(P, P + geometry.get_n_cdims());
+			add(point, point);
+
+			size_t s = k;
+			while (s > 0) {
+				s--;
+				if (++pos[s] <= to[s]) break;
+				pos[s] = from[s];
+			}
+			if (s == 0 && pos[0] == from[0]) break;
+		}
+		return box;
+	}
+
+	size_t n_values = 1;
+	for (size_t s = 0; s < k; s++) {
+		n_values *= degrees[s] + 1;
+	}
+	std::vector<size_t> elem = first;
+	while (true) {
+		/*
+		 * The basis functions of the element at the Bezier nodes of its
+		 * part inside the box, then the spline there from the control points
+		 */
+		std::vector<std::vector<std::vector<scalar_t>>> N(k);
+		std::vector<size_t> start(k);
+		for (size_t s = 0; s < k; s++) {
+			size_t j = spans[s][elem[s]];
+			scalar_t a = std::max(lo[s], breaks[s][elem[s]]);
+			scalar_t b = std::min(hi[s], breaks[s][elem[s] + 1]);
+			start[s] = j - degrees[s];
+			for (size_t i = 0; i <= degrees[s]; i++) {
+				scalar_t t = degrees[s] == 0 ? 0.5 : scalar_t(i) / degrees[s];
+				std::vector<std::vector<scalar_t>> ders;
+				geometry.basis_derivatives(s, j, a + (b - a) * t, 0, ders);
+				N[s].push_back(ders[0]);
+			}
+		}
+		std::vector<ctrl_t> values(n_values, ctrl_t(n_cdims, 0));
+		for (size_t v = 0; v < n_values; v++) {
+			for (size_t w = 0; w < n_values; w++) {
+				size_t I = 0;
+				scalar_t B = 1;
+				for (size_t s = 0, div = n_values; s < k; s++) {
+					div /= degrees[s] + 1;
+					size_t i = v / div % (degrees[s] + 1), q = w / div % (degrees[s] + 1);
+					I = start[s] + q + geometry.get_n_ctrl(s) * I;
+					B *= N[s][i][q];
+				}
+				if (B == 0) continue;
+				scalar_t const* P = geometry.get_control_point(I);
+				for (size_t r = 0; r < n_cdims; r++) {
+					values[v][r] += B * P[r];
+				}
+			}
+		}
+
+		/* Bisect along every dimension subdivisions - 1 times */
+		std::vector<BezierPatch> pieces{bezier_interpolate(degrees, values)};
+		for (size_t level = 1; level < subdivisions; level++) {
+			for (size_t s = 0; s < k; s++) {
+				std::vector<BezierPatch> halves;
+				for (BezierPatch const& piece : pieces) {
+					BezierPatch left, right;
+					bezier_subdivide(piece, s, 0.5, left, right);
+					halves.push_back(left);
+					halves.push_back(right);
+				}
+				pieces.swap(halves);
+			}
+		}
+		for (BezierPatch const& piece : pieces) {
+			ctrl_t a, b;
+			bezier_bounds(piece, a, b);
+			add(a, b);
+		}
+
+		size_t s = k;
+		while (s > 0) {
+			s--;
+			if (++elem[s] <= last[s]) break;
+			elem[s] = first[s];
+		}
+		if (s == 0 && elem[0] == first[0]) break;
+	}
+	return box;
+}
+
+AABB ElementBVH::element_hull(BSplineGeometry const& geometry, size_t e) const
+{
+	size_t k = degrees.size();
+	std::vector<size_t> first(k);
+	for (size_t s = k, rest = e; s > 0; s--) {
+		first[s - 1] = spans[s - 1][rest % spans[s - 1].size()] - degrees[s - 1];
+		rest /= spans[s - 1].size();
+	}
+
+	AABB box;
+	std::vector<size_t> pos(k, 0);
+	while (true) {
+		size_t I = 0;
+		for (size_t s = 0; s < k; s++) {
+			I = first[s] + pos[s] + n_ctrl[s] * I;
+		}
+		scalar_t const* P = geometry.get_control_point(I);
+		ctrl_t point(P, P + geometry.get_n_cdims());
+		if (box.lo.empty()) {
+			box.lo = box.hi = point;
+		}
+		else {
+			merge(box, AABB{point, point});
+		}
+
+		size_t s = k;
+		while (s > 0) {
+			s--;
+			if (++pos[s] <= degrees[s]) break;
+			pos[s] = 0;
+		}
+		if (s == 0 && pos[0] == 0) break;
+	}
+	return box;
+}
+
+size_t ElementBVH::build(size_t first, size_t count, size_t parent)
+{
+	size_t index = nodes.size();
+	nodes.push_back(node{boxes[order[first]], 0, 0, parent, first, count});
+	for (size_t i = first + 1; i < first + count; i++) {
+		merge(nodes[index].box, boxes[order[i]]);
+	}
+	if (count <= leaf_size) {
+		for (size_t i = first; i < first + count; i++) {
+			leaf_of[order[i]] = index;
+		}
+		return index;
+	}
+
+	/* Median split of the box centers along the longest axis */
+	AABB const& box = nodes[index].box;
+	size_t axis = 0;
+	for (size_t r = 1; r < box.lo.size(); r++) {
+		if (box.hi[r] - box.lo[r] > box.hi[axis] - box.lo[axis]) axis = r;
+	}
+	auto begin = order.begin() + first;
+	std::nth_element(begin, begin + count / 2, begin + count, [&](size_t a, size_t b) {
+		return boxes[a].lo[axis] + boxes[a].hi[axis] < boxes[b].lo[axis] + boxes[b].hi[axis];
+	});
+
+	size_t left = build(first, count / 2, index);
+	size_t right = build(first + count / 2, count - count / 2, index);
+	nodes[index].left = left;
+	nodes[index].right = right;
+	return index;
+}
+
+ElementBVH::ElementBVH(BSplineGeometry const& geometry)
+{
+	size_t k = geometry.get_n_kdims();
+	size_t total = 1;
+	for (size_t s = 0; s < k; s++) {
+		degrees.push_back(geometry.get_degree(s));
+		n_ctrl.push_back(geometry.get_n_ctrl(s));
+		spans.push_back(geometry.get_spans(s));
+		total *= spans[s].size();
+	}
+
+	boxes.resize(total);
+	parallel_for(geometry.get_n_threads(), total, [&](size_t, size_t e) {
+		boxes[e] = element_hull(geometry, e);
+	});
+
+	order.resize(total);
+	for (size_t e = 0; e < total; e++) {
+		order[e] = e;
+	}
+	leaf_of.resize(total);
+	build(0, total, 0);
+}
+
+size_t ElementBVH::n_elements() const
+{
+	return boxes.size();
+}
+
+AABB const& ElementBVH::element_box(size_t e) const
+{
+	return boxes[e];
+}
+
+AABB const& ElementBVH::extent() const
+{
+	return nodes[0].box;
+}
+
+std::vector<size_t> ElementBVH::overlapping(AABB const& box) const
+{
+	std::vector<size_t> result;
+	std::vector<size_t> stack{0};
+	while (!stack.empty()) {
+		node const& n = nodes[stack.back()];
+		stack.pop_back();
+		if (!n.box.overlaps(box)) continue;
+		if (n.left == 0) {
+			for (size_t i = n.first; i < n.first + n.count; i++) {
+				if (boxes[order[i]].overlaps(box)) result.push_back(order[i]);
+			}
+		}
+		else {
+			stack.push_back(n.left);
+			stack.push_back(n.right);
+		}
+	}
+	std::sort(result.begin(), result.end());
+	return result;
+}
+
+size_t ElementBVH::nearest(ctrl_t const& y, scalar_t* distance) const
+{
+	size_t best = order[0];
+	scalar_t best_d = HUGE_VAL;
+	std::vector<size_t> stack{0};
+	while (!stack.empty()) {
+		node const& n = nodes[stack.back()];
+		stack.pop_back();
+		if (n.box.distance(y) >= best_d) continue;
+		if (n.left == 0) {
+			for (size_t i = n.first; i < n.first + n.count; i++) {
+				scalar_t d = boxes[order[i]].distance(y);
+				if (d < best_d || (d == best_d && order[i] < best)) {
+					best_d = d;
+					best = order[i];
+				}
+			}
+		}
+		else {
+			/* Visit the nearer child first */
+			size_t a = n.left, b = n.right;
+			if (nodes[a].box.distance(y) < nodes[b].box.distance(y)) std::swap(a, b);
+			stack.push_back(a);
+			stack.push_back(b);
+		}
+	}
+	if (distance) *distance = best_d;
+	return best;
+}
+
+std::vector<std::pair<scalar_t, size_t>> ElementBVH::intersect_ray(ctrl_t const& origin, 
+		ctrl_t const& direction) const
+{
+	std::vector<std::pair<scalar_t, size_t>> result;
+	std::vector<size_t> stack{0};
+	scalar_t t_in, t_out;
+	while (!stack.empty()) {
+		node const& n = nodes[stack.back()];
+		stack.pop_back();
+		if (!n.box.clip_ray(origin, direction, t_in, t_out)) continue;
+		if (n.left == 0) {
+			for (size_t i = n.first; i < n.first + n.count; i++) {
+				if (boxes[order[i]].clip_ray(origin, direction, t_in, t_out)) {
+					result.push_back({t_in, order[i]});
+				}
+			}
+		}
+		else {
+			stack.push_back(n.left);
+			stack.push_back(n.right);
+		}
+	}
+	std::sort(result.begin(), result.end());
+	return result;
+}
+
+std::vector<size_t> ElementBVH::crossing_plane(ctrl_t const& origin, ctrl_t const& normal) const
+{
+	std::vector<size_t> result;
+	std::vector<size_t> stack{0};
+	while (!stack.empty()) {
+		node const& n = nodes[stack.back()];
+		stack.pop_back();
+		if (!n.box.crosses_plane(origin, normal)) continue;
+		if (n.left == 0) {
+			for (size_t i = n.first; i < n.first + n.count; i++) {
+				if (boxes[order[i]].crosses_plane(origin, normal)) result.push_back(order[i]);
+			}
+		}
+		else {
+			stack.push_back(n.left);
+			stack.push_back(n.right);
+		}
+	}
+	std::sort(result.begin(), result.end());
+	return result;
+}
+
+void ElementBVH::update(std::vector<size_t> const& dirty_leaves)
+{
+	/* Children always have larger indices than their parents */
+	std::vector<bool> dirty(nodes.size(), false);
+	size_t lowest = nodes.size();
+	for (size_t leaf : dirty_leaves) {
+		for (size_t n = leaf; !dirty[n]; n = nodes[n].parent) {
+			dirty[n] = true;
+			lowest = std::min(lowest, n);
+			if (n == 0) break;
+		}
+	}
+	for (size_t n = nodes.size(); n > lowest; ) {
+		n--;
+		if (!dirty[n]) continue;
+		node& nd = nodes[n];
+		if (nd.left == 0) {
+			nd.box = boxes[order[nd.first]];
+			for (size_t i = nd.first + 1; i < nd.first + nd.count; i++) {
+				merge(nd.box, boxes[order[i]]);
+			}
+		}
+		else {
+			nd.box = nodes[nd.left].box;
+			merge(nd.box, nodes[nd.right].box);
+		}
+	}
+}
+
+void ElementBVH::refit(BSplineGeometry const& geometry, std::vector<size_t> const& changed)
+{
+	/*
+	 * Control point (i_0, ..., i_{k-1}) lies in the hull of every
+	 * element whose span j along each dimension s satisfies
+	 * j - p_s <= i_s <= j.
+	 */
+	size_t k = degrees.size();
+	std::vector<size_t> affected;
+	for (size_t I : changed) {
+		std::vector<size_t> lo(k), hi(k);
+		bool any = true;
+		for (size_t s = k, rest = I; s > 0; s--) {
+			size_t i = rest % n_ctrl[s - 1];
+			rest /= n_ctrl[s - 1];
+			std::vector<size_t> const& sp = spans[s - 1];
+			lo[s - 1] = std::lower_bound(sp.begin(), sp.end(), i) - sp.begin();
+			hi[s - 1] = std::upper_bound(sp.begin(), sp.end(), i + degrees[s - 1]) - sp.begin();
+			if (lo[s - 1] == hi[s - 1]) any = false;
+		}
+		if (!any) continue;
+
+		std::vector<size_t> pos = lo;
+		while (true) {
+			size_t e = 0;
+			for (size_t s = 0; s < k; s++) {
+				e = pos[s] + spans[s].size() * e;
+			}
+			affected.push_back(e);
+
+			size_t s = k;
+			while (s > 0) {
+				s--;
+				if (++pos[s] < hi[s]) break;
+				pos[s] = lo[s];
+			}
+			if (s == 0 && pos[0] == lo[0]) break;
+		}
+	}
+	std::sort(affected.begin(), affected.end());
+	affected.erase(std::unique(affected.begin(), affected.end()), affected.end());
+
+	std::vector<size_t> dirty_leaves;
+	for (size_t e : affected) {
+		boxes[e] = element_hull(geometry, e);
+		dirty_leaves.push_back(leaf_of[e]);
+	}
+	update(dirty_leaves);
+}
+
+void ElementBVH::refit(BSplineGeometry const& geometry)
+{
+	parallel_for(geometry.get_n_threads(), boxes.size(), [&](size_t, size_t e) {
+		boxes[e] = element_hull(geometry, e);
+	});
+	std::vector<size_t> dirty_leaves;
+	for (size_t n = 0; n < nodes.size(); n++) {
+		if (nodes[n].left == 0) dirty_leaves.push_back(n);
+	}
+	update(dirty_leaves);
+}
@@ -0,0 +1,129 @@
+#ifndef BSPLINE_BVH_H
+#define BSPLINE_BVH_H
+
+#include "geometry.h"
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+/* An axis-aligned box in physical space (n_cdims coordinates) */
+struct AABB {
+	ctrl_t lo;
+	ctrl_t hi;
+
+	bool overlaps(AABB const& other) const;
+	/* Euclidean distance from y to the box (zero inside) */
+	scalar_t distance(ctrl_t const& y) const;
+	/*
+	 * Clip the ray origin + t * direction to the box. Returns false
+	 * if it misses; otherwise [t_in, t_out] is the parameter interval
+	 * inside the box, with t_in >= 0.
+	 */
+	bool clip_ray(ctrl_t const& origin, ctrl_t const& direction, 
+			scalar_t& t_in, scalar_t& t_out) const;
+	/*
+	 * Whether the plane through origin with the given normal meets
+	 * the box. Coordinates beyond those of the normal are ignored.
+	 */
+	bool crosses_plane(ctrl_t const& origin, ctrl_t const& normal) const;
+};
+
+/*
+ * A box containing the image of the parametric box lo <= x <= hi.
+ *
+ * With subdivisions = 0 this is the box of the control points of
+ * the knot spans overlapping the parametric box (the convex hull
+ * property), which needs no evaluation. Otherwise each overlapping
+ * element is clipped to the parametric box and written as a Bezier
+ * patch from its control points, the patch is bisected along every
+ * dimension subdivisions - 1 times, and the boxes of the Bezier
+ * coefficients of the pieces are merged. The bounds tighten
+ * quadratically with the size of the pieces. Safe to call
+ * concurrently.
+ */
+AABB image_bounds(BSplineGeometry const& geometry, knot_t const& lo, knot_t const& hi,
+		size_t subdivisions = 0);
+
+/*
+ * A bounding volume hierarchy over the elements of a BSplineGeometry.
+ *
+ * By the convex hull property, the image of each element (a product
+ * of nonempty knot spans) lies in the bounding box of its
+ * (p_0 + 1) x ... x (p_{k-1} + 1) control points. These boxes are
+ * arranged in a binary tree built by median splits along the longest
+ * axis. Elements are numbered as in check_jacobian(): per-dimension
+ * element indices flattened lexicographically, last dimension fastest.
+ *
+ * The tree keeps its topology when control points move; refit()
+ * recomputes only the boxes of the affected elements and their
+ * ancestors.
+ */
+class ElementBVH {
+private:
+	struct node {
+		AABB box;
+		/* Children, or 0 for a leaf (the root is never a child) */
+		size_t left, right;
+		size_t parent;
+		/* The elements order[first], ..., order[first + count - 1] */
+		size_t first, count;
+	};
+	std::vector<node> nodes;
+	std::vector<size_t> order;
+	std::vector<size_t> leaf_of;
+	std::vector<AABB> boxes;
+
+	/* Geometry layout needed to map elements to control points */
+	std::vector<size_t> degrees, n_ctrl;
+	std::vector<std::vector<size_t>> spans;
+
+	AABB element_hull(BSplineGeometry const& geometry, size_t e) const;
+	size_t build(size_t first, size_t count, size_t parent);
+	void update(std::vector<size_t> const& dirty_leaves);
+
+public:
+	/* The largest number of elements stored in a leaf */
+	static const size_t leaf_size = 4;
+
+	ElementBVH(BSplineGeometry const& geometry);
+
+	size_t n_elements() const;
+
+	/* The bounding box of element e */
+	AABB const& element_box(size_t e) const;
+
+	/* A bounding box of the whole geometry */
+	AABB const& extent() const;
+
+	/* The elements whose boxes overlap box, in increasing order */
+	std::vector<size_t> overlapping(AABB const& box) const;
+
+	/*
+	 * The element whose box is nearest to the physical point y,
+	 * by branch and bound over the tree. If distance is not null,
+	 * the distance from y to that box is stored there; it is a
+	 * lower bound for the distance from y to the geometry.
+	 */
+	size_t nearest(ctrl_t const& y, scalar_t* distance = nullptr) const;
+
+	/*
+	 * The elements whose boxes are hit by the ray origin + t * direction
+	 * for t >= 0, as pairs (entry parameter t, element), sorted by t.
+	 */
+	std::vector<std::pair<scalar_t, size_t>> intersect_ray(ctrl_t const& origin, 
+			ctrl_t const& direction) const;
+
+	/*
+	 * The elements whose boxes are crossed by the plane through
+	 * origin with the given normal, in increasing order.
+	 */
+	std::vector<size_t> crossing_plane(ctrl_t const& origin, ctrl_t const& normal) const;
+
+	/* Recompute the boxes after the given control points moved */
+	void refit(BSplineGeometry const& geometry, std::vector<size_t> const& changed);
+
+	/* Recompute all boxes */
+	void refit(BSplineGeometry const& geometry);
+};
+
+#endif
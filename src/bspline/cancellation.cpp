@@ -0,0 +1,55 @@
+#include "cancellation.h"
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <vector>
+
+CancellationToken::CancellationToken()
+	: cancelled(false), has_deadline(false)
+{
+}
+
+void CancellationToken::cancel()
+{
+	cancelled = true;
+}
+
+void CancellationToken::set_deadline(std::chrono::steady_clock::time_point time)
+{
+	deadline = time;
+	has_deadline = true;
+}
+
+void CancellationToken::set_timeout(double seconds)
+{
+	set_deadline(std::chrono::steady_clock::now()
+			+ std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+				std::chrono::duration<double>(seconds)));
+}
+
+bool CancellationToken::stop_requested() const
+{
+	return cancelled || (has_deadline && std::chrono::steady_clock::now() >= deadline);
+}
+
+JobStatus CancellationToken::stop_reason() const
+{
+	return cancelled ? JOB_CANCELLED : JOB_DEADLINE_EXCEEDED;
+}
+
+PartialEvaluation evaluate(BSplineGeometry& geometry, std::vector<knot_t> const& x,
+		CancellationToken const& token, size_t chunk_size)
+{
+	if (chunk_size == 0) {
+		chunk_size = 1;
+	}
+	size_t n = x.size(), n_chunks = (n + chunk_size - 1) / chunk_size;
+	PartialEvaluation result;
+	result.values.resize(n);
+	size_t completed = chunked_for(geometry.get_n_threads(), n_chunks, token, [&](size_t tid, size_t c) {
+		geometry.evaluate(x, c * chunk_size, std::min(n, (c + 1) * chunk_size), result.values, tid);
+	});
+	result.status = completed == n_chunks ? JOB_COMPLETED : token.stop_reason();
+	result.values.resize(std::min(n, completed * chunk_size));
+	return result;
+}
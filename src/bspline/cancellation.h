@@ -0,0 +1,97 @@
+#ifndef BSPLINE_CANCELLATION_H
+#define BSPLINE_CANCELLATION_H
+
+#include "geometry.h"
+#include "parallel.h"
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <vector>
+
+/* How a job that can be stopped early ended */
+enum JobStatus {
+	JOB_COMPLETED,
+	JOB_CANCELLED,
+	JOB_DEADLINE_EXCEEDED
+};
+
+/*
+ * A request to stop a running job, shared between the thread that
+ * started the job (or any other thread) and its workers. The job
+ * stops once cancel() has been called or its deadline has passed.
+ * Workers check the token between chunks of work, so a job stops
+ * within about one chunk per thread.
+ */
+class CancellationToken {
+private:
+	std::atomic<bool> cancelled;
+	bool has_deadline;
+	std::chrono::steady_clock::time_point deadline;
+
+public:
+	/* A token without a deadline */
+	CancellationToken();
+
+	/* Ask the job to stop. Safe to call from any thread at any time. */
+	void cancel();
+
+	/*
+	 * Stop the job at the given time, or after the given number of
+	 * seconds. Unlike cancel(), set the deadline before the job starts.
+	 */
+	void set_deadline(std::chrono::steady_clock::time_point time);
+	void set_timeout(double seconds);
+
+	/* Whether the job should stop now */
+	bool stop_requested() const;
+
+	/* Why the job stopped: JOB_CANCELLED if cancel() was called, otherwise JOB_DEADLINE_EXCEEDED */
+	JobStatus stop_reason() const;
+};
+
+/*
+ * Call body(tid, c) for the chunks 0 <= c < n_chunks using
+ * n_threads threads, handing the chunks out in increasing order,
+ * until they run out or token.stop_requested() (checked before
+ * every chunk). tid is as in parallel_for().
+ *
+ * Returns the number of leading chunks that were all completed.
+ * After a stop, some later chunks may be completed as well.
+ */
+template <typename Body>
+size_t chunked_for(size_t n_threads, size_t n_chunks, CancellationToken const& token, Body body)
+{
+	std::atomic<size_t> next(0);
+	std::vector<char> done(n_chunks, 0);
+	parallel_for(n_threads, n_threads, [&](size_t tid, size_t) {
+		while (!token.stop_requested()) {
+			size_t c = next++;
+			if (c >= n_chunks) break;
+			body(tid, c);
+			done[c] = 1;
+		}
+	});
+	size_t completed = 0;
+	while (completed < n_chunks && done[completed]) {
+		completed++;
+	}
+	return completed;
+}
+
+/* The result of a batch evaluation that may have been stopped early */
+struct PartialEvaluation {
+	JobStatus status;
+	/* The values at x[0], ..., x[values.size() - 1] (all of x if completed) */
+	std::vector<ctrl_t> values;
+};
+
+/*
+ * Evaluate the geometry at the points x like the map operation,
+ * in chunks of chunk_size points spread over the geometry's
+ * threads, stopping early when the token asks to. The values of
+ * the longest completed prefix of x are returned.
+ */
+PartialEvaluation evaluate(BSplineGeometry& geometry, std::vector<knot_t> const& x,
+		CancellationToken const& token, size_t chunk_size = 4096);
+
+#endif
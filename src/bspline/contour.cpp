@@ -0,0 +1,319 @@
+#include "contour.h"
+#include "parallel.h"
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <functional>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+/* The contoured function of a physical point; the surface is where it vanishes */
+typedef std::function<scalar_t(ctrl_t const&)> level_t;
+
+/*
+ * A vertex on a grid edge, named by the global indices of the edge
+ * end points in increasing order, or twice the index of a grid
+ * point the surface passes through.
+ */
+typedef std::pair<size_t, size_t> edge_key;
+
+/* The polygons found in one element, before the elements are merged */
+struct element_contour {
+	std::vector<edge_key> keys;
+	std::vector<knot_t> params;
+	std::vector<ctrl_t> points;
+	std::vector<std::vector<size_t>> polygons;
+};
+
+/*
+ * The six tetrahedra of a cube (Kuhn's subdivision), as corner
+ * numbers whose bit s is the offset along axis s. All share the
+ * diagonal from corner 0 to corner 7, so neighboring cubes split
+ * their common faces the same way.
+ */
+static const int kuhn[6][4] = {
+	{0, 1, 3, 7}, {0, 1, 5, 7}, {0, 2, 3, 7}, {0, 2, 6, 7}, {0, 4, 5, 7}, {0, 4, 6, 7}
+};
+
+/*
+ * The zero of level on the parametric segment from x0 (where the
+ * level is f0 >= 0) to x1 (f1 < 0), by the Illinois variant of
+ * regula falsi, with the physical point there.
+ */
+static void edge_crossing(BSplineGeometry& geometry, level_t const& level,
+		knot_t const& x0, knot_t const& x1, scalar_t f0, scalar_t f1, size_t tid,
+		knot_t& x, ctrl_t& y)
+{
+	scalar_t a = 0, b = 1, fa = f0, fb = f1;
+	scalar_t tol = 1e-14 * (f0 - f1);
+	int side = 0;
+	x = x0;
+	for (int iter = 0; iter < 50; iter++) {
+		scalar_t t = (a * fb - b * fa) / (fb - fa);
+		for (size_t s = 0; s < x.size(); s++) {
+			x[s] = x0[s] + t * (x1[s] - x0[s]);
+		}
+		y = geometry.evaluate(x, tid);
+		scalar_t f = level(y);
+		if (std::fabs(f) <= tol || b - a <= 1e-15) break;
+		if (f >= 0) {
+			a = t;
+			fa = f;
+			if (side == 1) fb /= 2;
+			side = 1;
+		}
+		else {
+			b = t;
+			fb = f;
+			if (side == -1) fa /= 2;
+			side = -1;
+		}
+	}
+}
+
+/* The parametric box lo <= x <= hi of element e, given the breakpoints */
+static void element_domain(std::vector<std::vector<scalar_t>> const& breaks, size_t e,
+		knot_t& lo, knot_t& hi)
+{
+	size_t k = breaks.size();
+	lo.resize(k);
+	hi.resize(k);
+	for (size_t s = k, rest = e; s > 0; s--) {
+		size_t n_elem = breaks[s - 1].size() - 1;
+		lo[s - 1] = breaks[s - 1][rest % n_elem];
+		hi[s - 1] = breaks[s - 1][rest % n_elem + 1];
+		rest /= n_elem;
+	}
+}
+
+/* The first three coordinates of b - a */
+static std::vector<scalar_t> difference(ctrl_t const& a, ctrl_t const& b)
+{
+	return {b[0] - a[0], b[1] - a[1], b[2] - a[2]};
+}
+
+/*
+ * Contour level on the given elements of a trivariate geometry,
+ * sampled with n_per_span segments per span along every axis.
+ */
+static PolygonMesh contour_elements(BSplineGeometry& geometry, std::vector<size_t> const& elements,
+		size_t n_per_span, level_t const& level)
+{
+	if (n_per_span == 0) {
+		error("at least one segment per span is needed");
+	}
+	std::vector<std::vector<scalar_t>> samples(3);
+	std::vector<size_t> n_elems(3);
+	for (size_t s = 0; s < 3; s++) {
+		samples[s] = uniform_samples(geometry, s, n_per_span);
+		n_elems[s] = geometry.get_spans(s).size();
+	}
+	size_t n = n_per_span, m = n + 1;
+
+	std::vector<element_contour> pieces(elements.size());
+	parallel_for(geometry.get_n_threads(), elements.size(), [&](size_t tid, size_t i) {
+		size_t el[3];
+		for (size_t s = 3, rest = elements[i]; s > 0; s--) {
+			el[s - 1] = rest % n_elems[s - 1];
+			rest /= n_elems[s - 1];
+		}
+
+		/* The level at the (n + 1)^3 grid points of the element */
+		std::vector<size_t> global(m * m * m);
+		std::vector<knot_t> x(m * m * m);
+		std::vector<ctrl_t> y(m * m * m);
+		std::vector<scalar_t> f(m * m * m);
+		for (size_t a = 0; a < m; a++) {
+			for (size_t b = 0; b < m; b++) {
+				for (size_t c = 0; c < m; c++) {
+					size_t l = (a * m + b) * m + c;
+					size_t g[3] = {el[0] * n + a, el[1] * n + b, el[2] * n + c};
+					global[l] = (g[0] * samples[1].size() + g[1]) * samples[2].size() + g[2];
+					x[l] = {samples[0][g[0]], samples[1][g[1]], samples[2][g[2]]};
+					y[l] = geometry.evaluate(x[l], tid);
+					f[l] = level(y[l]);
+				}
+			}
+		}
+
+		element_contour& piece = pieces[i];
+		std::map<edge_key, size_t> found;
+		auto vertex = [&](size_t p, size_t q) {
+			/* p is on the nonnegative side, q on the negative side */
+			edge_key key = f[p] == 0 ? edge_key(global[p], global[p])
+				: edge_key(std::min(global[p], global[q]), std::max(global[p], global[q]));
+			auto it = found.find(key);
+			if (it != found.end()) return it->second;
+			knot_t xv = x[p];
+			ctrl_t yv = y[p];
+			if (f[p] != 0) {
+				edge_crossing(geometry, level, x[p], x[q], f[p], f[q], tid, xv, yv);
+			}
+			size_t index = piece.keys.size();
+			found[key] = index;
+			piece.keys.push_back(key);
+			piece.params.push_back(xv);
+			piece.points.push_back(yv);
+			return index;
+		};
+
+		for (size_t a = 0; a < n; a++) {
+			for (size_t b = 0; b < n; b++) {
+				for (size_t c = 0; c < n; c++) {
+					size_t corner[8];
+					for (int k = 0; k < 8; k++) {
+						corner[k] = ((a + (k & 1)) * m + b + ((k >> 1) & 1)) * m + c + ((k >> 2) & 1);
+					}
+					for (auto const& tet : kuhn) {
+						std::vector<size_t> pos, neg;
+						for (int k = 0; k < 4; k++) {
+							size_t l = corner[tet[k]];
+							(f[l] >= 0 ? pos : neg).push_back(l);
+						}
+						if (pos.empty() || neg.empty()) continue;
+
+						std::vector<size_t> polygon;
+						if (pos.size() == 1) {
+							for (size_t q : neg) polygon.push_back(vertex(pos[0], q));
+						}
+						else if (neg.size() == 1) {
+							for (size_t p : pos) polygon.push_back(vertex(p, neg[0]));
+						}
+						else {
+							polygon = {vertex(pos[0], neg[0]), vertex(pos[0], neg[1]),
+								vertex(pos[1], neg[1]), vertex(pos[1], neg[0])};
+						}
+
+						/* Drop repeated vertices where the surface passes through grid points */
+						polygon.erase(std::unique(polygon.begin(), polygon.end()), polygon.end());
+						while (polygon.size() > 1 && polygon.back() == polygon.front()) polygon.pop_back();
+						if (polygon.size() < 3) continue;
+
+						/* Orient the polygon from the negative towards the positive side */
+						std::vector<scalar_t> up{0, 0, 0};
+						for (size_t p : pos) {
+							for (size_t q : neg) {
+								std::vector<scalar_t> d = difference(y[q], y[p]);
+								for (int r = 0; r < 3; r++) up[r] += d[r];
+							}
+						}
+						std::vector<scalar_t> normal{0, 0, 0};
+						ctrl_t const& o = piece.points[polygon[0]];
+						for (size_t v = 1; v + 1 < polygon.size(); v++) {
+							std::vector<scalar_t> e1 = difference(o, piece.points[polygon[v]]);
+							std::vector<scalar_t> e2 = difference(o, piece.points[polygon[v + 1]]);
+							normal[0] += e1[1] * e2[2] - e1[2] * e2[1];
+							normal[1] += e1[2] * e2[0] - e1[0] * e2[2];
+							normal[2] += e1[0] * e2[1] - e1[1] * e2[0];
+						}
+						if (normal[0] * up[0] + normal[1] * up[1] + normal[2] * up[2] < 0) {
+							std::reverse(polygon.begin(), polygon.end());
+						}
+						piece.polygons.push_back(polygon);
+					}
+				}
+			}
+		}
+	});
+
+	/* Merge the elements in order, sharing the vertices on common edges */
+	PolygonMesh mesh;
+	std::map<edge_key, size_t> merged;
+	for (element_contour const& piece : pieces) {
+		std::vector<size_t> index(piece.keys.size());
+		for (size_t v = 0; v < piece.keys.size(); v++) {
+			auto it = merged.find(piece.keys[v]);
+			if (it != merged.end()) {
+				index[v] = it->second;
+				continue;
+			}
+			index[v] = mesh.points.size();
+			merged[piece.keys[v]] = index[v];
+			mesh.params.push_back(piece.params[v]);
+			mesh.points.push_back(piece.points[v]);
+		}
+		for (std::vector<size_t> const& polygon : piece.polygons) {
+			mesh.polygons.push_back({});
+			for (size_t v : polygon) mesh.polygons.back().push_back(index[v]);
+		}
+	}
+
+	for (size_t r = 3; r < geometry.get_n_cdims(); r++) {
+		PointField field{"Component " + std::to_string(r), {}};
+		for (ctrl_t const& point : mesh.points) field.values.push_back(point[r]);
+		mesh.point_fields.push_back(field);
+	}
+	return mesh;
+}
+
+PolygonMesh slice_plane(BSplineGeometry& geometry, ElementBVH const& bvh,
+		ctrl_t const& origin, ctrl_t const& normal, size_t n_per_span)
+{
+	if (geometry.get_n_kdims() != 3 || geometry.get_n_cdims() < 3) {
+		error("only volumes in three dimensions can be sliced");
+	}
+	if (origin.size() != 3 || normal.size() != 3) {
+		error("the plane must be given in three dimensions");
+	}
+	if (normal[0] == 0 && normal[1] == 0 && normal[2] == 0) {
+		error("the plane normal must not be zero");
+	}
+
+	/* Tighten the control point boxes of the BVH to the Bezier boxes */
+	std::vector<size_t> candidates = bvh.crossing_plane(origin, normal);
+	std::vector<char> crossed(candidates.size());
+	std::vector<std::vector<scalar_t>> breaks(3);
+	for (size_t s = 0; s < 3; s++) {
+		breaks[s] = geometry.get_breakpoints(s);
+	}
+	parallel_for(geometry.get_n_threads(), candidates.size(), [&](size_t, size_t i) {
+		knot_t lo, hi;
+		element_domain(breaks, candidates[i], lo, hi);
+		crossed[i] = image_bounds(geometry, lo, hi, 1).crosses_plane(origin, normal);
+	});
+	std::vector<size_t> elements;
+	for (size_t i = 0; i < candidates.size(); i++) {
+		if (crossed[i]) elements.push_back(candidates[i]);
+	}
+	return contour_elements(geometry, elements, n_per_span, [&](ctrl_t const& y) {
+		return normal[0] * (y[0] - origin[0]) + normal[1] * (y[1] - origin[1])
+			+ normal[2] * (y[2] - origin[2]);
+	});
+}
+
+PolygonMesh isosurface(BSplineGeometry& geometry, size_t component, scalar_t isovalue,
+		size_t n_per_span)
+{
+	if (geometry.get_n_kdims() != 3 || geometry.get_n_cdims() < 3) {
+		error("isosurfaces need a volume in three dimensions");
+	}
+	if (component >= geometry.get_n_cdims()) {
+		error("component out of range");
+	}
+
+	std::vector<std::vector<scalar_t>> breaks(3);
+	size_t total = 1;
+	for (size_t s = 0; s < 3; s++) {
+		breaks[s] = geometry.get_breakpoints(s);
+		total *= breaks[s].size() - 1;
+	}
+
+	/* Whether the Bezier bounds of the field on each element contain isovalue */
+	std::vector<char> straddles(total);
+	parallel_for(geometry.get_n_threads(), total, [&](size_t, size_t e) {
+		knot_t lo, hi;
+		element_domain(breaks, e, lo, hi);
+		AABB bounds = image_bounds(geometry, lo, hi, 1);
+		straddles[e] = bounds.lo[component] <= isovalue && isovalue <= bounds.hi[component];
+	});
+
+	std::vector<size_t> elements;
+	for (size_t e = 0; e < total; e++) {
+		if (straddles[e]) elements.push_back(e);
+	}
+	return contour_elements(geometry, elements, n_per_span, [&](ctrl_t const& y) {
+		return y[component] - isovalue;
+	});
+}
@@ -0,0 +1,61 @@
+#ifndef BSPLINE_CONTOUR_H
+#define BSPLINE_CONTOUR_H
+
+#include "bvh.h"
+#include "geometry.h"
+#include "tessellation.h"
+#include <cstddef>
+#include <vector>
+
+/*
+ * A polygonal surface (triangles and quadrilaterals) in a
+ * geometry with three parametric dimensions, such as a slice or
+ * an isosurface. Vertices shared by neighboring polygons are
+ * stored once.
+ */
+struct PolygonMesh {
+	/* Parametric and physical coordinates of each vertex */
+	std::vector<knot_t> params;
+	std::vector<ctrl_t> points;
+	/* Vertex indices of each polygon, counterclockwise around its normal */
+	std::vector<std::vector<size_t>> polygons;
+	/* Additional per-vertex fields to output with the mesh */
+	std::vector<PointField> point_fields;
+};
+
+/*
+ * Intersect a volume (n_kdims = 3, n_cdims >= 3) with the plane
+ * through origin with the given normal (both with three
+ * coordinates) without sampling the whole volume.
+ *
+ * Only the elements whose boxes in the BVH are crossed by the plane,
+ * and whose tighter Bezier boxes (see image_bounds()) are too, are
+ * visited. Each is sampled with n_per_span segments along every
+ * axis and split into tetrahedra, and the signed distance to the
+ * plane is contoured on each tetrahedron (marching tetrahedra). The
+ * crossings on the edges are then solved for on the spline itself,
+ * by regula falsi along the parametric edge, so every vertex lies on
+ * the plane up to rounding. Elements are processed in parallel with
+ * the geometry's threads; the mesh is conforming across elements.
+ *
+ * The polygons face along normal. Coordinates beyond the third are
+ * output as point fields named "Component 3", "Component 4", ...,
+ * evaluated on the spline at the vertices.
+ */
+PolygonMesh slice_plane(BSplineGeometry& geometry, ElementBVH const& bvh,
+		ctrl_t const& origin, ctrl_t const& normal, size_t n_per_span = 4);
+
+/*
+ * The isosurface where coordinate component of a volume
+ * (n_kdims = 3, n_cdims >= 3), typically a scalar field stored
+ * as an extra coordinate beyond the first three, equals isovalue.
+ *
+ * The elements whose Bezier coefficients do not straddle isovalue
+ * (see image_bounds()) are skipped by the convex hull property. The
+ * others are contoured as in slice_plane(), in parallel with the
+ * geometry's threads. The polygons face towards larger values.
+ */
+PolygonMesh isosurface(BSplineGeometry& geometry, size_t component, scalar_t isovalue,
+		size_t n_per_span = 4);
+
+#endif
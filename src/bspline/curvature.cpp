@@ -0,0 +1,168 @@
+#include "curvature.h"
+#include "parallel.h"
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+/*
+ * The nonzero basis functions along one axis at one coordinate,
+ * with their first and second derivatives.
+ */
+struct axis_basis {
+	size_t first;
+	std::vector<std::vector<scalar_t>> ders;
+};
+
+static axis_basis tabulate(BSplineGeometry const& geometry, size_t s, scalar_t u)
+{
+	std::vector<scalar_t> const& t = geometry.get_knot_vector(s);
+	if (u < t.front() || u > t.back()) {
+		error("evaluating at out-of-bounds point");
+	}
+	axis_basis b;
+	size_t j = geometry.find_span(s, u);
+	b.first = j - geometry.get_degree(s);
+	geometry.basis_derivatives(s, j, u, 2, b.ders);
+	return b;
+}
+
+/*
+ * The curvatures from S_u, S_v, S_uu, S_uv, S_vv given as rows of d,
+ * each with three (zero padded) coordinates.
+ */
+static SurfaceCurvature curvature_from(scalar_t const d[5][3])
+{
+	SurfaceCurvature c{0, 0, 0, 0};
+	auto dot = [](scalar_t const* a, scalar_t const* b) {
+		return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+	};
+	scalar_t const* Su = d[0];
+	scalar_t const* Sv = d[1];
+	scalar_t n[3] = {Su[1] * Sv[2] - Su[2] * Sv[1], Su[2] * Sv[0] - Su[0] * Sv[2], Su[0] * Sv[1] - Su[1] * Sv[0]};
+	scalar_t len = std::sqrt(dot(n, n));
+	if (len == 0) {
+		return c;
+	}
+	for (scalar_t& v : n) {
+		v /= len;
+	}
+
+	/* First and second fundamental forms */
+	scalar_t E = dot(Su, Su), F = dot(Su, Sv), G = dot(Sv, Sv);
+	scalar_t L = dot(d[2], n), M = dot(d[3], n), N = dot(d[4], n);
+	scalar_t det = E * G - F * F;
+
+	c.gaussian = (L * N - M * M) / det;
+	c.mean = (E * N - 2 * F * M + G * L) / (2 * det);
+	scalar_t disc = std::sqrt(std::max<scalar_t>(c.mean * c.mean - c.gaussian, 0));
+	c.k1 = c.mean + disc;
+	c.k2 = c.mean - disc;
+	return c;
+}
+
+/*
+ * S_u, S_v, S_uu, S_uv, S_vv at one point, summing over the second
+ * dimension first so that each control point is read once. Only the
+ * first three physical coordinates take part.
+ */
+static SurfaceCurvature curvature_kernel(BSplineGeometry const& geometry, 
+		axis_basis const& bu, axis_basis const& bv)
+{
+	size_t n_c = std::min<size_t>(geometry.get_n_cdims(), 3);
+	size_t pu = geometry.get_degree(0), pv = geometry.get_degree(1);
+	size_t n_v = geometry.get_n_ctrl(1);
+	std::vector<scalar_t> const& Nu0 = bu.ders[0];
+	std::vector<scalar_t> const& Nu1 = bu.ders[1];
+	std::vector<scalar_t> const& Nu2 = bu.ders[2];
+
+	scalar_t d[5][3] = {};
+	for (size_t a = 0; a <= pu; a++) {
+		scalar_t v[3][3] = {};
+		size_t row = (bu.first + a) * n_v + bv.first;
+		for (size_t b = 0; b <= pv; b++) {
+			scalar_t const* P = geometry.get_control_point(row + b);
+			for (size_t r = 0; r < n_c; r++) {
+				v[0][r] += bv.ders[0][b] * P[r];
+				v[1][r] += bv.ders[1][b] * P[r];
+				v[2][r] += bv.ders[2][b] * P[r];
+			}
+		}
+		for (size_t r = 0; r < n_c; r++) {
+			d[0][r] += Nu1[a] * v[0][r];
+			d[1][r] += Nu0[a] * v[1][r];
+			d[2][r] += Nu2[a] * v[0][r];
+			d[3][r] += Nu1[a] * v[1][r];
+			d[4][r] += Nu0[a] * v[2][r];
+		}
+	}
+	return curvature_from(d);
+}
+
+SurfaceCurvature surface_curvature(std::vector<ctrl_t> const& ders)
+{
+	scalar_t d[5][3] = {};
+	for (size_t i = 0; i < 5; i++) {
+		for (size_t r = 0; r < ders[i].size() && r < 3; r++) {
+			d[i][r] = ders[i][r];
+		}
+	}
+	return curvature_from(d);
+}
+
+std::vector<SurfaceCurvature> evaluate_curvature(BSplineGeometry const& geometry, 
+		std::vector<knot_t> const& x)
+{
+	if (geometry.get_n_kdims() != 2) {
+		error("curvature requires a geometry with two parametric dimensions");
+	}
+	std::vector<SurfaceCurvature> result(x.size());
+	parallel_for(geometry.get_n_threads(), x.size(), [&](size_t, size_t i) {
+		if (x[i].size() != 2) {
+			error("dimensions of evaluation point do not match B-spline geometry");
+		}
+		result[i] = curvature_kernel(geometry, tabulate(geometry, 0, x[i][0]), 
+				tabulate(geometry, 1, x[i][1]));
+	});
+	return result;
+}
+
+std::vector<SurfaceCurvature> evaluate_curvature_grid(BSplineGeometry const& geometry,
+		std::vector<std::vector<scalar_t>> const& samples)
+{
+	if (geometry.get_n_kdims() != 2 || samples.size() != 2) {
+		error("curvature requires a geometry with two parametric dimensions");
+	}
+	std::vector<std::vector<axis_basis>> tab(2);
+	for (size_t s = 0; s < 2; s++) {
+		for (scalar_t u : samples[s]) {
+			tab[s].push_back(tabulate(geometry, s, u));
+		}
+	}
+
+	size_t n_u = samples[0].size(), n_v = samples[1].size();
+	std::vector<SurfaceCurvature> result(n_u * n_v);
+	parallel_for(geometry.get_n_threads(), n_u, [&](size_t, size_t i) {
+		for (size_t j = 0; j < n_v; j++) {
+			result[i * n_v + j] = curvature_kernel(geometry, tab[0][i], tab[1][j]);
+		}
+	});
+	return result;
+}
+
+void add_curvature_fields(BSplineGeometry const& geometry, TessellationMesh& mesh)
+{
+	std::vector<SurfaceCurvature> c = evaluate_curvature_grid(geometry, mesh.samples);
+	PointField gaussian{"Gaussian Curvature", {}}, mean{"Mean Curvature", {}};
+	PointField k1{"Max Principal Curvature", {}}, k2{"Min Principal Curvature", {}};
+	for (SurfaceCurvature const& v : c) {
+		gaussian.values.push_back(v.gaussian);
+		mean.values.push_back(v.mean);
+		k1.values.push_back(v.k1);
+		k2.values.push_back(v.k2);
+	}
+	mesh.point_fields.push_back(gaussian);
+	mesh.point_fields.push_back(mean);
+	mesh.point_fields.push_back(k1);
+	mesh.point_fields.push_back(k2);
+}
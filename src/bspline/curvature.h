@@ -0,0 +1,57 @@
+#ifndef BSPLINE_CURVATURE_H
+#define BSPLINE_CURVATURE_H
+
+#include "geometry.h"
+#include "tessellation.h"
+#include <cstddef>
+#include <vector>
+
+/*
+ * Curvatures of a surface (a geometry with n_kdims = 2) at a point.
+ * k1 >= k2 are the principal curvatures; their sign follows the
+ * normal S_u x S_v.
+ */
+struct SurfaceCurvature {
+	scalar_t gaussian;
+	scalar_t mean;
+	scalar_t k1;
+	scalar_t k2;
+};
+
+/*
+ * The curvatures of a surface from its first and second partial
+ * derivatives S_u, S_v, S_uu, S_uv, S_vv (in that order), using the
+ * first and second fundamental forms. Surfaces in the plane
+ * (n_cdims = 2) have zero curvature. At singular points
+ * (S_u x S_v = 0) all curvatures are reported as zero.
+ */
+SurfaceCurvature surface_curvature(std::vector<ctrl_t> const& ders);
+
+/*
+ * Evaluate the curvatures of a surface at a batch of parametric
+ * points, in parallel with geometry.get_n_threads() threads.
+ *
+ * The first and second derivatives are computed together from one
+ * tabulation of the basis functions and their derivatives per point,
+ * and the tensor product is summed one dimension at a time.
+ */
+std::vector<SurfaceCurvature> evaluate_curvature(BSplineGeometry const& geometry, 
+		std::vector<knot_t> const& x);
+
+/*
+ * Evaluate the curvatures on the tensor grid samples[0] x samples[1],
+ * in the vertex order of TessellationMesh. The basis functions are
+ * tabulated once per sample value on each axis rather than once per
+ * point.
+ */
+std::vector<SurfaceCurvature> evaluate_curvature_grid(BSplineGeometry const& geometry,
+		std::vector<std::vector<scalar_t>> const& samples);
+
+/*
+ * Append the Gaussian, mean and principal curvatures at the mesh
+ * vertices to mesh.point_fields. The mesh must come from
+ * tessellating this (two dimensional) geometry.
+ */
+void add_curvature_fields(BSplineGeometry const& geometry, TessellationMesh& mesh);
+
+#endif
@@ -0,0 +1,340 @@
+#include "fitting.h"
+#include "linalg.h"
+#include "parallel.h"
+#include <algorithm>
+#include <cstddef>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+std::vector<scalar_t> greville_abscissae(std::vector<scalar_t> const& knot_vector, size_t degree)
+{
+	size_t n_ctrl = knot_vector.size() - degree - 1;
+	std::vector<scalar_t> g(n_ctrl);
+	for (size_t i = 0; i < n_ctrl; i++) {
+		if (degree == 0) {
+			g[i] = 0.5 * (knot_vector[i] + knot_vector[i + 1]);
+			continue;
+		}
+		scalar_t sum = 0;
+		for (size_t q = 1; q <= degree; q++) {
+			sum += knot_vector[i + q];
+		}
+		g[i] = sum / degree;
+	}
+	return g;
+}
+
+BSplineGeometry interpolate_grid(std::vector<size_t> const& degrees,
+		std::vector<std::vector<scalar_t>> const& knots, std::vector<ctrl_t> const& points,
+		size_t n_threads)
+{
+	size_t k = degrees.size();
+	if (points.empty()) {
+		error("no points to interpolate");
+	}
+	size_t n_cdims = points[0].size();
+
+	/*
+	 * A geometry with the requested layout; the points themselves
+	 * serve as placeholder control points and validate the sizes.
+	 */
+	BSplineGeometry layout(k, n_cdims, degrees, knots, points, n_threads);
+	std::vector<ctrl_t> ctrl = points;
+
+	for (size_t s = 0; s < k; s++) {
+		size_t n = layout.get_n_ctrl(s);
+		size_t p = degrees[s];
+
+		/* The collocation matrix N_j(g_i) at the Greville abscissae */
+		std::vector<scalar_t> g = greville_abscissae(layout.get_knot_vector(s), p);
+		BandedMatrix A(n, p, p);
+		std::vector<std::vector<scalar_t>> ders;
+		for (size_t i = 0; i < n; i++) {
+			size_t j = layout.find_span(s, g[i]);
+			layout.basis_derivatives(s, j, g[i], 0, ders);
+			for (size_t q = 0; q <= p; q++) {
+				size_t col = j - p + q;
+				if (col + p < i || col > i + p) {
+					if (ders[0][q] != 0) {
+						error("collocation matrix is not banded");
+					}
+					continue;
+				}
+				A.at(i, col) = ders[0][q];
+			}
+		}
+		banded_lu(A);
+
+		/* Solve along every line of points in dimension s */
+		size_t stride = 1, outer = 1;
+		for (size_t r = s + 1; r < k; r++) stride *= layout.get_n_ctrl(r);
+		for (size_t r = 0; r < s; r++) outer *= layout.get_n_ctrl(r);
+		parallel_for(n_threads, outer * stride, [&](size_t, size_t line) {
+			size_t base = (line / stride) * n * stride + line % stride;
+			std::vector<ctrl_t> b(n);
+			for (size_t i = 0; i < n; i++) {
+				b[i] = ctrl[base + i * stride];
+			}
+			banded_solve(A, b);
+			for (size_t i = 0; i < n; i++) {
+				ctrl[base + i * stride] = b[i];
+			}
+		});
+	}
+	return BSplineGeometry(k, n_cdims, degrees, knots, ctrl, n_threads);
+}
+
+BSplineGeometry interpolate_grid(std::vector<size_t> const& n_points, std::vector<size_t> const& degrees,
+		std::vector<ctrl_t> const& points, size_t n_threads)
+{
+	if (n_points.size() != degrees.size()) {
+		error("incorrect number of degrees provided");
+	}
+	std::vector<std::vector<scalar_t>> knots(n_points.size());
+	for (size_t s = 0; s < n_points.size(); s++) {
+		if (n_points[s] < degrees[s] + 1) {
+			error("too few points to interpolate with this degree");
+		}
+		size_t n_knots = n_points[s] - degrees[s] + 1;
+		for (size_t i = 0; i < n_knots; i++) {
+			knots[s].push_back(scalar_t(i) / (n_knots - 1));
+		}
+	}
+	return interpolate_grid(degrees, knots, points, n_threads);
+}
+
+/*
+ * The sparsity pattern of A^T A for the given layout: the basis
+ * functions with indices i and j overlap when |i_s - j_s| <= p_s in
+ * every dimension s.
+ */
+static SparseMatrix normal_pattern(BSplineGeometry const& layout)
+{
+	size_t k = layout.get_n_kdims(), n = 1;
+	for (size_t s = 0; s < k; s++) {
+		n *= layout.get_n_ctrl(s);
+	}
+	SparseMatrix M;
+	M.n = n;
+	M.row_start.push_back(0);
+	std::vector<size_t> lo(k), hi(k), j(k);
+	for (size_t I = 0; I < n; I++) {
+		for (size_t s = k, rest = I; s > 0; s--) {
+			size_t i = rest % layout.get_n_ctrl(s - 1), p = layout.get_degree(s - 1);
+			rest /= layout.get_n_ctrl(s - 1);
+			lo[s - 1] = i > p ? i - p : 0;
+			hi[s - 1] = std::min(i + p, layout.get_n_ctrl(s - 1) - 1);
+		}
+
+		/* The columns of row I, in increasing (lexicographic) order */
+		j = lo;
+		while (true) {
+			size_t J = 0;
+			for (size_t s = 0; s < k; s++) {
+				J = j[s] + layout.get_n_ctrl(s) * J;
+			}
+			M.column.push_back(J);
+			size_t s = k;
+			for (; s > 0; s--) {
+				if (++j[s - 1] <= hi[s - 1]) break;
+				j[s - 1] = lo[s - 1];
+			}
+			if (s == 0) break;
+		}
+		M.row_start.push_back(M.column.size());
+	}
+	M.value.assign(M.column.size(), 0);
+	return M;
+}
+
+/* Placeholder control points for a layout */
+static std::vector<ctrl_t> zero_control_points(size_t n_cdims, std::vector<size_t> const& degrees,
+		std::vector<std::vector<scalar_t>> const& knots)
+{
+	size_t n = 1;
+	for (size_t s = 0; s < degrees.size() && s < knots.size(); s++) {
+		n *= knots[s].size() + degrees[s] - 1;
+	}
+	return std::vector<ctrl_t>(n, ctrl_t(n_cdims, 0));
+}
+
+LeastSquaresFitter::LeastSquaresFitter(size_t n_cdims, std::vector<size_t> const& degrees,
+		std::vector<std::vector<scalar_t>> const& knots, size_t n_threads)
+	: n_kdims(degrees.size()), n_cdims(n_cdims), n_threads(n_threads), 
+	  degrees(degrees), knots(knots),
+	  layout(degrees.size(), n_cdims, degrees, knots, 
+			  zero_control_points(n_cdims, degrees, knots), n_threads),
+	  normal(normal_pattern(layout)),
+	  rhs(layout.get_n_control_points(), ctrl_t(n_cdims, 0)),
+	  n_samples(0)
+{
+}
+
+void LeastSquaresFitter::accumulate(std::vector<knot_t> const& x, std::vector<ctrl_t> const& y,
+		size_t begin, size_t end, std::vector<scalar_t>& M, std::vector<ctrl_t>& b,
+		size_t& row_begin, size_t& row_end) const
+{
+	row_begin = b.size();
+	row_end = 0;
+	std::vector<std::vector<std::vector<scalar_t>>> ders(n_kdims);
+	std::vector<size_t> first(n_kdims);
+	size_t support = 1;
+	for (size_t s = 0; s < n_kdims; s++) {
+		support *= degrees[s] + 1;
+	}
+	std::vector<size_t> index(support), offset(support * n_kdims);
+	std::vector<scalar_t> weight(support);
+	std::vector<size_t> lo(n_kdims), width(n_kdims);
+
+	for (size_t i = begin; i < end; i++) {
+		if (x[i].size() != n_kdims || y[i].size() != n_cdims) {
+			error("sample has incorrect dimension");
+		}
+		for (size_t s = 0; s < n_kdims; s++) {
+			std::vector<scalar_t> const& t = layout.get_knot_vector(s);
+			if (x[i][s] < t.front() || x[i][s] > t.back()) {
+				error("sample parameter out of bounds");
+			}
+			size_t j = layout.find_span(s, x[i][s]);
+			first[s] = j - degrees[s];
+			layout.basis_derivatives(s, j, x[i][s], 0, ders[s]);
+		}
+
+		/* The nonzero entries of row i of A */
+		std::vector<size_t> pos(n_kdims, 0);
+		for (size_t a = 0; a < support; a++) {
+			size_t I = 0;
+			scalar_t B = 1;
+			for (size_t s = 0; s < n_kdims; s++) {
+				I = first[s] + pos[s] + layout.get_n_ctrl(s) * I;
+				B *= ders[s][0][pos[s]];
+			}
+			index[a] = I;
+			weight[a] = B;
+			std::copy(pos.begin(), pos.end(), offset.begin() + a * n_kdims);
+			row_begin = std::min(row_begin, I);
+			row_end = std::max(row_end, I + 1);
+			for (size_t s = n_kdims; s > 0; s--) {
+				if (++pos[s - 1] <= degrees[s - 1]) break;
+				pos[s - 1] = 0;
+			}
+		}
+
+		for (size_t a = 0; a < support; a++) {
+			if (weight[a] == 0) continue;
+
+			/* Row index[a] stores the box lo <= j < lo + width of normal_pattern() */
+			for (size_t s = 0; s < n_kdims; s++) {
+				size_t i = first[s] + offset[a * n_kdims + s];
+				lo[s] = i > degrees[s] ? i - degrees[s] : 0;
+				width[s] = std::min(i + degrees[s], layout.get_n_ctrl(s) - 1) - lo[s] + 1;
+			}
+			scalar_t* row = &M[normal.row_start[index[a]]];
+			for (size_t c = 0; c < support; c++) {
+				size_t k = 0;
+				for (size_t s = 0; s < n_kdims; s++) {
+					k = first[s] + offset[c * n_kdims + s] - lo[s] + width[s] * k;
+				}
+				row[k] += weight[a] * weight[c];
+			}
+			for (size_t r = 0; r < n_cdims; r++) {
+				b[index[a]][r] += weight[a] * y[i][r];
+			}
+		}
+	}
+}
+
+void LeastSquaresFitter::add_samples(std::vector<knot_t> const& x, std::vector<ctrl_t> const& y)
+{
+	if (x.size() != y.size()) {
+		error("number of sample parameters and values do not match");
+	}
+	size_t n = x.size();
+	size_t n_blocks = (n + sample_block - 1) / sample_block;
+	size_t slots = std::min(n_threads, n_blocks);
+	while (partial_M.size() < slots) {
+		partial_M.push_back(std::vector<scalar_t>(normal.value.size(), 0));
+		partial_b.push_back(std::vector<ctrl_t>(rhs.size(), ctrl_t(n_cdims, 0)));
+	}
+
+	/* Blocks first, ..., first + slots - 1 in parallel, then added in block order */
+	std::vector<size_t> row_begin(slots), row_end(slots);
+	for (size_t first = 0; first < n_blocks; first += slots) {
+		size_t count = std::min(slots, n_blocks - first);
+		parallel_for(n_threads, count, [&](size_t, size_t j) {
+			size_t begin = (first + j) * sample_block;
+			accumulate(x, y, begin, std::min(n, begin + sample_block),
+					partial_M[j], partial_b[j], row_begin[j], row_end[j]);
+		});
+		for (size_t j = 0; j < count; j++) {
+			for (size_t i = normal.row_start[row_begin[j]]; i < normal.row_start[row_end[j]]; i++) {
+				normal.value[i] += partial_M[j][i];
+				partial_M[j][i] = 0;
+			}
+			for (size_t i = row_begin[j]; i < row_end[j]; i++) {
+				for (size_t r = 0; r < n_cdims; r++) {
+					rhs[i][r] += partial_b[j][i][r];
+					partial_b[j][i][r] = 0;
+				}
+			}
+		}
+	}
+	n_samples += n;
+}
+
+long LeastSquaresFitter::add_samples_from_file(std::string const& filename, size_t chunk_size)
+{
+	std::ifstream file(filename);
+	if (!file.is_open()) {
+		return -1;
+	}
+	if (chunk_size == 0) {
+		chunk_size = 1;
+	}
+
+	long count = 0;
+	std::vector<knot_t> x;
+	std::vector<ctrl_t> y;
+	std::string line;
+	while (std::getline(file, line)) {
+		std::istringstream in(line);
+		knot_t u(n_kdims);
+		ctrl_t v(n_cdims);
+		size_t read = 0;
+		for (size_t s = 0; s < n_kdims && in >> u[s]; s++) read++;
+		for (size_t r = 0; r < n_cdims && in >> v[r]; r++) read++;
+		if (read == 0) continue;
+		if (read != n_kdims + n_cdims) {
+			error("malformed sample line");
+		}
+		x.push_back(u);
+		y.push_back(v);
+		if (x.size() == chunk_size) {
+			add_samples(x, y);
+			count += x.size();
+			x.clear();
+			y.clear();
+		}
+	}
+	add_samples(x, y);
+	count += x.size();
+	return count;
+}
+
+size_t LeastSquaresFitter::get_n_samples() const
+{
+	return n_samples;
+}
+
+BSplineGeometry LeastSquaresFitter::solve(scalar_t regularization, scalar_t tolerance) const
+{
+	SparseMatrix M = normal;
+	for (size_t i = 0; i < M.n; i++) {
+		M.at(i, i) += regularization;
+	}
+	std::vector<ctrl_t> ctrl = rhs;
+	sparse_solve(M, ctrl, tolerance, 10 * M.n + 100, n_threads);
+	return BSplineGeometry(n_kdims, n_cdims, degrees, knots, ctrl, n_threads);
+}
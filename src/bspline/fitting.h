@@ -0,0 +1,127 @@
+#ifndef BSPLINE_FITTING_H
+#define BSPLINE_FITTING_H
+
+#include "geometry.h"
+#include "linalg.h"
+#include <cstddef>
+#include <string>
+#include <vector>
+
+/*
+ * The Greville abscissae of a padded (clamped) knot vector t of
+ * the given degree p: the averages (t_{i+1} + ... + t_{i+p}) / p
+ * for each control point i (the knot midpoints for p = 0).
+ */
+std::vector<scalar_t> greville_abscissae(std::vector<scalar_t> const& knot_vector, size_t degree);
+
+/*
+ * Interpolate a grid of points by a BSplineGeometry with the given
+ * degrees and (unpadded, as for the BSplineGeometry constructor)
+ * knot vectors.
+ *
+ * The grid has get_n_ctrl(s) = knots[s].size() + degrees[s] - 1
+ * points along each dimension s, ordered like control points (last
+ * dimension fastest). The spline passes through the point with
+ * index (i_0, ..., i_{k-1}) at the parametric point whose coordinate
+ * s is the i_s-th Greville abscissa.
+ *
+ * The collocation matrix of each dimension is banded with bandwidth
+ * p_s, and is factored once in O(n_s * p_s^2) operations. The tensor
+ * product system is then solved one dimension at a time, each
+ * dimension in parallel over all lines of points along it, with
+ * n_threads threads. The result is prepared for n_threads threads.
+ */
+BSplineGeometry interpolate_grid(std::vector<size_t> const& degrees,
+		std::vector<std::vector<scalar_t>> const& knots, std::vector<ctrl_t> const& points,
+		size_t n_threads = 1);
+
+/*
+ * As above, with uniform knots on [0, 1] chosen so that there are
+ * n_points[s] control points along each dimension s.
+ */
+BSplineGeometry interpolate_grid(std::vector<size_t> const& n_points, std::vector<size_t> const& degrees,
+		std::vector<ctrl_t> const& points, size_t n_threads = 1);
+
+/*
+ * Least squares approximation of scattered samples by a
+ * BSplineGeometry with a fixed layout (degrees and knot vectors).
+ *
+ * Samples (x_i, y_i) are accumulated into the normal equations
+ * A^T A c = A^T y, where row i of A holds the tensor product basis
+ * functions at x_i. Basis functions overlap only when their indices
+ * differ by at most p_s along every dimension s, so A^T A is stored
+ * as a sparse matrix with at most prod_s (2 p_s + 1) entries per
+ * control point, independent of the number of samples. (Its band,
+ * sum_s p_s * (n_{s+1} * ... * n_{k-1}) wide, would grow with the
+ * control net, and so would a banded factorization.)
+ *
+ * Each batch of samples is split into blocks of sample_block
+ * samples. Up to n_threads blocks at a time are accumulated into
+ * partial sums in parallel, which are then added to the totals in
+ * block order, so the result does not depend on the number of
+ * threads. The partial sums are kept between batches, and only the
+ * rows a block touched are added and cleared. Batches may come from
+ * memory or be streamed from a file, so the samples never need to
+ * fit in memory at once.
+ */
+class LeastSquaresFitter {
+private:
+	size_t n_kdims;
+	size_t n_cdims;
+	size_t n_threads;
+	std::vector<size_t> degrees;
+	std::vector<std::vector<scalar_t>> knots;
+
+	/* A geometry with the target layout, used for basis functions */
+	BSplineGeometry layout;
+
+	/* The normal equations accumulated so far */
+	SparseMatrix normal;
+	std::vector<ctrl_t> rhs;
+	size_t n_samples;
+
+	/* Partial sums of the blocks in flight (the values of normal), zero between batches */
+	std::vector<std::vector<scalar_t>> partial_M;
+	std::vector<std::vector<ctrl_t>> partial_b;
+
+	/*
+	 * Add the samples x[begin, end) to the given partial sums, and
+	 * return the rows [row_begin, row_end) they touched.
+	 */
+	void accumulate(std::vector<knot_t> const& x, std::vector<ctrl_t> const& y,
+			size_t begin, size_t end, std::vector<scalar_t>& M, std::vector<ctrl_t>& b,
+			size_t& row_begin, size_t& row_end) const;
+
+public:
+	/* The number of samples accumulated together before adding them to the totals */
+	static const size_t sample_block = 4096;
+
+	/* Fit control points in R^n_cdims over the given (unpadded) knot vectors */
+	LeastSquaresFitter(size_t n_cdims, std::vector<size_t> const& degrees,
+			std::vector<std::vector<scalar_t>> const& knots, size_t n_threads = 1);
+
+	/* Add samples y[i] at parametric points x[i] */
+	void add_samples(std::vector<knot_t> const& x, std::vector<ctrl_t> const& y);
+
+	/*
+	 * Read samples from a text file, one per line: n_kdims parameter
+	 * coordinates followed by n_cdims physical coordinates. The file
+	 * is processed in batches of chunk_size samples. Returns the
+	 * number of samples read, or -1 if the file cannot be opened.
+	 */
+	long add_samples_from_file(std::string const& filename, size_t chunk_size = 1 << 20);
+
+	size_t get_n_samples() const;
+
+	/*
+	 * Solve the normal equations by preconditioned conjugate
+	 * gradients (see sparse_solve()), to a residual of tolerance
+	 * relative to A^T y, and return the fitted geometry.
+	 * regularization is added to the diagonal of A^T A; a small
+	 * positive value keeps the system solvable when some basis
+	 * functions have no samples in their support.
+	 */
+	BSplineGeometry solve(scalar_t regularization = 0, scalar_t tolerance = 1e-13) const;
+};
+
+#endif
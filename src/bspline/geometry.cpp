@@ -1,4 +1,6 @@
 #include "geometry.h"
+#include <algorithm>
+#include <cmath>
 #include <cstddef>
 #include <iostream>
 #include <vector>
@@ -17,7 +19,8 @@ BSplineGeometry::BSplineGeometry(
 			std::vector<std::vector<scalar_t>> const& knot_vectors, 
 			std::vector<ctrl_t> const& control_points,
 			size_t n_threads)
-	: n_kdims(n_kdims), n_cdims(n_cdims), n_threads(n_threads), params(n_kdims), scratch(n_threads) 
+	: n_kdims(n_kdims), n_cdims(n_cdims), n_threads(n_threads), params(n_kdims), 
+	  preview_resolution(0), preview_error(0), block_size(0), scratch(n_threads) 
 {
 	/* Check that the BSplineGeometry state is valid. */
 
@@ -87,6 +90,7 @@ BSplineGeometry::BSplineGeometry(
 		params[s].n_ctrl = knot_vectors[s].size() + degrees[s] - 1;
 	}
 	this->control_points = control_points;
+	set_block_size(0);
 
 	for (size_t z = 0; z < n_threads; z++) {
 		size_t max_degree = 0;
@@ -97,6 +101,7 @@ BSplineGeometry::BSplineGeometry(
 		}
 		scratch[z].offset = max_degree + 1;
 		scratch[z].store = std::vector<scalar_t>(scratch[z].offset * (n_kdims + 1));
+		scratch[z].spans = std::vector<size_t>(prefetch_distance * n_kdims);
 	}
 		
 	/* 
@@ -147,7 +152,48 @@ BSplineGeometry::BSplineGeometry(
 	}
 }
 
-ctrl_t BSplineGeometry::evaluate(knot_t const& x, size_t tid) 
+size_t BSplineGeometry::find_span(size_t s, scalar_t u) const
+{
+	// convenience variables
+	size_t p = params[s].degree;
+	size_t l = params[s].span_cap;
+	std::vector<scalar_t> const& t = params[s].knot_vector;
+
+	/*
+	 * Find the knot span in which u lies.
+	 * This is an interval [t_j,t_{j+1}) such that
+	 * t_j <= u < t_{j+1}.
+	 *
+	 * We avoid the cases j < p or j >= l,
+	 * because these knot spans are empty
+	 * and used only for padding. In the case
+	 * where u equals the maximum knot value,
+	 * this requires special treatment, since
+	 * technically u < t_{j+1} is not possible.
+	 * We settle for allowing u = t_{j+1} then,
+	 * and we require t_j < u instead.
+	 *
+	 * We use the binary search algorithm,
+	 * since the knot vectors are sorted.
+	 */
+	size_t j, lo = p, hi = l;
+	if (u == t.back()) {
+		j = l;	
+	}
+	else {
+		while (true) {
+			j = (lo + hi) / 2;
+			if (t[j] <= u) {
+				if (t[j + 1] <= u) lo = j + 1;
+				else break;
+			}
+			else hi = j - 1;
+		}
+	}
+	return j;
+}
+
+void BSplineGeometry::find_spans(knot_t const& x, size_t* spans) const
 {
 	// check that x has the correct number of coordinates
 	if (x.size() != n_kdims) {
@@ -160,51 +206,46 @@ ctrl_t BSplineGeometry::evaluate(knot_t const& x, size_t tid)
 			|| x[s] > params[s].knot_vector.back()) {
 			error("evaluating at out-of-bounds point");
 		}
+		spans[s] = find_span(s, x[s]);
 	}
-	
+}
+
+ctrl_t BSplineGeometry::evaluate(knot_t const& x, size_t tid) 
+{
+	size_t* spans = scratch[tid].spans.data();
+	find_spans(x, spans);
+	return evaluate_in_spans(x, spans, tid);
+}
+
+ctrl_t BSplineGeometry::evaluate_in_spans(knot_t const& x, size_t const* spans, size_t tid)
+{
 	scratch_space& space = scratch[tid];
 	std::vector<size_t> first(n_kdims), last(n_kdims);
 	for (size_t s = 0; s < n_kdims; s++) {
 		// convenience variables
 		scalar_t u = x[s];
 		size_t p = params[s].degree;
-		size_t l = params[s].span_cap;
 		std::vector<scalar_t> const& t = params[s].knot_vector;
 		
-		/*
-		 * Find the knot span in which u lies.
-		 * This is an interval [t_j,t_{j+1}) such that
-		 * t_j <= u < t_{j+1}.
-		 *
-		 * We avoid the cases j < p or j >= l,
-		 * because these knot spans are empty
-		 * and used only for padding. In the case
-		 * where u equals the maximum knot value,
-		 * this requires special treatment, since
-		 * technically u < t_{j+1} is not possible.
-		 * We settle for allowing u = t_{j+1} then,
-		 * and we require t_j < u instead.
-		 *
-		 * We use the binary search algorithm,
-		 * since the knot vectors are sorted.
-		 */
-		size_t j, lo = p, hi = l;
-		if (u == t.back()) {
-			j = l;	
-		}
-		else {
-			while (true) {
-				j = (lo + hi) / 2;
-				if (t[j] <= u) {
-					if (t[j + 1] <= u) lo = j + 1;
-					else break;
-				}
-				else hi = j - 1;
-			}
-		}
+		size_t j = spans[s];
 		first[s] = j - p;
 		last[s] = j;
 
+		/* Preview mode: interpolate the tabulated basis functions */
+		if (preview_resolution > 0) {
+			size_t m = preview_resolution;
+			scalar_t f = (u - t[j]) / (t[j + 1] - t[j]) * m;
+			size_t e = std::min(size_t(f), m - 1);
+			scalar_t w = f - e;
+			std::vector<scalar_t>::const_iterator T = 
+				params[s].preview_table.begin() + (j * (m + 1) + e) * (p + 1);
+			std::vector<scalar_t>::iterator B = space.row(s);
+			for (size_t q = 0; q <= p; q++) {
+				B[q] = (1 - w) * T[q] + w * T[q + p + 1];
+			}
+			continue;
+		}
+
 		/*
 		 * Precompute the B-Spline basis functions.
 		 *
@@ -276,7 +317,7 @@ ctrl_t BSplineGeometry::evaluate(knot_t const& x, size_t tid)
 		 * Compute and store indices and weights recursively. 
 		 */
 		do {
-			istack[s + 1] = pos[s] + params[s].n_ctrl * istack[s];
+			istack[s + 1] = istack[s] + params[s].offset[pos[s]];
 			bstack[s + 1] = space.row(s)[pos[s] - first[s]] * bstack[s];
 			s++;	
 		} while (s < n_kdims);
@@ -284,7 +325,7 @@ ctrl_t BSplineGeometry::evaluate(knot_t const& x, size_t tid)
 		/* Main computation */
 		size_t I = istack[s];
 		scalar_t B = bstack[s];
-		ctrl_t const& ctrl_pt = control_points[I];
+		scalar_t const* ctrl_pt = block_size > 0 ? &blocked[I * n_cdims] : control_points[I].data();
 		for (size_t r = 0; r < n_cdims; r++) {
 			y[r] += B * ctrl_pt[r];
 		}
@@ -312,13 +353,469 @@ ctrl_t BSplineGeometry::evaluate(knot_t const& x, size_t tid)
 	 */
 std::vector<ctrl_t> BSplineGeometry::evaluate(std::vector<knot_t> const& x)
 {
-	std::vector<ctrl_t> y{x.size()};
-	auto xi = x.begin();
-	auto yi = y.begin();
-	for (; xi != x.end(); ++xi, ++yi) {
-		*yi = evaluate(*xi);
+	std::vector<ctrl_t> y(x.size());
+	evaluate(x, 0, x.size(), y, 0);
+	return y;
+}
+
+void BSplineGeometry::evaluate(std::vector<knot_t> const& x, size_t begin, size_t end,
+		std::vector<ctrl_t>& y, size_t tid)
+{
+	/*
+	 * A software pipeline: the knot spans of point i + prefetch_distance
+	 * are found, and the control points they select are prefetched,
+	 * before point i is evaluated, so that the memory accesses of the
+	 * next points overlap the arithmetic of the current one. The spans
+	 * are kept in a ring buffer in the scratch space.
+	 */
+	size_t* ring = scratch[tid].spans.data();
+	for (size_t i = begin; i < end && i < begin + prefetch_distance; i++) {
+		find_spans(x[i], ring + (i - begin) * n_kdims);
+		prefetch_support(ring + (i - begin) * n_kdims);
+	}
+	for (size_t i = begin; i < end; i++) {
+		size_t* spans = ring + ((i - begin) % prefetch_distance) * n_kdims;
+		y[i] = evaluate_in_spans(x[i], spans, tid);
+
+		size_t ahead = i + prefetch_distance;
+		if (ahead < end) {
+			find_spans(x[ahead], spans);
+			prefetch_support(spans);
+		}
+	}
+}
+
+void BSplineGeometry::prefetch_support(size_t const* spans) const
+{
+#if defined(__GNUC__)
+	/*
+	 * The control points selected by the spans form (p + 1)^(k - 1)
+	 * runs of p_{k-1} + 1 consecutive points along the last dimension
+	 * (contiguous in both storage orders, up to block boundaries).
+	 * Prefetch the coordinates of each run. In lexicographic storage
+	 * every point keeps its coordinates on the heap, so this reads
+	 * the (contiguous) point objects for their addresses and
+	 * prefetches each point's coordinates separately.
+	 */
+	size_t last = n_kdims - 1;
+	size_t run = params[last].degree + 1;
+	std::vector<size_t> q(last, 0);
+	while (true) {
+		size_t I = params[last].offset[spans[last] - params[last].degree];
+		for (size_t s = 0; s < last; s++) {
+			I += params[s].offset[spans[s] - params[s].degree + q[s]];
+		}
+		if (block_size > 0) {
+			scalar_t const* P = &blocked[I * n_cdims];
+			for (size_t b = 0; b < run * n_cdims; b += 64 / sizeof(scalar_t)) {
+				__builtin_prefetch(P + b);
+			}
+			__builtin_prefetch(P + run * n_cdims - 1);
+		} else {
+			for (size_t j = 0; j < run; j++) {
+				__builtin_prefetch(control_points[I + j].data());
+			}
+		}
+		size_t s = last;
+		for (; s > 0; s--) {
+			if (++q[s - 1] <= params[s - 1].degree) break;
+			q[s - 1] = 0;
+		}
+		if (s == 0) break;
+	}
+#endif
+}
+
+
+
+void BSplineGeometry::basis_derivatives(size_t s, size_t span, scalar_t u,
+		size_t n_ders, std::vector<std::vector<scalar_t>>& ders) const
+{
+	/*
+	 * This is algorithm A2.3 from Piegl and Tiller, "The NURBS Book".
+	 * ndu holds the basis functions (upper triangle) and the
+	 * knot differences (lower triangle); a holds two rows of
+	 * the coefficients of the derivative recurrence.
+	 */
+	long p = params[s].degree;
+	std::vector<scalar_t> const& t = params[s].knot_vector;
+
+	ders.assign(n_ders + 1, std::vector<scalar_t>(p + 1, 0));
+	std::vector<std::vector<scalar_t>> ndu(p + 1, std::vector<scalar_t>(p + 1));
+	std::vector<scalar_t> left(p + 1), right(p + 1);
+	ndu[0][0] = 1;
+	for (long j = 1; j <= p; j++) {
+		left[j] = u - t[span + 1 - j];
+		right[j] = t[span + j] - u;
+		scalar_t saved = 0;
+		for (long r = 0; r < j; r++) {
+			ndu[j][r] = right[r + 1] + left[j - r];
+			scalar_t temp = ndu[r][j - 1] / ndu[j][r];
+			ndu[r][j] = saved + right[r + 1] * temp;
+			saved = left[j - r] * temp;
+		}
+		ndu[j][j] = saved;
+	}
+	for (long j = 0; j <= p; j++) {
+		ders[0][j] = ndu[j][p];
+	}
+
+	long n = std::min<long>(n_ders, p);
+	std::vector<std::vector<scalar_t>> a(2, std::vector<scalar_t>(p + 1));
+	for (long r = 0; r <= p; r++) {
+		long s1 = 0, s2 = 1;
+		a[0][0] = 1;
+		for (long k = 1; k <= n; k++) {
+			scalar_t d = 0;
+			long rk = r - k, pk = p - k;
+			if (r >= k) {
+				a[s2][0] = a[s1][0] / ndu[pk + 1][rk];
+				d = a[s2][0] * ndu[rk][pk];
+			}
+			long j1 = (rk >= -1) ? 1 : -rk;
+			long j2 = (r - 1 <= pk) ? k - 1 : p - r;
+			for (long j = j1; j <= j2; j++) {
+				a[s2][j] = (a[s1][j] - a[s1][j - 1]) / ndu[pk + 1][rk + j];
+				d += a[s2][j] * ndu[rk + j][pk];
+			}
+			if (r <= pk) {
+				a[s2][k] = -a[s1][k - 1] / ndu[pk + 1][r];
+				d += a[s2][k] * ndu[r][pk];
+			}
+			ders[k][r] = d;
+			std::swap(s1, s2);
+		}
+	}
+
+	/* Multiply through by the factors p! / (p - k)! */
+	scalar_t factor = p;
+	for (long k = 1; k <= n; k++) {
+		for (long j = 0; j <= p; j++) {
+			ders[k][j] *= factor;
+		}
+		factor *= (p - k);
+	}
+}
+
+std::vector<ctrl_t> BSplineGeometry::evaluate_derivatives(knot_t const& x,
+		std::vector<std::vector<size_t>> const& orders) const
+{
+	if (x.size() != n_kdims) {
+		error("dimensions of evaluation point do not match B-spline geometry");
+	}
+	for (size_t s = 0; s < n_kdims; s++) {
+		if (x[s] < params[s].knot_vector.front() 
+			|| x[s] > params[s].knot_vector.back()) {
+			error("evaluating at out-of-bounds point");
+		}
+	}
+	for (std::vector<size_t> const& order : orders) {
+		if (order.size() != n_kdims) {
+			error("derivative order has incorrect dimension");
+		}
+	}
+
+	/* Span search and basis tabulation, shared by all orders */
+	std::vector<size_t> first(n_kdims);
+	std::vector<std::vector<std::vector<scalar_t>>> ders(n_kdims);
+	for (size_t s = 0; s < n_kdims; s++) {
+		size_t n_ders = 0;
+		for (std::vector<size_t> const& order : orders) {
+			n_ders = std::max(n_ders, order[s]);
+		}
+		size_t j = find_span(s, x[s]);
+		first[s] = j - params[s].degree;
+		basis_derivatives(s, j, x[s], n_ders, ders[s]);
+	}
+
+	/* Accumulate over the (p_0 + 1) x ... x (p_{k-1} + 1) supporting control points */
+	std::vector<ctrl_t> y(orders.size(), ctrl_t(n_cdims));
+	std::vector<size_t> pos(n_kdims, 0);
+	while (true) {
+		size_t I = 0;
+		for (size_t s = 0; s < n_kdims; s++) {
+			I = first[s] + pos[s] + params[s].n_ctrl * I;
+		}
+		scalar_t const* ctrl_pt = get_control_point(I);
+		for (size_t i = 0; i < orders.size(); i++) {
+			scalar_t B = 1;
+			for (size_t s = 0; s < n_kdims; s++) {
+				B *= ders[s][orders[i][s]][pos[s]];
+			}
+			for (size_t r = 0; r < n_cdims; r++) {
+				y[i][r] += B * ctrl_pt[r];
+			}
+		}
+
+		size_t s = n_kdims;
+		while (s > 0) {
+			s--;
+			if (++pos[s] <= params[s].degree) break;
+			pos[s] = 0;
+		}
+		if (s == 0 && pos[0] == 0) break;
 	}
 	return y;
 }
 
+std::vector<ctrl_t> BSplineGeometry::jacobian(knot_t const& x) const
+{
+	std::vector<std::vector<size_t>> orders(n_kdims, std::vector<size_t>(n_kdims, 0));
+	for (size_t s = 0; s < n_kdims; s++) {
+		orders[s][s] = 1;
+	}
+	return evaluate_derivatives(x, orders);
+}
 
+size_t BSplineGeometry::get_n_kdims() const
+{
+	return n_kdims;
+}
+
+size_t BSplineGeometry::get_n_cdims() const
+{
+	return n_cdims;
+}
+
+size_t BSplineGeometry::get_n_threads() const
+{
+	return n_threads;
+}
+
+size_t BSplineGeometry::get_degree(size_t s) const
+{
+	return params[s].degree;
+}
+
+size_t BSplineGeometry::get_n_ctrl(size_t s) const
+{
+	return params[s].n_ctrl;
+}
+
+std::vector<scalar_t> const& BSplineGeometry::get_knot_vector(size_t s) const
+{
+	return params[s].knot_vector;
+}
+
+std::vector<scalar_t> BSplineGeometry::get_breakpoints(size_t s) const
+{
+	std::vector<scalar_t> const& t = params[s].knot_vector;
+	std::vector<scalar_t> breaks;
+	for (scalar_t u : t) {
+		if (breaks.empty() || breaks.back() < u) {
+			breaks.push_back(u);
+		}
+	}
+	return breaks;
+}
+
+std::vector<size_t> BSplineGeometry::get_spans(size_t s) const
+{
+	std::vector<scalar_t> const& t = params[s].knot_vector;
+	std::vector<size_t> spans;
+	for (size_t j = params[s].degree; j < params[s].n_ctrl; j++) {
+		if (t[j] < t[j + 1]) {
+			spans.push_back(j);
+		}
+	}
+	return spans;
+}
+
+size_t BSplineGeometry::get_n_control_points() const
+{
+	size_t n = 1;
+	for (size_t s = 0; s < n_kdims; s++) {
+		n *= params[s].n_ctrl;
+	}
+	return n;
+}
+
+size_t BSplineGeometry::blocked_address(size_t I) const
+{
+	size_t addr = 0;
+	for (size_t s = n_kdims; s > 0; s--) {
+		addr += params[s - 1].offset[I % params[s - 1].n_ctrl];
+		I /= params[s - 1].n_ctrl;
+	}
+	return addr;
+}
+
+scalar_t const* BSplineGeometry::get_control_point(size_t I) const
+{
+	if (block_size == 0) {
+		return control_points[I].data();
+	}
+	return &blocked[blocked_address(I) * n_cdims];
+}
+
+std::vector<ctrl_t> BSplineGeometry::get_control_points() const
+{
+	if (block_size == 0) {
+		return control_points;
+	}
+	std::vector<ctrl_t> ctrl(get_n_control_points());
+	for (size_t I = 0; I < ctrl.size(); I++) {
+		scalar_t const* P = get_control_point(I);
+		ctrl[I].assign(P, P + n_cdims);
+	}
+	return ctrl;
+}
+
+void BSplineGeometry::set_control_point(size_t I, ctrl_t const& P)
+{
+	if (I >= get_n_control_points()) {
+		error("control point index out of range");
+	}
+	if (P.size() != n_cdims) {
+		error("control point has incorrect dimension");
+	}
+	if (block_size == 0) {
+		control_points[I] = P;
+		return;
+	}
+	std::copy(P.begin(), P.end(), blocked.begin() + blocked_address(I) * n_cdims);
+}
+
+void BSplineGeometry::set_preview(size_t resolution)
+{
+	preview_resolution = 0;
+	preview_error = 0;
+	for (size_t s = 0; s < n_kdims; s++) {
+		params[s].preview_table.clear();
+	}
+	if (resolution == 0) {
+		return;
+	}
+
+	/*
+	 * Tabulate, for every nonempty span j, the p + 1 nonzero basis
+	 * functions at resolution + 1 points, and compare their linear
+	 * interpolant with the exact functions halfway between entries.
+	 */
+	size_t m = resolution;
+	std::vector<std::vector<scalar_t>> ders, mid;
+	scalar_t error_estimate = 0;
+	size_t n_points = get_n_control_points(), stride = n_points;
+	for (size_t s = 0; s < n_kdims; s++) {
+		size_t p = params[s].degree;
+		std::vector<scalar_t> const& t = params[s].knot_vector;
+		std::vector<scalar_t>& table = params[s].preview_table;
+		table.assign(params[s].n_ctrl * (m + 1) * (p + 1), 0);
+
+		scalar_t basis_error = 0;
+		for (size_t j : get_spans(s)) {
+			scalar_t h = (t[j + 1] - t[j]) / m;
+			for (size_t e = 0; e <= m; e++) {
+				basis_derivatives(s, j, e == m ? t[j + 1] : t[j] + e * h, 0, ders);
+				std::copy(ders[0].begin(), ders[0].end(), table.begin() + (j * (m + 1) + e) * (p + 1));
+			}
+			for (size_t e = 0; e < m; e++) {
+				basis_derivatives(s, j, t[j] + (e + 0.5) * h, 0, mid);
+				scalar_t const* T = &table[(j * (m + 1) + e) * (p + 1)];
+				scalar_t err = 0;
+				for (size_t q = 0; q <= p; q++) {
+					err += std::fabs(0.5 * (T[q] + T[q + p + 1]) - mid[0][q]);
+				}
+				basis_error = std::max(basis_error, err);
+			}
+		}
+
+		/*
+		 * The interpolation errors d_q of dimension s sum to zero, so
+		 * sum_q d_q P_q is at most half their 1-norm times the diameter
+		 * of the p + 1 control points involved, which is at most p
+		 * times the largest step between neighbors along dimension s.
+		 */
+		stride /= params[s].n_ctrl;
+		scalar_t step = 0;
+		for (size_t I = 0; I < n_points; I++) {
+			if ((I / stride) % params[s].n_ctrl + 1 == params[s].n_ctrl) continue;
+			scalar_t const* P = get_control_point(I);
+			scalar_t const* Q = get_control_point(I + stride);
+			scalar_t d2 = 0;
+			for (size_t r = 0; r < n_cdims; r++) {
+				scalar_t d = Q[r] - P[r];
+				d2 += d * d;
+			}
+			step = std::max(step, d2);
+		}
+		error_estimate += 0.5 * basis_error * p * std::sqrt(step);
+	}
+
+	preview_resolution = m;
+	preview_error = error_estimate;
+}
+
+size_t BSplineGeometry::get_preview() const
+{
+	return preview_resolution;
+}
+
+scalar_t BSplineGeometry::get_preview_error() const
+{
+	return preview_error;
+}
+
+void BSplineGeometry::set_block_size(size_t b)
+{
+	/* Back to the lexicographic array, read with the old offsets */
+	if (block_size > 0) {
+		control_points = get_control_points();
+		std::vector<scalar_t>().swap(blocked);
+	}
+	block_size = b;
+
+	/* Lexicographic order */
+	size_t stride = control_points.size();
+	if (b == 0) {
+		for (size_t s = 0; s < n_kdims; s++) {
+			stride /= params[s].n_ctrl;
+			params[s].offset.resize(params[s].n_ctrl);
+			for (size_t j = 0; j < params[s].n_ctrl; j++) {
+				params[s].offset[j] = j * stride;
+			}
+		}
+		return;
+	}
+
+	/*
+	 * Blocked order: block index and index within the block are
+	 * both lexicographic, with block_stride and inner_stride the
+	 * strides of dimension s among blocks and within a block.
+	 */
+	size_t block_volume = 1, n_blocks = 1;
+	for (size_t s = 0; s < n_kdims; s++) {
+		block_volume *= b;
+		n_blocks *= (params[s].n_ctrl + b - 1) / b;
+	}
+	size_t block_stride = n_blocks, inner_stride = block_volume;
+	for (size_t s = 0; s < n_kdims; s++) {
+		block_stride /= (params[s].n_ctrl + b - 1) / b;
+		inner_stride /= b;
+		params[s].offset.resize(params[s].n_ctrl);
+		for (size_t j = 0; j < params[s].n_ctrl; j++) {
+			params[s].offset[j] = (j / b) * block_stride * block_volume + (j % b) * inner_stride;
+		}
+	}
+
+	blocked.assign(n_blocks * block_volume * n_cdims, 0);
+	std::vector<size_t> pos(n_kdims, 0);
+	for (size_t I = 0; I < control_points.size(); I++) {
+		size_t addr = 0;
+		for (size_t s = 0; s < n_kdims; s++) {
+			addr += params[s].offset[pos[s]];
+		}
+		std::copy(control_points[I].begin(), control_points[I].end(), blocked.begin() + addr * n_cdims);
+		ctrl_t().swap(control_points[I]);
+		for (size_t s = n_kdims; s > 0; s--) {
+			if (++pos[s - 1] < params[s - 1].n_ctrl) break;
+			pos[s - 1] = 0;
+		}
+	}
+	std::vector<ctrl_t>().swap(control_points);
+}
+
+size_t BSplineGeometry::get_block_size() const
+{
+	return block_size;
+}
@@ -1,3 +1,6 @@
+#ifndef BSPLINE_GEOMETRY_H
+#define BSPLINE_GEOMETRY_H
+
 #include <cstddef>
 #include <vector>
 
@@ -24,6 +27,12 @@ typedef std::vector<scalar_t> knot_t;
  */
 typedef std::vector<scalar_t> ctrl_t;
 
+/*
+ * Print an error message and terminate.
+ * Used for invalid input throughout the B-Spline code.
+ */
+void error(char const * msg);
+
 
 /*
  * A data structure for holding the parameters for a B-Spline.
@@ -48,14 +57,27 @@ private:
 	 * 		(the degree plus the number of legitimate
 	 * 		 knots, not including padding)
 	 * 	* the vector of knot coordinates along that axis
+	 * 	* in preview mode, the tabulated basis functions
+	 * 		(see set_preview())
+	 * 	* the contribution of each control point layer to the
+	 * 		storage address used by evaluate() (see below)
 	 */
 	struct param {
 		size_t degree;
 		size_t span_cap;
 		size_t n_ctrl;
 		std::vector<scalar_t> knot_vector;		
+		std::vector<scalar_t> preview_table;
+		std::vector<size_t> offset;
 	};
 	std::vector<param> params;
+
+	/*
+	 * The number of table intervals per knot span in preview
+	 * mode (zero for exact evaluation), and the estimated error.
+	 */
+	size_t preview_resolution;
+	scalar_t preview_error;
 	
 	/*
 	 * The array of control points.
@@ -75,9 +97,33 @@ private:
 	 * I_k, where
 	 * I_0 = 0,
 	 * I_{s+1} = j_s + l_s * I_s for 0 <= s < k. 
+	 *
+	 * While block_size > 0 the control points are kept in blocked
+	 * instead, and this array is empty.
 	 */
 	std::vector<ctrl_t> control_points;
 
+	/*
+	 * The control points in blocked order, used instead of
+	 * control_points when block_size > 0 (see set_block_size()).
+	 *
+	 * The grid of control points is cut into blocks of
+	 * block_size^k points, which are stored one after another in
+	 * lexicographic order, each block being contiguous (with its
+	 * points in lexicographic order, and padding in partial blocks).
+	 * The coordinates are stored inline, n_cdims scalars per point.
+	 *
+	 * Both orders are sums of per-dimension terms: the point with
+	 * index J is stored at position sum_s params[s].offset[j_s],
+	 * where offset[j] = j * (n_{s+1} * ... * n_{k-1}) for the
+	 * lexicographic order.
+	 */
+	size_t block_size;
+	std::vector<scalar_t> blocked;
+
+	/* The position in blocked of the point with lexicographic index I */
+	size_t blocked_address(size_t I) const;
+
 	/*
 	 * Scratch space for recursive calculations of B-Spline
 	 * basis functions.
@@ -99,6 +145,8 @@ private:
 	struct scratch_space {
 		size_t offset;
 		std::vector<scalar_t> store;
+		/* Knot spans of the points in flight (prefetch_distance points) */
+		std::vector<size_t> spans;
 
 		std::vector<scalar_t>::iterator row(size_t index) 
 		{
@@ -107,6 +155,21 @@ private:
 	};
 	std::vector<scratch_space> scratch;
 
+	/*
+	 * The number of points whose control points are prefetched
+	 * ahead of the point being evaluated by the map operation.
+	 */
+	static const size_t prefetch_distance = 8;
+
+	/* Check that x is in bounds, and find its knot span in every dimension */
+	void find_spans(knot_t const& x, size_t* spans) const;
+
+	/* Evaluate the spline at x, whose knot spans are already known */
+	ctrl_t evaluate_in_spans(knot_t const& x, size_t const* spans, size_t tid);
+
+	/* Prefetch the control points that are nonzero in the given spans */
+	void prefetch_support(size_t const* spans) const;
+
 public:
 	
 	/* Constructor */
@@ -136,6 +199,154 @@ public:
 	 *
 	 * The input x is mapped to a vector y such that for all
 	 * valid indices i of x, y[i] is the spline evaluated at x[i].
+	 *
+	 * The control points of the next few points are prefetched
+	 * while each point is evaluated, which hides memory latency
+	 * when the net is large and the points are scattered. This
+	 * uses the scratch space of thread 0.
 	 */
 	std::vector<ctrl_t> evaluate(std::vector<knot_t> const& x);
+
+	/*
+	 * The map operation on the points x[begin, end), storing the
+	 * results in y[begin, end) (y must have at least end entries).
+	 * Uses the scratch space of thread tid, so that threads can
+	 * work on separate ranges of the same batch.
+	 */
+	void evaluate(std::vector<knot_t> const& x, size_t begin, size_t end,
+			std::vector<ctrl_t>& y, size_t tid);
+
+	/*
+	 * Find the knot span of the coordinate u in dimension s.
+	 * The result is an index j into the padded knot vector
+	 * such that the basis functions with indices j - p, ..., j
+	 * (p being the degree) are the ones that are nonzero at u.
+	 */
+	size_t find_span(size_t s, scalar_t u) const;
+
+	/*
+	 * Compute the nonzero basis functions in dimension s at u,
+	 * together with their derivatives up to order n_ders.
+	 * span must be find_span(s, u). On return, ders[k][i] is
+	 * the k-th derivative of basis function span - p + i.
+	 * Derivatives of order above the degree are zero.
+	 */
+	void basis_derivatives(size_t s, size_t span, scalar_t u, 
+			size_t n_ders, std::vector<std::vector<scalar_t>>& ders) const;
+
+	/*
+	 * Evaluate several partial derivatives of the spline at x.
+	 *
+	 * Each entry of orders is a multi-index with one derivative
+	 * order per parametric dimension; y[i] is the partial
+	 * derivative of the spline with respect to orders[i] (so
+	 * the all-zero multi-index gives the value of the spline).
+	 * The knot span search and the basis function tabulation
+	 * are shared between all requested derivatives.
+	 *
+	 * This function does not use scratch space and is safe to
+	 * call concurrently.
+	 */
+	std::vector<ctrl_t> evaluate_derivatives(knot_t const& x, 
+			std::vector<std::vector<size_t>> const& orders) const;
+
+	/*
+	 * The first partial derivatives of the spline at x.
+	 * J[s] is the derivative with respect to parametric
+	 * coordinate s (a column of the Jacobian matrix).
+	 */
+	std::vector<ctrl_t> jacobian(knot_t const& x) const;
+
+	/*
+	 * Switch evaluate() to preview mode, trading accuracy for speed,
+	 * or back to exact evaluation with resolution = 0.
+	 *
+	 * In preview mode the nonzero basis functions of every knot span
+	 * are tabulated at resolution + 1 equally spaced points, and
+	 * evaluate() interpolates them linearly instead of running the
+	 * basis function recursion. The interpolated functions are still
+	 * nonnegative and sum to one, so the error at any point is at
+	 * most the sum over dimensions s of half the interpolation error
+	 * of the basis functions (in the 1-norm) times p_s times the
+	 * largest distance between neighboring control points along s.
+	 * The interpolation error is measured halfway between table
+	 * entries, which makes the result an estimate, not a strict bound.
+	 * It is computed for the control points at the time of the call.
+	 *
+	 * Only evaluate() is affected; derivatives stay exact.
+	 */
+	void set_preview(size_t resolution);
+
+	/* The preview resolution, or zero for exact evaluation */
+	size_t get_preview() const;
+
+	/* The estimated maximum preview error (zero for exact evaluation) */
+	scalar_t get_preview_error() const;
+
+	/*
+	 * Store the control points in blocked order (see above) with
+	 * blocks of block_size points along every dimension, or in the
+	 * lexicographic array with block_size = 0.
+	 *
+	 * Blocking keeps the control points around a parametric point
+	 * within a few blocks of memory instead of spreading them over
+	 * (p + 1)^(k - 1) distant rows, which matters for large nets
+	 * and scattered evaluation points. Only one order is stored, and
+	 * the blocked array holds the coordinates inline, so blocking
+	 * takes less memory than the lexicographic array. The indices
+	 * seen through the rest of the interface keep the lexicographic
+	 * order.
+	 */
+	void set_block_size(size_t block_size);
+	size_t get_block_size() const;
+
+	/* Accessors for the size parameters */
+	size_t get_n_kdims() const;
+	size_t get_n_cdims() const;
+	size_t get_n_threads() const;
+
+	/* The degree and the number of control point layers in dimension s */
+	size_t get_degree(size_t s) const;
+	size_t get_n_ctrl(size_t s) const;
+
+	/*
+	 * The knot vector in dimension s, including the padding
+	 * knots inserted by the constructor. It has
+	 * get_n_ctrl(s) + get_degree(s) + 1 entries.
+	 */
+	std::vector<scalar_t> const& get_knot_vector(size_t s) const;
+
+	/*
+	 * The distinct knot values in dimension s, in increasing order.
+	 * Consecutive breakpoints bound the nonempty knot spans
+	 * (the elements of the spline in that dimension).
+	 */
+	std::vector<scalar_t> get_breakpoints(size_t s) const;
+
+	/*
+	 * The indices j (into the padded knot vector) of the nonempty
+	 * knot spans [t_j, t_{j+1}) in dimension s, in increasing order.
+	 * Element e along dimension s is the span get_spans(s)[e], which
+	 * lies between breakpoints e and e + 1.
+	 */
+	std::vector<size_t> get_spans(size_t s) const;
+
+	/* The number of control points, the product of get_n_ctrl(s) */
+	size_t get_n_control_points() const;
+
+	/*
+	 * The n_cdims coordinates of the control point with flattened
+	 * index I (see above for ordering), in either storage order.
+	 * The pointer is valid until the control point or the block
+	 * size is changed.
+	 */
+	scalar_t const* get_control_point(size_t I) const;
+
+	/* A copy of the flattened array of control points (see above for ordering) */
+	std::vector<ctrl_t> get_control_points() const;
+
+	/* Move the control point with flattened index I to P */
+	void set_control_point(size_t I, ctrl_t const& P);
 };
+
+#endif
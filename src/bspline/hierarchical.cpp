@@ -0,0 +1,452 @@
+#include "hierarchical.h"
+#include "fitting.h"
+#include "parallel.h"
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <map>
+#include <utility>
+#include <vector>
+
+/* Split the flattened index I into per-dimension indices */
+static std::vector<size_t> unflatten(size_t I, std::vector<size_t> const& n)
+{
+	std::vector<size_t> pos(n.size());
+	for (size_t s = n.size(); s > 0; s--) {
+		pos[s - 1] = I % n[s - 1];
+		I /= n[s - 1];
+	}
+	return pos;
+}
+
+static size_t flatten(std::vector<size_t> const& pos, std::vector<size_t> const& n)
+{
+	size_t I = 0;
+	for (size_t s = 0; s < n.size(); s++) {
+		I = pos[s] + n[s] * I;
+	}
+	return I;
+}
+
+/* Unpadded knots with the midpoint of every nonempty span inserted */
+static std::vector<scalar_t> split_spans(std::vector<scalar_t> const& knots)
+{
+	std::vector<scalar_t> result;
+	for (size_t i = 0; i < knots.size(); i++) {
+		result.push_back(knots[i]);
+		if (i + 1 < knots.size() && knots[i + 1] != knots[i]) {
+			result.push_back(0.5 * (knots[i] + knots[i + 1]));
+		}
+	}
+	return result;
+}
+
+/* The univariate spline of degree p over the given unpadded knots, for its basis */
+static BSplineGeometry univariate_basis(size_t p, std::vector<scalar_t> const& knots)
+{
+	return BSplineGeometry(1, 1, {p}, {knots},
+			std::vector<ctrl_t>(knots.size() + p - 1, ctrl_t(1, 0)));
+}
+
+HierarchicalBSpline::HierarchicalBSpline(BSplineGeometry const& g)
+	: n_kdims(g.get_n_kdims()), n_cdims(g.get_n_cdims()), n_threads(g.get_n_threads()), levels(1)
+{
+	level& base = levels[0];
+	for (size_t s = 0; s < n_kdims; s++) {
+		size_t p = g.get_degree(s);
+		std::vector<scalar_t> const& t = g.get_knot_vector(s);
+		degrees.push_back(p);
+		base.bases.push_back(univariate_basis(p, std::vector<scalar_t>(t.begin() + p, t.end() - p)));
+		base.breakpoints.push_back(g.get_breakpoints(s));
+		base.n_funcs.push_back(g.get_n_ctrl(s));
+		base.n_elems.push_back(base.breakpoints[s].size() - 1);
+	}
+	std::vector<ctrl_t> ctrl = g.get_control_points();
+	for (size_t I = 0; I < ctrl.size(); I++) {
+		base.active.emplace_hint(base.active.end(), I, ctrl[I]);
+	}
+}
+
+void HierarchicalBSpline::add_level()
+{
+	level const& coarse = levels.back();
+	level fine;
+	for (size_t s = 0; s < n_kdims; s++) {
+		size_t p = degrees[s];
+		std::vector<scalar_t> const& t = coarse.bases[s].get_knot_vector(0);
+		std::vector<scalar_t> knots = split_spans(std::vector<scalar_t>(t.begin() + p, t.end() - p));
+		fine.bases.push_back(univariate_basis(p, knots));
+		fine.breakpoints.push_back(fine.bases[s].get_breakpoints(0));
+		fine.n_funcs.push_back(fine.bases[s].get_n_ctrl(0));
+		fine.n_elems.push_back(fine.breakpoints[s].size() - 1);
+
+		/*
+		 * The refinement coefficients: interpolating all coarse basis
+		 * functions at once (as the components of one spline whose
+		 * control points are the unit vectors) on the fine knots
+		 * reproduces them exactly, since they lie in the fine space.
+		 */
+		size_t n_c = coarse.n_funcs[s], n_f = fine.n_funcs[s];
+		std::vector<ctrl_t> unit(n_c, ctrl_t(n_c, 0));
+		for (size_t i = 0; i < n_c; i++) {
+			unit[i][i] = 1;
+		}
+		BSplineGeometry all(1, n_c, {p}, {std::vector<scalar_t>(t.begin() + p, t.end() - p)}, unit);
+		std::vector<scalar_t> g = greville_abscissae(fine.bases[s].get_knot_vector(0), p);
+		std::vector<ctrl_t> values(n_f);
+		for (size_t j = 0; j < n_f; j++) {
+			values[j] = all.evaluate(knot_t{g[j]});
+		}
+		std::vector<ctrl_t> R = interpolate_grid({p}, {knots}, values).get_control_points();
+
+		fine.parents.emplace_back(n_f);
+		for (size_t j = 0; j < n_f; j++) {
+			for (size_t i = 0; i < n_c; i++) {
+				if (std::fabs(R[j][i]) > 1e-12) {
+					fine.parents[s][j].push_back({i, R[j][i]});
+				}
+			}
+		}
+	}
+	levels.push_back(fine);
+}
+
+std::vector<size_t> HierarchicalBSpline::element_of(size_t l, knot_t const& x) const
+{
+	std::vector<size_t> e(n_kdims);
+	for (size_t s = 0; s < n_kdims; s++) {
+		std::vector<scalar_t> const& bp = levels[l].breakpoints[s];
+		size_t i = std::upper_bound(bp.begin(), bp.end(), x[s]) - bp.begin();
+		e[s] = std::min(i == 0 ? 0 : i - 1, levels[l].n_elems[s] - 1);
+	}
+	return e;
+}
+
+bool HierarchicalBSpline::covered(size_t l, size_t j, size_t d) const
+{
+	if (d == 0) {
+		return true;
+	}
+	if (d >= levels.size()) {
+		return false;
+	}
+
+	/* The elements of level d in the support, per dimension */
+	std::vector<size_t> pos = unflatten(j, levels[l].n_funcs);
+	std::vector<size_t> lo(n_kdims), hi(n_kdims);
+	for (size_t s = 0; s < n_kdims; s++) {
+		std::vector<scalar_t> const& t = levels[l].bases[s].get_knot_vector(0);
+		std::vector<scalar_t> const& bp = levels[l].breakpoints[s];
+		size_t first = std::lower_bound(bp.begin(), bp.end(), t[pos[s]]) - bp.begin();
+		size_t last = std::lower_bound(bp.begin(), bp.end(), t[pos[s] + degrees[s] + 1]) - bp.begin();
+		lo[s] = first << (d - l);
+		hi[s] = last << (d - l);
+	}
+
+	std::vector<size_t> e = lo;
+	while (true) {
+		if (!levels[d].domain.count(flatten(e, levels[d].n_elems))) {
+			return false;
+		}
+		size_t s = n_kdims;
+		for (; s > 0; s--) {
+			if (++e[s - 1] < hi[s - 1]) break;
+			e[s - 1] = lo[s - 1];
+		}
+		if (s == 0) {
+			return true;
+		}
+	}
+}
+
+std::map<size_t, scalar_t> HierarchicalBSpline::level_basis(size_t l, knot_t const& x) const
+{
+	std::vector<size_t> first(n_kdims);
+	std::vector<std::vector<std::vector<scalar_t>>> ders(n_kdims);
+	for (size_t s = 0; s < n_kdims; s++) {
+		BSplineGeometry const& b = levels[l].bases[s];
+		size_t span = b.find_span(0, x[s]);
+		b.basis_derivatives(0, span, x[s], 0, ders[s]);
+		first[s] = span - degrees[s];
+	}
+
+	std::map<size_t, scalar_t> w;
+	std::vector<size_t> q(n_kdims, 0), pos(n_kdims);
+	while (true) {
+		scalar_t B = 1;
+		for (size_t s = 0; s < n_kdims; s++) {
+			pos[s] = first[s] + q[s];
+			B *= ders[s][0][q[s]];
+		}
+		w[flatten(pos, levels[l].n_funcs)] = B;
+		size_t s = n_kdims;
+		for (; s > 0; s--) {
+			if (++q[s - 1] <= degrees[s - 1]) break;
+			q[s - 1] = 0;
+		}
+		if (s == 0) {
+			return w;
+		}
+	}
+}
+
+/*
+ * The coefficient a_j of function j of level l when the spline is
+ * written in the basis of level l (before adding later levels):
+ * the control point of an active function, zero for the other
+ * functions in the domain of level l (they are truncated away), and
+ * otherwise the refinement of the coefficients of level l - 1.
+ */
+ctrl_t HierarchicalBSpline::coefficient(size_t l, size_t j, std::vector<std::map<size_t, ctrl_t>>& memo) const
+{
+	auto a = levels[l].active.find(j);
+	if (a != levels[l].active.end()) {
+		return a->second;
+	}
+	auto m = memo[l].find(j);
+	if (m != memo[l].end()) {
+		return m->second;
+	}
+
+	ctrl_t c(n_cdims, 0);
+	if (l > 0 && !covered(l, j, l)) {
+		level const& L = levels[l];
+		std::vector<size_t> pos = unflatten(j, L.n_funcs);
+		std::vector<size_t> q(n_kdims, 0), parent(n_kdims);
+		while (true) {
+			scalar_t R = 1;
+			for (size_t s = 0; s < n_kdims; s++) {
+				std::pair<size_t, scalar_t> const& r = L.parents[s][pos[s]][q[s]];
+				parent[s] = r.first;
+				R *= r.second;
+			}
+			ctrl_t P = coefficient(l - 1, flatten(parent, levels[l - 1].n_funcs), memo);
+			for (size_t r = 0; r < n_cdims; r++) {
+				c[r] += R * P[r];
+			}
+			size_t s = n_kdims;
+			for (; s > 0; s--) {
+				if (++q[s - 1] < L.parents[s - 1][pos[s - 1]].size()) break;
+				q[s - 1] = 0;
+			}
+			if (s == 0) break;
+		}
+	}
+	memo[l][j] = c;
+	return c;
+}
+
+size_t HierarchicalBSpline::get_n_kdims() const
+{
+	return n_kdims;
+}
+
+size_t HierarchicalBSpline::get_n_cdims() const
+{
+	return n_cdims;
+}
+
+size_t HierarchicalBSpline::get_n_levels() const
+{
+	return levels.size();
+}
+
+size_t HierarchicalBSpline::get_n_active() const
+{
+	size_t n = 0;
+	for (level const& L : levels) {
+		n += L.active.size();
+	}
+	return n;
+}
+
+std::map<size_t, ctrl_t> const& HierarchicalBSpline::get_active(size_t l) const
+{
+	if (l >= levels.size()) {
+		error("hierarchical spline level out of range");
+	}
+	return levels[l].active;
+}
+
+void HierarchicalBSpline::set_control_point(size_t l, size_t j, ctrl_t const& P)
+{
+	if (l >= levels.size() || !levels[l].active.count(j)) {
+		error("not an active basis function");
+	}
+	if (P.size() != n_cdims) {
+		error("control point has incorrect dimension");
+	}
+	levels[l].active[j] = P;
+}
+
+void HierarchicalBSpline::refine(size_t l, knot_t const& lo, knot_t const& hi)
+{
+	if (l == 0 || l > levels.size()) {
+		error("hierarchical spline level out of range");
+	}
+	if (lo.size() != n_kdims || hi.size() != n_kdims) {
+		error("refinement box has incorrect dimension");
+	}
+	if (l == levels.size()) {
+		add_level();
+	}
+	level& fine = levels[l];
+	level& coarse = levels[l - 1];
+
+	/* The elements of level l overlapping the box, per dimension */
+	std::vector<size_t> e_lo(n_kdims), e_hi(n_kdims);
+	for (size_t s = 0; s < n_kdims; s++) {
+		std::vector<scalar_t> const& bp = fine.breakpoints[s];
+		e_lo[s] = std::upper_bound(bp.begin(), bp.end(), lo[s]) - bp.begin();
+		e_lo[s] = e_lo[s] == 0 ? 0 : e_lo[s] - 1;
+		e_hi[s] = std::lower_bound(bp.begin(), bp.end(), hi[s]) - bp.begin();
+		e_hi[s] = std::min(e_hi[s], fine.n_elems[s]);
+		if (e_lo[s] >= e_hi[s]) {
+			return;
+		}
+	}
+
+	/* The new elements of the domain, and the functions they touch */
+	std::vector<size_t> added;
+	std::set<size_t> fine_funcs, coarse_funcs;
+	std::vector<size_t> e = e_lo, half(n_kdims);
+	while (true) {
+		for (size_t s = 0; s < n_kdims; s++) {
+			half[s] = e[s] / 2;
+		}
+		size_t E = flatten(e, fine.n_elems);
+		if ((l == 1 || coarse.domain.count(flatten(half, coarse.n_elems))) && !fine.domain.count(E)) {
+			added.push_back(E);
+			for (size_t d = 0; d < 2; d++) {
+				level const& L = levels[l - d];
+				std::vector<size_t> const& elem = d == 0 ? e : half;
+				std::vector<size_t> first(n_kdims), q(n_kdims, 0), pos(n_kdims);
+				for (size_t s = 0; s < n_kdims; s++) {
+					first[s] = L.bases[s].get_spans(0)[elem[s]] - degrees[s];
+				}
+				while (true) {
+					for (size_t s = 0; s < n_kdims; s++) {
+						pos[s] = first[s] + q[s];
+					}
+					(d == 0 ? fine_funcs : coarse_funcs).insert(flatten(pos, L.n_funcs));
+					size_t s = n_kdims;
+					for (; s > 0; s--) {
+						if (++q[s - 1] <= degrees[s - 1]) break;
+						q[s - 1] = 0;
+					}
+					if (s == 0) break;
+				}
+			}
+		}
+		size_t s = n_kdims;
+		for (; s > 0; s--) {
+			if (++e[s - 1] < e_hi[s - 1]) break;
+			e[s - 1] = e_lo[s - 1];
+		}
+		if (s == 0) break;
+	}
+	if (added.empty()) {
+		return;
+	}
+
+	/* The coefficients of the touched functions before refining */
+	std::vector<std::map<size_t, ctrl_t>> memo(levels.size());
+	std::map<size_t, ctrl_t> before;
+	for (size_t j : fine_funcs) {
+		before[j] = coefficient(l, j, memo);
+	}
+
+	fine.domain.insert(added.begin(), added.end());
+
+	/*
+	 * Functions of level l now inside the domain become active with
+	 * their previous coefficients; functions of level l - 1 inside it
+	 * are replaced by them.
+	 */
+	for (size_t j : fine_funcs) {
+		if (!fine.active.count(j) && covered(l, j, l) && !covered(l, j, l + 1)) {
+			fine.active[j] = before[j];
+		}
+	}
+	for (size_t i : coarse_funcs) {
+		if (covered(l - 1, i, l)) {
+			coarse.active.erase(i);
+		}
+	}
+}
+
+std::vector<ActiveFunction> HierarchicalBSpline::active_basis(knot_t const& x) const
+{
+	if (x.size() != n_kdims) {
+		error("parametric point has incorrect dimension");
+	}
+
+	/* The finest level whose domain contains x */
+	size_t top = 0;
+	while (top + 1 < levels.size() && levels[top + 1].domain.count(
+				flatten(element_of(top + 1, x), levels[top + 1].n_elems))) {
+		top++;
+	}
+
+	/*
+	 * Starting from the basis of the finest level, the weight of each
+	 * inactive function outside the domain of its level passes to the
+	 * functions of the previous level through the refinement relation
+	 * (the transpose of computing coefficients in coefficient()).
+	 */
+	std::vector<ActiveFunction> result;
+	std::map<size_t, scalar_t> w = level_basis(top, x);
+	for (size_t l = top + 1; l-- > 0;) {
+		level const& L = levels[l];
+		std::map<size_t, scalar_t> parent_w;
+		for (auto const& f : w) {
+			if (L.active.count(f.first)) {
+				result.push_back({l, f.first, f.second});
+				continue;
+			}
+			if (l == 0 || covered(l, f.first, l)) {
+				continue;
+			}
+			std::vector<size_t> pos = unflatten(f.first, L.n_funcs);
+			std::vector<size_t> q(n_kdims, 0), parent(n_kdims);
+			while (true) {
+				scalar_t R = 1;
+				for (size_t s = 0; s < n_kdims; s++) {
+					std::pair<size_t, scalar_t> const& r = L.parents[s][pos[s]][q[s]];
+					parent[s] = r.first;
+					R *= r.second;
+				}
+				parent_w[flatten(parent, levels[l - 1].n_funcs)] += R * f.second;
+				size_t s = n_kdims;
+				for (; s > 0; s--) {
+					if (++q[s - 1] < L.parents[s - 1][pos[s - 1]].size()) break;
+					q[s - 1] = 0;
+				}
+				if (s == 0) break;
+			}
+		}
+		w.swap(parent_w);
+	}
+	return result;
+}
+
+ctrl_t HierarchicalBSpline::evaluate(knot_t const& x) const
+{
+	ctrl_t y(n_cdims, 0);
+	for (ActiveFunction const& f : active_basis(x)) {
+		ctrl_t const& P = levels[f.level].active.at(f.index);
+		for (size_t r = 0; r < n_cdims; r++) {
+			y[r] += f.value * P[r];
+		}
+	}
+	return y;
+}
+
+std::vector<ctrl_t> HierarchicalBSpline::evaluate(std::vector<knot_t> const& x) const
+{
+	std::vector<ctrl_t> y(x.size());
+	parallel_for(n_threads, x.size(), [&](size_t, size_t i) {
+		y[i] = evaluate(x[i]);
+	});
+	return y;
+}
@@ -0,0 +1,124 @@
+#ifndef BSPLINE_HIERARCHICAL_H
+#define BSPLINE_HIERARCHICAL_H
+
+#include "geometry.h"
+#include <cstddef>
+#include <map>
+#include <set>
+#include <utility>
+#include <vector>
+
+/*
+ * An active basis function of a hierarchical spline, with the
+ * value of its truncated version at some parametric point.
+ */
+struct ActiveFunction {
+	size_t level;
+	size_t index;
+	scalar_t value;
+};
+
+/*
+ * A truncated hierarchical B-Spline (THB-Spline).
+ *
+ * Level 0 is a BSplineGeometry; level l + 1 has the same degrees
+ * and every nonempty knot span of level l split in half. Each level
+ * l >= 1 has a domain, a union of its elements, with the domain of
+ * level l + 1 inside that of level l (level 0 covers everything).
+ * A basis function of level l is active if its support lies in the
+ * domain of level l but not in that of level l + 1; only active
+ * functions have control points, so their number grows with the
+ * refined regions instead of with the finest resolution.
+ *
+ * Each active function is truncated: written in the basis of the
+ * next level, the terms whose support lies in the next domain are
+ * dropped (and so on through the later levels). The truncated
+ * functions form a partition of unity, and refining a region does
+ * not change the spline.
+ *
+ * Basis functions of a level are numbered like the control points
+ * of a BSplineGeometry (lexicographically, last dimension fastest).
+ */
+class HierarchicalBSpline {
+private:
+	size_t n_kdims;
+	size_t n_cdims;
+	size_t n_threads;
+	std::vector<size_t> degrees;
+
+	struct level {
+		/* One univariate spline per dimension, for its basis functions */
+		std::vector<BSplineGeometry> bases;
+		std::vector<std::vector<scalar_t>> breakpoints;
+		std::vector<size_t> n_funcs;
+		std::vector<size_t> n_elems;
+
+		/* The elements (flattened indices) in the domain of the level */
+		std::set<size_t> domain;
+
+		/* The control points of the active functions */
+		std::map<size_t, ctrl_t> active;
+
+		/*
+		 * parents[s][j] lists the functions i of the previous level
+		 * in dimension s whose refinement B_i = sum_j R_ij B_j has
+		 * R_ij != 0, with the coefficients R_ij.
+		 */
+		std::vector<std::vector<std::vector<std::pair<size_t, scalar_t>>>> parents;
+	};
+	std::vector<level> levels;
+
+	void add_level();
+
+	/* Element of level l containing x (per dimension) */
+	std::vector<size_t> element_of(size_t l, knot_t const& x) const;
+
+	/* Whether the support of function j of level l lies in the domain of level d >= l */
+	bool covered(size_t l, size_t j, size_t d) const;
+
+	/* The functions of level l that are nonzero at x, with their values */
+	std::map<size_t, scalar_t> level_basis(size_t l, knot_t const& x) const;
+
+	/* The coefficient of function j of level l in the spline (memoized per level) */
+	ctrl_t coefficient(size_t l, size_t j, std::vector<std::map<size_t, ctrl_t>>& memo) const;
+
+public:
+	/* A hierarchical spline with the single level g */
+	HierarchicalBSpline(BSplineGeometry const& g);
+
+	size_t get_n_kdims() const;
+	size_t get_n_cdims() const;
+	size_t get_n_levels() const;
+
+	/* The total number of active functions (control points) */
+	size_t get_n_active() const;
+
+	/* The active functions of level l and their control points */
+	std::map<size_t, ctrl_t> const& get_active(size_t l) const;
+
+	/* Move the control point of active function j of level l to P */
+	void set_control_point(size_t l, size_t j, ctrl_t const& P);
+
+	/*
+	 * Add to the domain of level l >= 1 the elements of level l
+	 * that overlap the parametric box (lo, hi) and lie in the
+	 * domain of level l - 1. Level l is created if l equals
+	 * get_n_levels(). The new active functions get control points
+	 * such that the spline does not change.
+	 */
+	void refine(size_t l, knot_t const& lo, knot_t const& hi);
+
+	/*
+	 * The active functions whose truncated versions are nonzero
+	 * at x, with their values there.
+	 */
+	std::vector<ActiveFunction> active_basis(knot_t const& x) const;
+
+	/* Evaluate the spline at x */
+	ctrl_t evaluate(knot_t const& x) const;
+
+	/* Evaluate the spline at many points, in parallel */
+	std::vector<ctrl_t> evaluate(std::vector<knot_t> const& x) const;
+};
+
+#endif
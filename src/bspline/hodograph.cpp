@@ -0,0 +1,48 @@
+#include "hodograph.h"
+#include <cstddef>
+#include <vector>
+
+BSplineGeometry hodograph(BSplineGeometry const& geometry, size_t s)
+{
+	size_t k = geometry.get_n_kdims(), n_cdims = geometry.get_n_cdims();
+	if (s >= k) {
+		error("derivative dimension out of range");
+	}
+	size_t p = geometry.get_degree(s);
+	if (p == 0) {
+		error("cannot differentiate a degree zero spline");
+	}
+
+	/* Control points before, along and after dimension s */
+	size_t outer = 1, inner = 1, n = geometry.get_n_ctrl(s);
+	for (size_t r = 0; r < s; r++) outer *= geometry.get_n_ctrl(r);
+	for (size_t r = s + 1; r < k; r++) inner *= geometry.get_n_ctrl(r);
+
+	std::vector<scalar_t> const& t = geometry.get_knot_vector(s);
+	std::vector<ctrl_t> ctrl(outer * (n - 1) * inner, ctrl_t(n_cdims, 0));
+	for (size_t i = 0; i + 1 < n; i++) {
+		scalar_t h = t[i + p + 1] - t[i + 1];
+		if (h == 0) continue;
+		scalar_t w = p / h;
+		for (size_t o = 0; o < outer; o++) {
+			for (size_t j = 0; j < inner; j++) {
+				scalar_t const* a = geometry.get_control_point((o * n + i) * inner + j);
+				scalar_t const* b = geometry.get_control_point((o * n + i + 1) * inner + j);
+				ctrl_t& to = ctrl[(o * (n - 1) + i) * inner + j];
+				for (size_t c = 0; c < n_cdims; c++) {
+					to[c] = w * (b[c] - a[c]);
+				}
+			}
+		}
+	}
+
+	std::vector<size_t> degrees;
+	std::vector<std::vector<scalar_t>> knots;
+	for (size_t r = 0; r < k; r++) {
+		size_t d = geometry.get_degree(r);
+		std::vector<scalar_t> const& kv = geometry.get_knot_vector(r);
+		degrees.push_back(r == s ? d - 1 : d);
+		knots.push_back(std::vector<scalar_t>(kv.begin() + d, kv.end() - d));
+	}
+	return BSplineGeometry(k, n_cdims, degrees, knots, ctrl, geometry.get_n_threads());
+}
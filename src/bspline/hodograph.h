@@ -0,0 +1,25 @@
+#ifndef BSPLINE_HODOGRAPH_H
+#define BSPLINE_HODOGRAPH_H
+
+#include "geometry.h"
+#include <cstddef>
+
+/*
+ * The partial derivative of the spline with respect to parametric
+ * coordinate s, as a spline of its own (the hodograph).
+ *
+ * Along s the degree drops to p - 1 and the padding knots at either
+ * end lose one copy, so the unpadded knots stay the same; the
+ * control points are the differences
+ *
+ *     Q_i = p (P_{i+1} - P_i) / (t_{i+p+1} - t_{i+1})
+ *
+ * of neighbors along s (zero where the knots coincide). The other
+ * dimensions are unchanged. The result is an ordinary
+ * BSplineGeometry with the same number of threads, so it can be
+ * evaluated in batches, tessellated and so on; applying hodograph()
+ * again gives higher derivatives. Requires get_degree(s) >= 1.
+ */
+BSplineGeometry hodograph(BSplineGeometry const& geometry, size_t s);
+
+#endif
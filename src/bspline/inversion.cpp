@@ -0,0 +1,123 @@
+#include "inversion.h"
+#include "bezier.h"
+#include "linalg.h"
+#include "parallel.h"
+#include <algorithm>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+enum element_status { POSITIVE, INVERTED, UNCERTAIN };
+
+JacobianCheck check_jacobian(BSplineGeometry const& geometry, size_t max_depth)
+{
+	size_t k = geometry.get_n_kdims();
+	if (geometry.get_n_cdims() != k) {
+		error("Jacobian determinant requires equal parametric and physical dimensions");
+	}
+
+	std::vector<size_t> degrees(k), n_elem(k);
+	std::vector<std::vector<scalar_t>> breaks(k);
+	size_t total_elem = 1;
+	for (size_t s = 0; s < k; s++) {
+		if (geometry.get_degree(s) == 0) {
+			error("Jacobian determinant of a degree zero spline vanishes");
+		}
+		degrees[s] = k * geometry.get_degree(s) - 1;
+		breaks[s] = geometry.get_breakpoints(s);
+		n_elem[s] = breaks[s].size() - 1;
+		total_elem *= n_elem[s];
+	}
+	size_t n_values = 1;
+	for (size_t d : degrees) {
+		n_values *= d + 1;
+	}
+
+	std::vector<element_status> status(total_elem);
+	std::vector<scalar_t> lower(total_elem);
+	parallel_for(geometry.get_n_threads(), total_elem, [&](size_t, size_t index) {
+		std::vector<size_t> elem(k);
+		for (size_t s = k, rest = index; s > 0; s--) {
+			elem[s - 1] = rest % n_elem[s - 1];
+			rest /= n_elem[s - 1];
+		}
+
+		/* det J on the uniform grid of the element */
+		std::vector<ctrl_t> values(n_values, ctrl_t(1));
+		bool sampled_nonpositive = false;
+		knot_t x(k);
+		std::vector<scalar_t> M(k * k);
+		for (size_t v = 0; v < n_values; v++) {
+			for (size_t s = k, rest = v; s > 0; s--) {
+				size_t i = rest % (degrees[s - 1] + 1);
+				rest /= degrees[s - 1] + 1;
+				scalar_t a = breaks[s - 1][elem[s - 1]], b = breaks[s - 1][elem[s - 1] + 1];
+				/* det J is constant along a dimension of degree zero; sample its midpoint */
+				x[s - 1] = degrees[s - 1] == 0 ? (a + b) / 2 : a + (b - a) * i / degrees[s - 1];
+			}
+			std::vector<ctrl_t> J = geometry.jacobian(x);
+			for (size_t r = 0; r < k; r++) {
+				for (size_t s = 0; s < k; s++) {
+					M[r * k + s] = J[s][r];
+				}
+			}
+			values[v][0] = determinant(M, k);
+			if (values[v][0] <= 0) sampled_nonpositive = true;
+		}
+
+		BezierPatch root = bezier_interpolate(degrees, values);
+		ctrl_t lo, hi;
+		bezier_bounds(root, lo, hi);
+		scalar_t root_bound = lo[0];
+		if (sampled_nonpositive) {
+			status[index] = INVERTED;
+			lower[index] = root_bound;
+			return;
+		}
+
+		/* Subdivide only the uncertain parts */
+		element_status result = POSITIVE;
+		scalar_t bound = hi[0];
+		std::vector<std::pair<BezierPatch, size_t>> stack{{root, 0}};
+		while (!stack.empty() && result != INVERTED) {
+			BezierPatch patch = std::move(stack.back().first);
+			size_t depth = stack.back().second;
+			stack.pop_back();
+
+			bezier_bounds(patch, lo, hi);
+			if (lo[0] > 0) {
+				bound = std::min(bound, lo[0]);
+				continue;
+			}
+			bool corner_nonpositive = false;
+			for (ctrl_t const& c : bezier_corners(patch)) {
+				if (c[0] <= 0) corner_nonpositive = true;
+			}
+			if (corner_nonpositive) {
+				result = INVERTED;
+				bound = root_bound;
+				break;
+			}
+			if (depth == max_depth) {
+				result = UNCERTAIN;
+				bound = std::min(bound, lo[0]);
+				continue;
+			}
+			BezierPatch left, right;
+			bezier_subdivide(patch, depth % k, 0.5, left, right);
+			stack.push_back({std::move(left), depth + 1});
+			stack.push_back({std::move(right), depth + 1});
+		}
+		status[index] = result;
+		lower[index] = bound;
+	});
+
+	JacobianCheck check;
+	check.min_bound = lower.empty() ? 0 : lower[0];
+	for (size_t e = 0; e < total_elem; e++) {
+		check.min_bound = std::min(check.min_bound, lower[e]);
+		if (status[e] == INVERTED) check.inverted.push_back(e);
+		if (status[e] == UNCERTAIN) check.uncertain.push_back(e);
+	}
+	return check;
+}
@@ -0,0 +1,46 @@
+#ifndef BSPLINE_INVERSION_H
+#define BSPLINE_INVERSION_H
+
+#include "geometry.h"
+#include <cstddef>
+#include <vector>
+
+/*
+ * The result of check_jacobian().
+ *
+ * Elements are numbered by flattening their per-dimension element
+ * indices (see BSplineGeometry::get_spans()) lexicographically,
+ * with the last dimension varying fastest.
+ */
+struct JacobianCheck {
+	/* Elements on which det J <= 0 at some point (proven) */
+	std::vector<size_t> inverted;
+	/* Elements that could be neither proven valid nor inverted */
+	std::vector<size_t> uncertain;
+	/* A lower bound for det J over the whole geometry */
+	scalar_t min_bound;
+
+	/* True if det J was proven positive everywhere */
+	bool valid() const { return inverted.empty() && uncertain.empty(); }
+};
+
+/*
+ * Conservatively check that the Jacobian determinant of the
+ * geometry is positive everywhere. Requires n_kdims == n_cdims.
+ *
+ * On each element, det J is a polynomial of degree k * p_s - 1
+ * along dimension s, so it is represented exactly by Bernstein
+ * coefficients computed from its values on a uniform grid. If all
+ * coefficients are positive, det J is positive on the element by
+ * the convex hull property. If a corner coefficient (or any of the
+ * sampled values) is not positive, the element is inverted.
+ * Otherwise the Bezier patch is bisected, cycling through the
+ * dimensions, and only the uncertain halves are examined further,
+ * up to max_depth levels.
+ *
+ * Elements are checked in parallel with geometry.get_n_threads()
+ * threads; the result lists elements in increasing order.
+ */
+JacobianCheck check_jacobian(BSplineGeometry const& geometry, size_t max_depth = 12);
+
+#endif
@@ -0,0 +1,229 @@
+#include "knotremoval.h"
+#include "parallel.h"
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+/*
+ * The control net of one dimension s: row i holds the control
+ * points with index i along s, one after another for every line
+ * along s (each line taking n_cdims scalars).
+ */
+typedef std::vector<std::vector<scalar_t>> net_t;
+
+/* A spline being simplified: degrees, padded knots, control points */
+struct Layout {
+	std::vector<size_t> degrees;
+	std::vector<std::vector<scalar_t>> knots;
+	std::vector<size_t> n_ctrl;
+	std::vector<ctrl_t> ctrl;
+};
+
+static net_t gather(Layout const& L, size_t s)
+{
+	size_t n_cdims = L.ctrl[0].size();
+	size_t inner = 1, outer = 1;
+	for (size_t r = s + 1; r < L.n_ctrl.size(); r++) inner *= L.n_ctrl[r];
+	for (size_t r = 0; r < s; r++) outer *= L.n_ctrl[r];
+
+	net_t P(L.n_ctrl[s], std::vector<scalar_t>(outer * inner * n_cdims));
+	for (size_t o = 0; o < outer; o++) {
+		for (size_t i = 0; i < L.n_ctrl[s]; i++) {
+			for (size_t q = 0; q < inner; q++) {
+				ctrl_t const& c = L.ctrl[(o * L.n_ctrl[s] + i) * inner + q];
+				std::copy(c.begin(), c.end(), P[i].begin() + (o * inner + q) * n_cdims);
+			}
+		}
+	}
+	return P;
+}
+
+static void scatter(Layout& L, size_t s, net_t const& P)
+{
+	size_t n_cdims = L.ctrl[0].size();
+	size_t inner = 1, outer = 1;
+	for (size_t r = s + 1; r < L.n_ctrl.size(); r++) inner *= L.n_ctrl[r];
+	for (size_t r = 0; r < s; r++) outer *= L.n_ctrl[r];
+
+	L.n_ctrl[s] = P.size();
+	L.ctrl.assign(outer * P.size() * inner, ctrl_t(n_cdims));
+	for (size_t o = 0; o < outer; o++) {
+		for (size_t i = 0; i < P.size(); i++) {
+			for (size_t q = 0; q < inner; q++) {
+				auto begin = P[i].begin() + (o * inner + q) * n_cdims;
+				std::copy(begin, begin + n_cdims, L.ctrl[(o * P.size() + i) * inner + q].begin());
+			}
+		}
+	}
+}
+
+/* The largest distance between corresponding points of two rows */
+static scalar_t max_distance(std::vector<scalar_t> const& a, std::vector<scalar_t> const& b, size_t n_cdims)
+{
+	scalar_t max_d2 = 0;
+	for (size_t f = 0; f < a.size(); f += n_cdims) {
+		scalar_t d2 = 0;
+		for (size_t r = 0; r < n_cdims; r++) {
+			scalar_t d = a[f + r] - b[f + r];
+			d2 += d * d;
+		}
+		max_d2 = std::max(max_d2, d2);
+	}
+	return std::sqrt(max_d2);
+}
+
+/*
+ * Remove one copy of the knot t[r] of multiplicity m (r being the
+ * index of its last copy) from the net P of degree p. Returns the
+ * removal error; if removed is not null, it receives the new net.
+ */
+static scalar_t remove_once(std::vector<scalar_t> const& t, size_t p, long r, long m,
+		net_t const& P, size_t n_cdims, net_t* removed)
+{
+	long ord = p + 1;
+	scalar_t u = t[r];
+	long first = r - p, last = r - m;
+	net_t temp(last - first + 3);
+	temp[0] = P[first - 1];
+	temp[last - first + 2] = P[last + 1];
+	size_t width = P[0].size();
+
+	long i = first, j = last, ii = 1, jj = last - first + 1;
+	while (j - i > 0) {
+		scalar_t alf_i = (u - t[i]) / (t[i + ord] - t[i]);
+		scalar_t alf_j = (u - t[j]) / (t[j + ord] - t[j]);
+		temp[ii].resize(width);
+		temp[jj].resize(width);
+		for (size_t k = 0; k < width; k++) {
+			temp[ii][k] = (P[i][k] - (1 - alf_i) * temp[ii - 1][k]) / alf_i;
+			temp[jj][k] = (P[j][k] - alf_j * temp[jj + 1][k]) / (1 - alf_j);
+		}
+		i++; ii++;
+		j--; jj--;
+	}
+
+	scalar_t err;
+	if (j - i < 0) {
+		err = max_distance(temp[ii - 1], temp[jj + 1], n_cdims);
+	} else {
+		scalar_t alf_i = (u - t[i]) / (t[i + ord] - t[i]);
+		std::vector<scalar_t> mid(width);
+		for (size_t k = 0; k < width; k++) {
+			mid[k] = alf_i * temp[ii + 1][k] + (1 - alf_i) * temp[ii - 1][k];
+		}
+		err = max_distance(P[i], mid, n_cdims);
+	}
+
+	if (removed) {
+		*removed = P;
+		for (i = first, j = last; j - i > 0; i++, j--) {
+			(*removed)[i] = temp[i - first + 1];
+			(*removed)[j] = temp[j - first + 1];
+		}
+		removed->erase(removed->begin() + (2 * r - m - p) / 2);
+	}
+	return err;
+}
+
+/* A candidate removal: dimension, index of the last copy of the knot, multiplicity */
+struct Candidate {
+	size_t s;
+	long r, m;
+};
+
+static std::vector<Candidate> candidates(Layout const& L, size_t s)
+{
+	std::vector<Candidate> result;
+	std::vector<scalar_t> const& t = L.knots[s];
+	long p = L.degrees[s];
+	long n = L.n_ctrl[s];
+	/* interior knots have indices p + 1, ..., n - 1 */
+	for (long r = p + 1; r < n; r++) {
+		if (t[r + 1] == t[r]) continue;
+		long m = 1;
+		while (r - m > p && t[r - m] == t[r]) m++;
+		if (m <= p + 1) {
+			result.push_back({s, r, m});
+		}
+	}
+	return result;
+}
+
+static BSplineGeometry simplify(BSplineGeometry const& g, std::vector<size_t> const& dims,
+		scalar_t tol, KnotRemoval* report)
+{
+	size_t n_kdims = g.get_n_kdims(), n_cdims = g.get_n_cdims();
+	Layout L;
+	for (size_t s = 0; s < n_kdims; s++) {
+		L.degrees.push_back(g.get_degree(s));
+		L.knots.push_back(g.get_knot_vector(s));
+		L.n_ctrl.push_back(g.get_n_ctrl(s));
+	}
+	L.ctrl = g.get_control_points();
+
+	size_t n_removed = 0;
+	scalar_t deviation = 0;
+	while (true) {
+		std::vector<Candidate> cands;
+		std::vector<net_t> nets(n_kdims);
+		for (size_t s : dims) {
+			std::vector<Candidate> c = candidates(L, s);
+			if (!c.empty()) {
+				nets[s] = gather(L, s);
+			}
+			cands.insert(cands.end(), c.begin(), c.end());
+		}
+		if (cands.empty()) break;
+
+		std::vector<scalar_t> errors(cands.size());
+		parallel_for(g.get_n_threads(), cands.size(), [&](size_t, size_t c) {
+			Candidate const& k = cands[c];
+			errors[c] = remove_once(L.knots[k.s], L.degrees[k.s], k.r, k.m, 
+					nets[k.s], n_cdims, nullptr);
+		});
+
+		size_t best = 0;
+		for (size_t c = 1; c < cands.size(); c++) {
+			if (errors[c] < errors[best]) best = c;
+		}
+		if (deviation + errors[best] > tol) break;
+
+		Candidate const& k = cands[best];
+		net_t P;
+		remove_once(L.knots[k.s], L.degrees[k.s], k.r, k.m, nets[k.s], n_cdims, &P);
+		scatter(L, k.s, P);
+		L.knots[k.s].erase(L.knots[k.s].begin() + k.r);
+		deviation += errors[best];
+		n_removed++;
+	}
+
+	if (report) {
+		report->n_removed = n_removed;
+		report->max_deviation = deviation;
+	}
+
+	std::vector<std::vector<scalar_t>> knots(n_kdims);
+	for (size_t s = 0; s < n_kdims; s++) {
+		size_t p = L.degrees[s];
+		knots[s].assign(L.knots[s].begin() + p, L.knots[s].end() - p);
+	}
+	return BSplineGeometry(n_kdims, n_cdims, L.degrees, knots, L.ctrl, g.get_n_threads());
+}
+
+BSplineGeometry remove_knots(BSplineGeometry const& g, size_t s, scalar_t tol, KnotRemoval* report)
+{
+	if (s >= g.get_n_kdims()) {
+		error("knot removal dimension out of range");
+	}
+	return simplify(g, {s}, tol, report);
+}
+
+BSplineGeometry remove_knots(BSplineGeometry const& g, scalar_t tol, KnotRemoval* report)
+{
+	std::vector<size_t> dims;
+	for (size_t s = 0; s < g.get_n_kdims(); s++) {
+		dims.push_back(s);
+	}
+	return simplify(g, dims, tol, report);
+}
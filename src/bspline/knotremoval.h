@@ -0,0 +1,43 @@
+#ifndef BSPLINE_KNOTREMOVAL_H
+#define BSPLINE_KNOTREMOVAL_H
+
+#include "geometry.h"
+#include <cstddef>
+
+/*
+ * The outcome of knot removal: how many knots were removed,
+ * and a bound on the distance between the original and the
+ * simplified spline at any parametric point.
+ */
+struct KnotRemoval {
+	size_t n_removed;
+	scalar_t max_deviation;
+};
+
+/*
+ * Remove interior knots of dimension s of g while the deviation
+ * from g stays within tol, and return the simplified spline.
+ *
+ * Each removal is the knot removal algorithm of Piegl and Tiller
+ * (The NURBS Book, A5.8) applied to every line of control points
+ * along dimension s at once; its error is the largest error over
+ * those lines. Removals are made greedily, smallest error first,
+ * and their errors are summed into the reported bound, so the
+ * result is within tol of g. Knots that are exactly redundant
+ * (for example, inserted by refinement) have zero error and are
+ * always removed. Every removed knot removes one layer of control
+ * points. The candidates are tried with g.get_n_threads() threads.
+ *
+ * If report is not null, it receives the number of knots removed
+ * and the deviation bound.
+ */
+BSplineGeometry remove_knots(BSplineGeometry const& g, size_t s, scalar_t tol,
+		KnotRemoval* report = nullptr);
+
+/*
+ * As above, removing knots in all dimensions, sharing the
+ * tolerance between them.
+ */
+BSplineGeometry remove_knots(BSplineGeometry const& g, scalar_t tol, KnotRemoval* report = nullptr);
+
+#endif
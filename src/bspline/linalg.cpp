@@ -0,0 +1,210 @@
+#include "linalg.h"
+#include "parallel.h"
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+scalar_t determinant(std::vector<scalar_t> A, size_t n)
+{
+	/* Gaussian elimination with partial pivoting */
+	scalar_t det = 1;
+	for (size_t c = 0; c < n; c++) {
+		size_t pivot = c;
+		for (size_t r = c + 1; r < n; r++) {
+			if (std::fabs(A[r * n + c]) > std::fabs(A[pivot * n + c])) pivot = r;
+		}
+		if (A[pivot * n + c] == 0) return 0;
+		if (pivot != c) {
+			for (size_t b = 0; b < n; b++) std::swap(A[c * n + b], A[pivot * n + b]);
+			det = -det;
+		}
+		det *= A[c * n + c];
+		for (size_t r = c + 1; r < n; r++) {
+			scalar_t f = A[r * n + c] / A[c * n + c];
+			for (size_t b = c; b < n; b++) {
+				A[r * n + b] -= f * A[c * n + b];
+			}
+		}
+	}
+	return det;
+}
+
+std::vector<scalar_t> inverse(std::vector<scalar_t> A, size_t n)
+{
+	std::vector<scalar_t> X(n * n, 0);
+	for (size_t i = 0; i < n; i++) {
+		X[i * n + i] = 1;
+	}
+	for (size_t c = 0; c < n; c++) {
+		size_t pivot = c;
+		for (size_t r = c + 1; r < n; r++) {
+			if (std::fabs(A[r * n + c]) > std::fabs(A[pivot * n + c])) pivot = r;
+		}
+		if (A[pivot * n + c] == 0) {
+			error("cannot invert singular matrix");
+		}
+		if (pivot != c) {
+			for (size_t b = 0; b < n; b++) {
+				std::swap(A[c * n + b], A[pivot * n + b]);
+				std::swap(X[c * n + b], X[pivot * n + b]);
+			}
+		}
+		scalar_t d = A[c * n + c];
+		for (size_t b = 0; b < n; b++) {
+			A[c * n + b] /= d;
+			X[c * n + b] /= d;
+		}
+		for (size_t r = 0; r < n; r++) {
+			if (r == c || A[r * n + c] == 0) continue;
+			scalar_t f = A[r * n + c];
+			for (size_t b = 0; b < n; b++) {
+				A[r * n + b] -= f * A[c * n + b];
+				X[r * n + b] -= f * X[c * n + b];
+			}
+		}
+	}
+	return X;
+}
+
+BandedMatrix::BandedMatrix(size_t n, size_t kl, size_t ku)
+	: n(n), kl(kl), ku(ku), band(n * (kl + ku + 1), 0)
+{
+}
+
+scalar_t& BandedMatrix::at(size_t i, size_t j)
+{
+	return band[i * (kl + ku + 1) + j + kl - i];
+}
+
+scalar_t BandedMatrix::at(size_t i, size_t j) const
+{
+	return band[i * (kl + ku + 1) + j + kl - i];
+}
+
+void banded_lu(BandedMatrix& A)
+{
+	for (size_t c = 0; c < A.n; c++) {
+		scalar_t pivot = A.at(c, c);
+		if (pivot == 0) {
+			error("zero pivot in band matrix factorization");
+		}
+		size_t r_end = std::min(A.n, c + A.kl + 1);
+		size_t b_end = std::min(A.n, c + A.ku + 1);
+		for (size_t r = c + 1; r < r_end; r++) {
+			scalar_t f = A.at(r, c) / pivot;
+			A.at(r, c) = f;
+			if (f == 0) continue;
+			for (size_t b = c + 1; b < b_end; b++) {
+				A.at(r, b) -= f * A.at(c, b);
+			}
+		}
+	}
+}
+
+void banded_solve(BandedMatrix const& LU, std::vector<ctrl_t>& b)
+{
+	size_t n = LU.n;
+	size_t m = n > 0 ? b[0].size() : 0;
+
+	/* Forward substitution with the unit lower triangular factor */
+	for (size_t i = 0; i < n; i++) {
+		size_t j0 = i > LU.kl ? i - LU.kl : 0;
+		for (size_t j = j0; j < i; j++) {
+			scalar_t l = LU.at(i, j);
+			for (size_t r = 0; r < m; r++) {
+				b[i][r] -= l * b[j][r];
+			}
+		}
+	}
+
+	/* Back substitution with the upper triangular factor */
+	for (size_t i = n; i > 0; ) {
+		i--;
+		size_t j1 = std::min(n, i + LU.ku + 1);
+		for (size_t j = i + 1; j < j1; j++) {
+			scalar_t u = LU.at(i, j);
+			for (size_t r = 0; r < m; r++) {
+				b[i][r] -= u * b[j][r];
+			}
+		}
+		scalar_t d = LU.at(i, i);
+		for (size_t r = 0; r < m; r++) {
+			b[i][r] /= d;
+		}
+	}
+}
+
+scalar_t& SparseMatrix::at(size_t i, size_t j)
+{
+	auto first = column.begin() + row_start[i], last = column.begin() + row_start[i + 1];
+	auto k = std::lower_bound(first, last, j);
+	if (k == last || *k != j) {
+		error("entry outside the sparsity pattern");
+	}
+	return value[k - column.begin()];
+}
+
+void sparse_solve(SparseMatrix const& A, std::vector<ctrl_t>& b, scalar_t tolerance,
+		size_t max_iterations, size_t n_threads)
+{
+	size_t n = A.n;
+	size_t m = n > 0 ? b[0].size() : 0;
+
+	std::vector<scalar_t> diagonal(n, 1);
+	for (size_t i = 0; i < n; i++) {
+		for (size_t k = A.row_start[i]; k < A.row_start[i + 1]; k++) {
+			if (A.column[k] == i && A.value[k] > 0) diagonal[i] = A.value[k];
+		}
+	}
+	auto multiply = [&](std::vector<scalar_t> const& v, std::vector<scalar_t>& Av) {
+		parallel_for(n_threads, n, [&](size_t, size_t i) {
+			scalar_t sum = 0;
+			for (size_t k = A.row_start[i]; k < A.row_start[i + 1]; k++) {
+				sum += A.value[k] * v[A.column[k]];
+			}
+			Av[i] = sum;
+		});
+	};
+
+	std::vector<scalar_t> x(n), r(n), z(n), p(n), q(n);
+	for (size_t c = 0; c < m; c++) {
+		/* Start from x = 0, so the residual is b */
+		scalar_t rz = 0, rr = 0;
+		for (size_t i = 0; i < n; i++) {
+			x[i] = 0;
+			r[i] = b[i][c];
+			z[i] = r[i] / diagonal[i];
+			p[i] = z[i];
+			rz += r[i] * z[i];
+			rr += r[i] * r[i];
+		}
+		scalar_t limit = tolerance * tolerance * rr;
+		for (size_t iteration = 0; iteration < max_iterations && rr > limit; iteration++) {
+			multiply(p, q);
+			scalar_t pq = 0;
+			for (size_t i = 0; i < n; i++) {
+				pq += p[i] * q[i];
+			}
+			if (pq <= 0) break;
+			scalar_t alpha = rz / pq, rz_next = 0;
+			rr = 0;
+			for (size_t i = 0; i < n; i++) {
+				x[i] += alpha * p[i];
+				r[i] -= alpha * q[i];
+				z[i] = r[i] / diagonal[i];
+				rr += r[i] * r[i];
+				rz_next += r[i] * z[i];
+			}
+			scalar_t beta = rz_next / rz;
+			rz = rz_next;
+			for (size_t i = 0; i < n; i++) {
+				p[i] = z[i] + beta * p[i];
+			}
+		}
+		for (size_t i = 0; i < n; i++) {
+			b[i][c] = x[i];
+		}
+	}
+}
@@ -0,0 +1,84 @@
+#ifndef BSPLINE_LINALG_H
+#define BSPLINE_LINALG_H
+
+#include "geometry.h"
+#include <cstddef>
+#include <vector>
+
+/*
+ * Small dense linear algebra used by the BSpline code.
+ *
+ * Matrices are stored as flat row-major arrays: entry (i, j) of
+ * an n x n matrix A is A[i * n + j].
+ */
+
+/* The determinant of the n x n matrix A */
+scalar_t determinant(std::vector<scalar_t> A, size_t n);
+
+/*
+ * The inverse of the n x n matrix A, by Gauss-Jordan elimination
+ * with partial pivoting. A must be nonsingular.
+ */
+std::vector<scalar_t> inverse(std::vector<scalar_t> A, size_t n);
+
+/*
+ * A square n x n band matrix with kl subdiagonals and ku
+ * superdiagonals. Entry (i, j), for i - kl <= j <= i + ku, is
+ * stored at band[i * (kl + ku + 1) + j + kl - i]; all other
+ * entries are zero.
+ */
+struct BandedMatrix {
+	size_t n, kl, ku;
+	std::vector<scalar_t> band;
+
+	BandedMatrix(size_t n, size_t kl, size_t ku);
+	scalar_t& at(size_t i, size_t j);
+	scalar_t at(size_t i, size_t j) const;
+};
+
+/*
+ * Factor A = LU in place, without pivoting, in O(n * kl * ku)
+ * operations. The factors keep the band structure.
+ *
+ * Pivoting is unnecessary for the matrices used here: B-Spline
+ * collocation matrices are totally positive, so Gaussian
+ * elimination without pivoting is stable (de Boor, 1977).
+ */
+void banded_lu(BandedMatrix& A);
+
+/*
+ * Solve LU x = b for a matrix factored by banded_lu(), with
+ * several right hand sides at once: b[i] is row i of the right
+ * hand side, and is overwritten with row i of the solution.
+ */
+void banded_solve(BandedMatrix const& LU, std::vector<ctrl_t>& b);
+
+/*
+ * A sparse n x n matrix in compressed sparse row form: the entries
+ * of row i are value[k] in column column[k], for row_start[i] <= k <
+ * row_start[i + 1], in increasing order of column. All other entries
+ * are zero.
+ */
+struct SparseMatrix {
+	size_t n;
+	std::vector<size_t> row_start;
+	std::vector<size_t> column;
+	std::vector<scalar_t> value;
+
+	/* Entry (i, j), which must be stored */
+	scalar_t& at(size_t i, size_t j);
+};
+
+/*
+ * Solve A x = b for a symmetric positive definite sparse matrix A by
+ * the conjugate gradient method with diagonal preconditioning. As
+ * for banded_solve(), b[i] is row i of several right hand sides, and
+ * is overwritten with row i of the solution. Each right hand side is
+ * iterated until its residual is at most tolerance times its norm,
+ * or for max_iterations steps. Products with A are split over
+ * n_threads threads; the result does not depend on n_threads.
+ */
+void sparse_solve(SparseMatrix const& A, std::vector<ctrl_t>& b, scalar_t tolerance,
+		size_t max_iterations, size_t n_threads = 1);
+
+#endif
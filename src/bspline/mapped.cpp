@@ -0,0 +1,255 @@
+#include "mapped.h"
+#include "parallel.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstdio>
+#include <fcntl.h>
+#include <numeric>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+/* The size of the file header in bytes */
+static const size_t header_size = 3 * sizeof(unsigned long long);
+
+bool write_control_point_file(std::string const& filename, std::vector<ctrl_t> const& control_points)
+{
+	FILE* file = std::fopen(filename.c_str(), "wb");
+	if (!file) {
+		return false;
+	}
+	unsigned long long header[3] = {control_file_magic,
+		control_points.empty() ? 0 : control_points[0].size(), control_points.size()};
+	bool ok = std::fwrite(header, sizeof(header), 1, file) == 1;
+	for (ctrl_t const& P : control_points) {
+		if (!ok) break;
+		ok = P.size() == header[1] && std::fwrite(P.data(), sizeof(scalar_t), P.size(), file) == P.size();
+	}
+	return std::fclose(file) == 0 && ok;
+}
+
+MappedBSplineGeometry::MappedBSplineGeometry(size_t n_kdims, size_t n_cdims,
+		std::vector<size_t> const& degrees, std::vector<std::vector<scalar_t>> const& knot_vectors,
+		std::string const& filename, size_t n_threads)
+	: n_kdims(n_kdims), n_cdims(n_cdims), n_threads(n_threads), degrees(degrees),
+	  mapping(nullptr), mapping_size(0), coordinates(nullptr)
+{
+	if (n_kdims == 0 || n_cdims == 0 || n_threads == 0) {
+		error("cannot create MappedBSplineGeometry with zero dimensions or threads");
+	}
+	if (degrees.size() != n_kdims) {
+		error("incorrect number of degrees provided");
+	}
+	if (knot_vectors.size() != n_kdims) {
+		error("incorrect number of knot vectors provided");
+	}
+
+	/* The univariate splines check the knots */
+	size_t total = 1;
+	for (size_t s = 0; s < n_kdims; s++) {
+		size_t n = knot_vectors[s].size() + degrees[s] - 1;
+		axes.push_back(BSplineGeometry(1, 1, {degrees[s]}, {knot_vectors[s]},
+					std::vector<ctrl_t>(n, ctrl_t(1, 0))));
+		n_ctrl.push_back(n);
+		total *= n;
+	}
+
+	int fd = open(filename.c_str(), O_RDONLY);
+	if (fd < 0) {
+		error("cannot open control point file");
+	}
+	struct stat info;
+	if (fstat(fd, &info) != 0 || size_t(info.st_size) < header_size) {
+		close(fd);
+		error("control point file is too short");
+	}
+	mapping_size = info.st_size;
+	mapping = mmap(nullptr, mapping_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (mapping == MAP_FAILED) {
+		mapping = nullptr;
+		error("cannot map control point file");
+	}
+
+	unsigned long long const* header = static_cast<unsigned long long const*>(mapping);
+	if (header[0] != control_file_magic) {
+		error("not a control point file");
+	}
+	if (header[1] != n_cdims) {
+		error("control point has incorrect dimension");
+	}
+	if (header[2] != total || mapping_size != header_size + total * n_cdims * sizeof(scalar_t)) {
+		error("incorrect number of control points");
+	}
+	coordinates = reinterpret_cast<scalar_t const*>(static_cast<char const*>(mapping) + header_size);
+
+	/* Single evaluations touch a few scattered pages; readahead would be wasted */
+	madvise(mapping, mapping_size, MADV_RANDOM);
+}
+
+MappedBSplineGeometry::~MappedBSplineGeometry()
+{
+	if (mapping) {
+		munmap(mapping, mapping_size);
+	}
+}
+
+void MappedBSplineGeometry::find_spans(knot_t const& x, size_t* spans) const
+{
+	if (x.size() != n_kdims) {
+		error("dimensions of evaluation point do not match B-spline geometry");
+	}
+	for (size_t s = 0; s < n_kdims; s++) {
+		std::vector<scalar_t> const& t = axes[s].get_knot_vector(0);
+		if (x[s] < t.front() || x[s] > t.back()) {
+			error("evaluating at out-of-bounds point");
+		}
+		spans[s] = axes[s].find_span(0, x[s]);
+	}
+}
+
+size_t MappedBSplineGeometry::first_support(size_t const* spans) const
+{
+	size_t I = 0;
+	for (size_t s = 0; s < n_kdims; s++) {
+		I = spans[s] - degrees[s] + n_ctrl[s] * I;
+	}
+	return I;
+}
+
+void MappedBSplineGeometry::evaluate_in_spans(knot_t const& x, size_t const* spans,
+		std::vector<std::vector<scalar_t>>& ders, ctrl_t& y) const
+{
+	std::vector<std::vector<scalar_t>> one;
+	for (size_t s = 0; s < n_kdims; s++) {
+		axes[s].basis_derivatives(0, spans[s], x[s], 0, one);
+		ders[s].swap(one[0]);
+	}
+
+	/* Rows of control points along the last dimension are contiguous in the file */
+	y.assign(n_cdims, 0);
+	size_t last = n_kdims - 1;
+	std::vector<size_t> pos(last, 0);
+	while (true) {
+		size_t I = 0;
+		scalar_t w = 1;
+		for (size_t s = 0; s < last; s++) {
+			I = spans[s] - degrees[s] + pos[s] + n_ctrl[s] * I;
+			w *= ders[s][pos[s]];
+		}
+		I = spans[last] - degrees[last] + n_ctrl[last] * I;
+		scalar_t const* row = coordinates + I * n_cdims;
+		for (size_t q = 0; q <= degrees[last]; q++) {
+			scalar_t B = w * ders[last][q];
+			for (size_t r = 0; r < n_cdims; r++) {
+				y[r] += B * row[q * n_cdims + r];
+			}
+		}
+
+		size_t s = last;
+		while (s > 0) {
+			s--;
+			if (++pos[s] <= degrees[s]) break;
+			pos[s] = 0;
+		}
+		if (s == 0 && (last == 0 || pos[0] == 0)) break;
+	}
+}
+
+void MappedBSplineGeometry::will_need(size_t first, size_t last) const
+{
+	size_t page = sysconf(_SC_PAGESIZE);
+	size_t begin = header_size + first * n_cdims * sizeof(scalar_t);
+	size_t end = std::min(mapping_size, header_size + (last + 1) * n_cdims * sizeof(scalar_t));
+	begin -= begin % page;
+	madvise(static_cast<char*>(mapping) + begin, end - begin, MADV_WILLNEED);
+}
+
+ctrl_t MappedBSplineGeometry::evaluate(knot_t const& x) const
+{
+	std::vector<size_t> spans(n_kdims);
+	find_spans(x, spans.data());
+	std::vector<std::vector<scalar_t>> ders(n_kdims);
+	ctrl_t y;
+	evaluate_in_spans(x, spans.data(), ders, y);
+	return y;
+}
+
+std::vector<ctrl_t> MappedBSplineGeometry::evaluate(std::vector<knot_t> const& x) const
+{
+	size_t n = x.size(), k = n_kdims;
+	std::vector<size_t> spans(n * k), key(n);
+	parallel_for(n_threads, n, [&](size_t, size_t i) {
+		find_spans(x[i], &spans[i * k]);
+		key[i] = first_support(&spans[i * k]);
+	});
+	std::vector<size_t> order(n);
+	std::iota(order.begin(), order.end(), 0);
+	std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+		return key[a] < key[b];
+	});
+
+	/* The largest offset from the first to the last control point of a support */
+	size_t reach = 0;
+	for (size_t s = 0, stride = 1; s < k; s++) {
+		reach += degrees[k - 1 - s] * stride;
+		stride *= n_ctrl[k - 1 - s];
+	}
+
+	std::vector<ctrl_t> y(n);
+	parallel_for(n_threads, n_threads, [&](size_t, size_t block) {
+		size_t begin = n * block / n_threads, end = n * (block + 1) / n_threads;
+		std::vector<std::vector<scalar_t>> ders(k);
+		if (begin < end) {
+			will_need(key[order[begin]], key[order[std::min(end, begin + chunk_size) - 1]] + reach);
+		}
+		for (size_t chunk = begin; chunk < end; chunk += chunk_size) {
+			size_t next = chunk + chunk_size;
+			if (next < end) {
+				will_need(key[order[next]], key[order[std::min(end, next + chunk_size) - 1]] + reach);
+			}
+			for (size_t i = chunk; i < std::min(end, next); i++) {
+				size_t j = order[i];
+				evaluate_in_spans(x[j], &spans[j * k], ders, y[j]);
+			}
+		}
+	});
+	return y;
+}
+
+size_t MappedBSplineGeometry::get_n_kdims() const
+{
+	return n_kdims;
+}
+
+size_t MappedBSplineGeometry::get_n_cdims() const
+{
+	return n_cdims;
+}
+
+size_t MappedBSplineGeometry::get_n_threads() const
+{
+	return n_threads;
+}
+
+size_t MappedBSplineGeometry::get_degree(size_t s) const
+{
+	return degrees[s];
+}
+
+size_t MappedBSplineGeometry::get_n_ctrl(size_t s) const
+{
+	return n_ctrl[s];
+}
+
+ctrl_t MappedBSplineGeometry::get_control_point(size_t I) const
+{
+	size_t total = 1;
+	for (size_t n : n_ctrl) total *= n;
+	if (I >= total) {
+		error("control point index out of range");
+	}
+	return ctrl_t(coordinates + I * n_cdims, coordinates + (I + 1) * n_cdims);
+}
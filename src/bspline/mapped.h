@@ -0,0 +1,101 @@
+#ifndef BSPLINE_MAPPED_H
+#define BSPLINE_MAPPED_H
+
+#include "geometry.h"
+#include <cstddef>
+#include <string>
+#include <vector>
+
+/*
+ * A control point file: a header of three 64-bit unsigned integers
+ * (the magic number control_file_magic, n_cdims and the number of
+ * control points), followed by the coordinates of the control points
+ * as scalar_t in native byte order, in the order of a BSplineGeometry
+ * (lexicographic, last dimension fastest).
+ */
+static const unsigned long long control_file_magic = 0x4c52544350534221ULL;
+
+/* Write control points to a control point file. Returns false on failure. */
+bool write_control_point_file(std::string const& filename, std::vector<ctrl_t> const& control_points);
+
+/*
+ * A B-Spline whose control points stay on disk, for control nets
+ * larger than memory.
+ *
+ * The control point file is mapped read-only, and only the knots
+ * (and a univariate spline per dimension for its basis functions)
+ * are kept in memory; the operating system pages the control points
+ * in as evaluation touches them. It evaluates like BSplineGeometry,
+ * whose storage it cannot share since that keeps every control
+ * point in its own vector.
+ */
+class MappedBSplineGeometry {
+private:
+	size_t n_kdims;
+	size_t n_cdims;
+	size_t n_threads;
+	std::vector<size_t> degrees;
+	std::vector<size_t> n_ctrl;
+	/* A univariate spline per dimension, for its spans and basis functions */
+	std::vector<BSplineGeometry> axes;
+
+	/* The mapping of the whole file, and the coordinates inside it */
+	void* mapping;
+	size_t mapping_size;
+	scalar_t const* coordinates;
+
+	/* Check that x is in bounds, and find its knot span in every dimension */
+	void find_spans(knot_t const& x, size_t* spans) const;
+
+	/* The flattened index of the first control point that is nonzero in the spans */
+	size_t first_support(size_t const* spans) const;
+
+	/* Evaluate at x, whose knot spans are already known, into y */
+	void evaluate_in_spans(knot_t const& x, size_t const* spans,
+			std::vector<std::vector<scalar_t>>& ders, ctrl_t& y) const;
+
+	/* Ask the operating system to read the control points first, ..., last ahead */
+	void will_need(size_t first, size_t last) const;
+
+public:
+	/* The number of points per chunk of the batch evaluate() */
+	static const size_t chunk_size = 1024;
+
+	/*
+	 * Map a control point file written for the given degrees and
+	 * knot vectors (as for the constructor of BSplineGeometry).
+	 */
+	MappedBSplineGeometry(size_t n_kdims, size_t n_cdims, std::vector<size_t> const& degrees,
+			std::vector<std::vector<scalar_t>> const& knot_vectors, std::string const& filename,
+			size_t n_threads = 1);
+	~MappedBSplineGeometry();
+	MappedBSplineGeometry(MappedBSplineGeometry const&) = delete;
+	MappedBSplineGeometry& operator=(MappedBSplineGeometry const&) = delete;
+
+	/* Evaluate the spline at x. Safe to call concurrently. */
+	ctrl_t evaluate(knot_t const& x) const;
+
+	/*
+	 * Map operation, in parallel with get_n_threads() threads.
+	 *
+	 * The points are sorted by the element containing them (in
+	 * control point order) so that each thread sweeps through the
+	 * file once instead of touching its pages at random. Every
+	 * thread announces the control points of its next chunk of
+	 * chunk_size points to the kernel (madvise(MADV_WILLNEED))
+	 * while it evaluates the current one. The results are returned
+	 * in the order of x.
+	 */
+	std::vector<ctrl_t> evaluate(std::vector<knot_t> const& x) const;
+
+	size_t get_n_kdims() const;
+	size_t get_n_cdims() const;
+	size_t get_n_threads() const;
+	size_t get_degree(size_t s) const;
+	size_t get_n_ctrl(size_t s) const;
+
+	/* The control point with flattened index I */
+	ctrl_t get_control_point(size_t I) const;
+};
+
+#endif
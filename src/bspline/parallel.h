@@ -0,0 +1,43 @@
+#ifndef BSPLINE_PARALLEL_H
+#define BSPLINE_PARALLEL_H
+
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+/*
+ * Call body(tid, i) for every 0 <= i < n, using n_threads threads.
+ *
+ * The range is split into n_threads contiguous blocks, and block
+ * number tid is processed in increasing order of i by the thread
+ * with identification number tid. This matches the scratch space
+ * convention of BSplineGeometry: a body that evaluates a geometry
+ * with n_threads scratch spaces may pass tid on to evaluate().
+ *
+ * With n_threads = 1 the body runs on the calling thread.
+ */
+template <typename Body>
+void parallel_for(size_t n_threads, size_t n, Body body)
+{
+	if (n_threads <= 1 || n <= 1) {
+		for (size_t i = 0; i < n; i++) {
+			body(0, i);
+		}
+		return;
+	}
+
+	std::vector<std::thread> workers;
+	for (size_t tid = 0; tid < n_threads; tid++) {
+		size_t begin = n * tid / n_threads, end = n * (tid + 1) / n_threads;
+		workers.emplace_back([=, &body]() {
+			for (size_t i = begin; i < end; i++) {
+				body(tid, i);
+			}
+		});
+	}
+	for (std::thread& worker : workers) {
+		worker.join();
+	}
+}
+
+#endif
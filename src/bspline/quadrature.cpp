@@ -0,0 +1,321 @@
+#include "quadrature.h"
+#include "linalg.h"
+#include "parallel.h"
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <vector>
+
+void gauss_legendre(size_t n, std::vector<scalar_t>& nodes, std::vector<scalar_t>& weights)
+{
+	if (n == 0) {
+		error("Gauss-Legendre rule needs at least one point");
+	}
+	nodes.assign(n, 0);
+	weights.assign(n, 0);
+
+	/*
+	 * Newton's method on the Legendre polynomial P_n, started from
+	 * the Chebyshev-like approximation of each root. The roots are
+	 * symmetric, so only half of them are computed.
+	 */
+	for (size_t i = 0; i < (n + 1) / 2; i++) {
+		scalar_t x = std::cos(M_PI * (i + 0.75) / (n + 0.5));
+		scalar_t dp = 0;
+		for (int iter = 0; iter < 100; iter++) {
+			/* P_n(x) and P_n'(x) by the three-term recurrence */
+			scalar_t p0 = 1, p1 = x;
+			for (size_t k = 2; k <= n; k++) {
+				scalar_t p2 = ((2 * k - 1) * x * p1 - (k - 1) * p0) / k;
+				p0 = p1;
+				p1 = p2;
+			}
+			dp = n * (x * p1 - p0) / (x * x - 1);
+			scalar_t dx = p1 / dp;
+			x -= dx;
+			if (std::fabs(dx) < 1e-15) break;
+		}
+		nodes[i] = -x;
+		nodes[n - 1 - i] = x;
+		weights[i] = weights[n - 1 - i] = 2 / ((1 - x * x) * dp * dp);
+	}
+	if (n % 2 == 1) {
+		nodes[n / 2] = 0;
+	}
+}
+
+scalar_t measure_density(std::vector<ctrl_t> const& J)
+{
+	/* Gram matrix G = J^T J */
+	size_t k = J.size();
+	std::vector<scalar_t> G(k * k);
+	for (size_t a = 0; a < k; a++) {
+		for (size_t b = 0; b < k; b++) {
+			scalar_t g = 0;
+			for (size_t r = 0; r < J[a].size(); r++) {
+				g += J[a][r] * J[b][r];
+			}
+			G[a * k + b] = g;
+		}
+	}
+
+	scalar_t det = determinant(G, k);
+	return det > 0 ? std::sqrt(det) : 0;
+}
+
+std::vector<scalar_t> integrate(BSplineGeometry const& geometry, size_t n_components,
+		integrand_t const& integrand, size_t n_points)
+{
+	size_t n_kdims = geometry.get_n_kdims();
+	size_t n_cdims = geometry.get_n_cdims();
+
+	/*
+	 * Per-dimension tables: for every element e along dimension s
+	 * and every Gauss point q, the parametric coordinate, the scaled
+	 * weight, and the basis functions with their first derivatives.
+	 */
+	struct tab_entry {
+		scalar_t u;
+		scalar_t w;
+		std::vector<std::vector<scalar_t>> ders;
+	};
+	std::vector<std::vector<size_t>> spans(n_kdims);
+	std::vector<std::vector<std::vector<tab_entry>>> tab(n_kdims);
+	std::vector<size_t> n_quad(n_kdims), n_elem(n_kdims);
+	size_t total_elem = 1;
+	for (size_t s = 0; s < n_kdims; s++) {
+		size_t p = geometry.get_degree(s);
+		n_quad[s] = n_points > 0 ? n_points : p + 1;
+		std::vector<scalar_t> nodes, weights;
+		gauss_legendre(n_quad[s], nodes, weights);
+
+		std::vector<scalar_t> const& t = geometry.get_knot_vector(s);
+		spans[s] = geometry.get_spans(s);
+		n_elem[s] = spans[s].size();
+		total_elem *= n_elem[s];
+		tab[s].resize(n_elem[s]);
+		for (size_t e = 0; e < n_elem[s]; e++) {
+			size_t j = spans[s][e];
+			scalar_t a = t[j], b = t[j + 1];
+			for (size_t q = 0; q < n_quad[s]; q++) {
+				tab_entry entry;
+				entry.u = 0.5 * (a + b) + 0.5 * (b - a) * nodes[q];
+				entry.w = 0.5 * (b - a) * weights[q];
+				geometry.basis_derivatives(s, j, entry.u, 1, entry.ders);
+				tab[s][e].push_back(entry);
+			}
+		}
+	}
+
+	std::vector<std::vector<scalar_t>> elem_sums(total_elem, std::vector<scalar_t>(n_components, 0));
+	parallel_for(geometry.get_n_threads(), total_elem, [&](size_t, size_t index) {
+		/* Element multi-index, last dimension fastest */
+		std::vector<size_t> elem(n_kdims);
+		for (size_t s = n_kdims, rest = index; s > 0; s--) {
+			elem[s - 1] = rest % n_elem[s - 1];
+			rest /= n_elem[s - 1];
+		}
+
+		knot_t x(n_kdims);
+		ctrl_t y(n_cdims);
+		std::vector<ctrl_t> J(n_kdims, ctrl_t(n_cdims));
+		std::vector<size_t> qpos(n_kdims, 0), cpos(n_kdims);
+		std::vector<scalar_t>& f = elem_sums[index];
+		while (true) {
+			std::vector<tab_entry const*> entry(n_kdims);
+			scalar_t weight = 1;
+			for (size_t s = 0; s < n_kdims; s++) {
+				entry[s] = &tab[s][elem[s]][qpos[s]];
+				x[s] = entry[s]->u;
+				weight *= entry[s]->w;
+			}
+
+			/* Value and Jacobian from the tabulated basis functions */
+			std::fill(y.begin(), y.end(), 0);
+			for (ctrl_t& column : J) {
+				std::fill(column.begin(), column.end(), 0);
+			}
+			std::fill(cpos.begin(), cpos.end(), 0);
+			while (true) {
+				size_t I = 0;
+				scalar_t B = 1;
+				for (size_t s = 0; s < n_kdims; s++) {
+					I = spans[s][elem[s]] - geometry.get_degree(s) + cpos[s] 
+						+ geometry.get_n_ctrl(s) * I;
+					B *= entry[s]->ders[0][cpos[s]];
+				}
+				scalar_t const* P = geometry.get_control_point(I);
+				for (size_t r = 0; r < n_cdims; r++) {
+					y[r] += B * P[r];
+				}
+				for (size_t d = 0; d < n_kdims; d++) {
+					scalar_t dB = 1;
+					for (size_t s = 0; s < n_kdims; s++) {
+						dB *= entry[s]->ders[s == d ? 1 : 0][cpos[s]];
+					}
+					for (size_t r = 0; r < n_cdims; r++) {
+						J[d][r] += dB * P[r];
+					}
+				}
+
+				size_t s = n_kdims;
+				while (s > 0) {
+					s--;
+					if (++cpos[s] <= geometry.get_degree(s)) break;
+					cpos[s] = 0;
+				}
+				if (s == 0 && cpos[0] == 0) break;
+			}
+
+			integrand(x, y, J, weight * measure_density(J), f);
+
+			size_t s = n_kdims;
+			while (s > 0) {
+				s--;
+				if (++qpos[s] < n_quad[s]) break;
+				qpos[s] = 0;
+			}
+			if (s == 0 && qpos[0] == 0) break;
+		}
+	});
+
+	/* Deterministic reduction in element order */
+	std::vector<scalar_t> total(n_components, 0);
+	for (std::vector<scalar_t> const& f : elem_sums) {
+		for (size_t i = 0; i < n_components; i++) {
+			total[i] += f[i];
+		}
+	}
+	return total;
+}
+
+scalar_t measure(BSplineGeometry const& geometry, size_t n_points)
+{
+	auto one = [](knot_t const&, ctrl_t const&, std::vector<ctrl_t> const&, 
+			scalar_t weight, std::vector<scalar_t>& f) {
+		f[0] += weight;
+	};
+	return integrate(geometry, 1, one, n_points)[0];
+}
+
+/* The 15-point Kronrod rule on [-1, 1] and its embedded 7-point Gauss rule */
+static const scalar_t kronrod_nodes[8] = {
+	0.991455371120812639206854697526329, 0.949107912342758524526189684047851,
+	0.864864423359769072789712788640926, 0.741531185599394439863864773280788,
+	0.586087235467691130294144845693013, 0.405845151377397166906606412076961,
+	0.207784955007898467600689403773245, 0
+};
+static const scalar_t kronrod_weights[8] = {
+	0.022935322010529224963732008058970, 0.063092092629978553290700663189204,
+	0.104790010322250183839876322541518, 0.140653259715525918745189590510238,
+	0.169004726639267902826583426598550, 0.190350578064785409913256402421014,
+	0.204432940075298892414161999234649, 0.209482141084727828012999174891714
+};
+static const scalar_t gauss_weights[4] = {
+	0.129484966168869693270611432679082, 0.279705391489276667901467771423780,
+	0.381830050505118944950369775488975, 0.417959183673469387755102040816327
+};
+
+scalar_t adaptive_measure(BSplineGeometry const& geometry, scalar_t tolerance,
+		size_t max_depth, size_t max_evaluations, scalar_t* error)
+{
+	size_t k = geometry.get_n_kdims();
+
+	/* The 15 nodes with their Kronrod and Gauss weights (zero off the Gauss nodes) */
+	scalar_t node[15], wk[15], wg[15];
+	for (size_t i = 0; i < 15; i++) {
+		size_t j = i < 8 ? i : 14 - i;
+		node[i] = i < 8 ? -kronrod_nodes[j] : kronrod_nodes[j];
+		wk[i] = kronrod_weights[j];
+		wg[i] = j % 2 == 1 ? gauss_weights[j / 2] : 0;
+	}
+	size_t n_nodes = 1;
+	for (size_t s = 0; s < k; s++) n_nodes *= 15;
+
+	std::vector<std::vector<scalar_t>> breaks(k);
+	std::vector<size_t> n_elem(k);
+	size_t total_elem = 1;
+	scalar_t domain = 1;
+	for (size_t s = 0; s < k; s++) {
+		breaks[s] = geometry.get_breakpoints(s);
+		n_elem[s] = breaks[s].size() - 1;
+		total_elem *= n_elem[s];
+		domain *= breaks[s].back() - breaks[s].front();
+	}
+
+	/* The evaluations per element; the root cell is always integrated */
+	size_t budget = std::max(max_evaluations / total_elem, n_nodes);
+	size_t children = size_t(1) << k;
+
+	struct cell {
+		std::vector<scalar_t> lo, hi;
+		size_t depth;
+	};
+	std::vector<scalar_t> elem_sums(total_elem, 0), elem_errors(total_elem, 0);
+	parallel_for(geometry.get_n_threads(), total_elem, [&](size_t, size_t index) {
+		cell root{std::vector<scalar_t>(k), std::vector<scalar_t>(k), 0};
+		for (size_t s = k, rest = index; s > 0; s--) {
+			size_t e = rest % n_elem[s - 1];
+			rest /= n_elem[s - 1];
+			root.lo[s - 1] = breaks[s - 1][e];
+			root.hi[s - 1] = breaks[s - 1][e + 1];
+		}
+
+		std::vector<cell> stack{root};
+		/* The evaluations spent or promised to the cells on the stack */
+		size_t committed = n_nodes;
+		knot_t x(k);
+		while (!stack.empty()) {
+			cell c = std::move(stack.back());
+			stack.pop_back();
+			scalar_t size = 1;
+			for (size_t s = 0; s < k; s++) size *= c.hi[s] - c.lo[s];
+
+			scalar_t kronrod = 0, gauss = 0;
+			for (size_t v = 0; v < n_nodes; v++) {
+				scalar_t w_k = size, w_g = size;
+				for (size_t s = k, rest = v; s > 0; s--) {
+					size_t i = rest % 15;
+					rest /= 15;
+					x[s - 1] = 0.5 * (c.lo[s - 1] + c.hi[s - 1]) + 0.5 * (c.hi[s - 1] - c.lo[s - 1]) * node[i];
+					w_k *= 0.5 * wk[i];
+					w_g *= 0.5 * wg[i];
+				}
+				scalar_t density = measure_density(geometry.jacobian(x));
+				kronrod += w_k * density;
+				gauss += w_g * density;
+			}
+
+			scalar_t estimate = std::fabs(kronrod - gauss);
+			scalar_t rounding = 50 * std::numeric_limits<scalar_t>::epsilon() * std::fabs(kronrod);
+			if (estimate <= std::max(tolerance * size / domain, rounding) || c.depth >= max_depth
+					|| committed + children * n_nodes > budget) {
+				elem_sums[index] += kronrod;
+				elem_errors[index] += estimate;
+				continue;
+			}
+
+			/* Bisect along every dimension */
+			committed += children * n_nodes;
+			for (size_t child = 0; child < children; child++) {
+				cell half{c.lo, c.hi, c.depth + 1};
+				for (size_t s = 0; s < k; s++) {
+					scalar_t mid = 0.5 * (c.lo[s] + c.hi[s]);
+					if (child >> s & 1) half.lo[s] = mid;
+					else half.hi[s] = mid;
+				}
+				stack.push_back(half);
+			}
+		}
+	});
+
+	/* Deterministic reduction in element order */
+	scalar_t total = 0, total_error = 0;
+	for (size_t e = 0; e < total_elem; e++) {
+		total += elem_sums[e];
+		total_error += elem_errors[e];
+	}
+	if (error) *error = total_error;
+	return total;
+}
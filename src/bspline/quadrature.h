@@ -0,0 +1,84 @@
+#ifndef BSPLINE_QUADRATURE_H
+#define BSPLINE_QUADRATURE_H
+
+#include "geometry.h"
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+/*
+ * Nodes and weights of the n-point Gauss-Legendre rule on [-1, 1],
+ * which integrates polynomials of degree up to 2n - 1 exactly.
+ */
+void gauss_legendre(size_t n, std::vector<scalar_t>& nodes, std::vector<scalar_t>& weights);
+
+/*
+ * The measure (length, area or volume) element of the geometry
+ * at a point with Jacobian columns J[0], ..., J[k-1].
+ *
+ * This is sqrt(det(J^T J)), which reduces to |det J| when the
+ * parametric and physical dimensions agree.
+ */
+scalar_t measure_density(std::vector<ctrl_t> const& J);
+
+/*
+ * A function to integrate over the image of a geometry.
+ * It receives the parametric point x, the physical point y
+ * and the Jacobian columns J at a quadrature point, and adds
+ * its value (which has a fixed number of components) times
+ * weight to the running sum f. It may be called concurrently
+ * from several threads.
+ */
+typedef std::function<void(knot_t const& x, ctrl_t const& y,
+		std::vector<ctrl_t> const& J, scalar_t weight, std::vector<scalar_t>& f)> integrand_t;
+
+/*
+ * Integrate over the image of the geometry by element-wise
+ * tensor product Gauss quadrature.
+ *
+ * n_points is the number of Gauss points per element in each
+ * parametric dimension; with the default of 0, degree + 1 points
+ * are used in each dimension. The weight passed to the integrand
+ * already includes the measure density, so a constant integrand
+ * of 1 yields the length/area/volume of the geometry.
+ *
+ * Basis functions and their derivatives are tabulated once per
+ * knot span and Gauss point in each dimension, and reused by all
+ * elements sharing that span. Elements are processed in parallel
+ * with geometry.get_n_threads() threads. Each element's
+ * contribution is summed separately and the element sums are
+ * reduced in element order, so the result does not depend on
+ * the number of threads.
+ */
+std::vector<scalar_t> integrate(BSplineGeometry const& geometry, size_t n_components,
+		integrand_t const& integrand, size_t n_points = 0);
+
+/* The length, area or volume of the image of the geometry */
+scalar_t measure(BSplineGeometry const& geometry, size_t n_points = 0);
+
+/*
+ * The length of a curve or the area of a surface (or the volume of
+ * a volume) to within an absolute tolerance, by adaptive
+ * Gauss-Kronrod quadrature.
+ *
+ * Every element is integrated with the tensor product of the
+ * 15-point Kronrod rule, and the difference to the embedded 7-point
+ * Gauss rule serves as an error estimate. An element, or part of
+ * one, whose estimate exceeds its share of tolerance (in proportion
+ * to its parametric size) is bisected along every dimension, at
+ * most max_depth times. Estimates below 50 machine epsilons of the
+ * part's measure are rounding noise and are accepted regardless of
+ * tolerance, as in QUADPACK. Each element may spend its share of
+ * max_evaluations evaluations of the density (which comes from
+ * jacobian()); parts that would exceed it are not bisected further.
+ * Elements are processed in parallel with the geometry's threads
+ * and reduced in element order.
+ *
+ * If error is not null, the sum of the accepted error estimates is
+ * stored there. It exceeds tolerance when the tolerance could not
+ * be met within max_depth, max_evaluations or rounding.
+ */
+scalar_t adaptive_measure(BSplineGeometry const& geometry, scalar_t tolerance = 1e-10,
+		size_t max_depth = 20, size_t max_evaluations = 10000000, scalar_t* error = nullptr);
+
+#endif
@@ -0,0 +1,303 @@
+#include "raytrace.h"
+#include "parallel.h"
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <fstream>
+#include <vector>
+
+/*
+ * A face of an element on the boundary of the geometry: the
+ * parametric box lo..hi with coordinates fixed in all dimensions
+ * except free[0] and free[1], and the bounding box of its control
+ * points.
+ */
+struct face {
+	knot_t lo, hi;
+	size_t free[2];
+	AABB box;
+};
+
+/*
+ * The bounding box of the control points with index ranges
+ * first[s], ..., last[s] in each dimension.
+ */
+static AABB hull(BSplineGeometry const& geometry, std::vector<size_t> const& first, 
+		std::vector<size_t> const& last)
+{
+	size_t k = first.size(), n_cdims = geometry.get_n_cdims();
+	AABB box;
+	std::vector<size_t> pos = first;
+	while (true) {
+		size_t I = 0;
+		for (size_t s = 0; s < k; s++) {
+			I = pos[s] + geometry.get_n_ctrl(s) * I;
+		}
+		scalar_t const* P = geometry.get_control_point(I);
+		if (box.lo.empty()) box.lo = box.hi = ctrl_t(P, P + n_cdims);
+		for (size_t r = 0; r < n_cdims; r++) {
+			box.lo[r] = std::min(box.lo[r], P[r]);
+			box.hi[r] = std::max(box.hi[r], P[r]);
+		}
+
+		size_t s = k;
+		while (s > 0) {
+			s--;
+			if (++pos[s] <= last[s]) break;
+			pos[s] = first[s];
+		}
+		if (s == 0 && pos[0] == first[0]) break;
+	}
+	return box;
+}
+
+/*
+ * The boundary faces of element e (the element itself for surfaces).
+ * Since the knot vectors are clamped, the boundary of the geometry
+ * at the lowest (highest) knot along s is the spline defined by the
+ * first (last) layer of control points along s.
+ */
+static std::vector<face> boundary_faces(BSplineGeometry const& geometry,
+		std::vector<std::vector<scalar_t>> const& breaks, 
+		std::vector<std::vector<size_t>> const& spans, size_t e)
+{
+	size_t k = geometry.get_n_kdims();
+	std::vector<size_t> elem(k), first(k), last(k);
+	face box;
+	for (size_t s = k, rest = e; s > 0; s--) {
+		elem[s - 1] = rest % spans[s - 1].size();
+		rest /= spans[s - 1].size();
+	}
+	for (size_t s = 0; s < k; s++) {
+		box.lo.push_back(breaks[s][elem[s]]);
+		box.hi.push_back(breaks[s][elem[s] + 1]);
+		last[s] = spans[s][elem[s]];
+		first[s] = last[s] - geometry.get_degree(s);
+	}
+
+	std::vector<face> faces;
+	if (k == 2) {
+		box.free[0] = 0;
+		box.free[1] = 1;
+		box.box = hull(geometry, first, last);
+		faces.push_back(box);
+		return faces;
+	}
+	for (size_t s = 0; s < 3; s++) {
+		face f = box;
+		f.free[0] = (s + 1) % 3;
+		f.free[1] = (s + 2) % 3;
+		if (elem[s] == 0) {
+			f.hi[s] = f.lo[s];
+			std::vector<size_t> layer = last;
+			layer[s] = 0;
+			std::vector<size_t> start = first;
+			start[s] = 0;
+			f.box = hull(geometry, start, layer);
+			faces.push_back(f);
+			f.hi[s] = box.hi[s];
+		}
+		if (elem[s] + 1 == spans[s].size()) {
+			f.lo[s] = f.hi[s];
+			std::vector<size_t> start = first;
+			start[s] = geometry.get_n_ctrl(s) - 1;
+			std::vector<size_t> layer = last;
+			layer[s] = start[s];
+			f.box = hull(geometry, start, layer);
+			faces.push_back(f);
+		}
+	}
+	return faces;
+}
+
+/*
+ * Newton's method for S(x) = o + t d on a face, starting from x.
+ * On success, x and t hold the solution.
+ */
+static bool newton(BSplineGeometry const& geometry, face const& f, 
+		ctrl_t const& o, ctrl_t const& d, knot_t& x, scalar_t& t, ctrl_t& y, ctrl_t& n)
+{
+	size_t k = geometry.get_n_kdims();
+	std::vector<std::vector<size_t>> orders(3, std::vector<size_t>(k, 0));
+	orders[1][f.free[0]] = 1;
+	orders[2][f.free[1]] = 1;
+
+	bool was_clamped = false;
+	for (int iter = 0; iter < 20; iter++) {
+		std::vector<ctrl_t> D = geometry.evaluate_derivatives(x, orders);
+		ctrl_t F(3);
+		for (size_t r = 0; r < 3; r++) {
+			F[r] = D[0][r] - o[r] - t * d[r];
+		}
+
+		/* Solve [S_a S_b -d] delta = -F by Cramer's rule */
+		ctrl_t const& a = D[1];
+		ctrl_t const& b = D[2];
+		auto det3 = [](ctrl_t const& c0, ctrl_t const& c1, ctrl_t const& c2) {
+			return c0[0] * (c1[1] * c2[2] - c1[2] * c2[1])
+				- c1[0] * (c0[1] * c2[2] - c0[2] * c2[1])
+				+ c2[0] * (c0[1] * c1[2] - c0[2] * c1[1]);
+		};
+		ctrl_t nd{-d[0], -d[1], -d[2]}, nF{-F[0], -F[1], -F[2]};
+		scalar_t det = det3(a, b, nd);
+		scalar_t residual = std::sqrt(F[0] * F[0] + F[1] * F[1] + F[2] * F[2]);
+		scalar_t size = std::sqrt(D[0][0] * D[0][0] + D[0][1] * D[0][1] + D[0][2] * D[0][2]) + 1;
+		if (residual < 1e-10 * size) {
+			for (size_t s = 0; s < 2; s++) {
+				size_t r = f.free[s];
+				if (x[r] < f.lo[r] - 1e-9 || x[r] > f.hi[r] + 1e-9) return false;
+			}
+			y = D[0];
+			n = {a[1] * b[2] - a[2] * b[1], a[2] * b[0] - a[0] * b[2], a[0] * b[1] - a[1] * b[0]};
+			return t > 0;
+		}
+		if (det == 0) return false;
+
+		x[f.free[0]] += det3(nF, b, nd) / det;
+		x[f.free[1]] += det3(a, nF, nd) / det;
+		t += det3(a, b, nF) / det;
+
+		/*
+		 * Stay near the face, allowing a margin for convergence to its
+		 * edge. An iterate pushed against the margin twice in a row is
+		 * heading for a solution elsewhere, so we give up on it.
+		 */
+		bool clamped = false;
+		for (size_t s = 0; s < 2; s++) {
+			size_t r = f.free[s];
+			scalar_t margin = 0.1 * (f.hi[r] - f.lo[r]);
+			scalar_t lo = std::max(f.lo[r] - margin, geometry.get_knot_vector(r).front());
+			scalar_t hi = std::min(f.hi[r] + margin, geometry.get_knot_vector(r).back());
+			if (x[r] < lo || x[r] > hi) clamped = true;
+			x[r] = std::min(std::max(x[r], lo), hi);
+		}
+		if (clamped && was_clamped) return false;
+		was_clamped = clamped;
+	}
+	return false;
+}
+
+std::vector<RayHit> intersect_rays(BSplineGeometry const& geometry, ElementBVH const& bvh,
+		std::vector<ctrl_t> const& origins, std::vector<ctrl_t> const& directions)
+{
+	size_t k = geometry.get_n_kdims();
+	if (geometry.get_n_cdims() != 3 || (k != 2 && k != 3)) {
+		error("ray intersection requires a surface or volume in three dimensions");
+	}
+	if (origins.size() != directions.size()) {
+		error("number of ray origins and directions do not match");
+	}
+	std::vector<std::vector<scalar_t>> breaks(k);
+	std::vector<std::vector<size_t>> spans(k);
+	for (size_t s = 0; s < k; s++) {
+		breaks[s] = geometry.get_breakpoints(s);
+		spans[s] = geometry.get_spans(s);
+	}
+
+	std::vector<RayHit> hits(origins.size());
+	parallel_for(geometry.get_n_threads(), origins.size(), [&](size_t, size_t i) {
+		ctrl_t const& o = origins[i];
+		ctrl_t const& d = directions[i];
+		RayHit& best = hits[i];
+		best.hit = false;
+		best.t = HUGE_VAL;
+
+		for (std::pair<scalar_t, size_t> const& candidate : bvh.intersect_ray(o, d)) {
+			if (candidate.first > best.t) break;
+			for (face const& f : boundary_faces(geometry, breaks, spans, candidate.second)) {
+				scalar_t t_in, t_out;
+				if (!f.box.clip_ray(o, d, t_in, t_out) || t_in > best.t) continue;
+
+				/* The center of the face first, then the centers of its quarters */
+				static const scalar_t seeds[5][2] = {
+					{0.5, 0.5}, {0.25, 0.25}, {0.75, 0.25}, {0.25, 0.75}, {0.75, 0.75}
+				};
+				for (scalar_t const* w : seeds) {
+					knot_t x = f.lo;
+					size_t a = f.free[0], b = f.free[1];
+					x[a] = f.lo[a] + w[0] * (f.hi[a] - f.lo[a]);
+					x[b] = f.lo[b] + w[1] * (f.hi[b] - f.lo[b]);
+					scalar_t t = 0.5 * (t_in + t_out);
+					ctrl_t y, n;
+					/* Every seed is tried: on a curved face a later one may find a nearer root */
+					if (newton(geometry, f, o, d, x, t, y, n) && t < best.t) {
+						best = RayHit{true, t, x, y, n, candidate.second};
+					}
+				}
+			}
+		}
+
+		if (best.hit) {
+			/* Unit normal facing the ray origin */
+			ctrl_t& n = best.normal;
+			scalar_t len = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+			scalar_t sign = (n[0] * d[0] + n[1] * d[1] + n[2] * d[2]) > 0 ? -1 : 1;
+			for (scalar_t& v : n) {
+				v = len > 0 ? sign * v / len : 0;
+			}
+		}
+	});
+	return hits;
+}
+
+std::vector<unsigned char> render_preview(BSplineGeometry const& geometry, ElementBVH const& bvh,
+		size_t width, size_t height)
+{
+	/* Orthographic camera along (-1, -1, -1), framing the bounding box */
+	AABB const& box = bvh.extent();
+	ctrl_t center(3);
+	scalar_t radius = 0;
+	for (size_t r = 0; r < 3; r++) {
+		center[r] = 0.5 * (box.lo[r] + box.hi[r]);
+		radius += (box.hi[r] - box.lo[r]) * (box.hi[r] - box.lo[r]);
+	}
+	radius = 0.5 * std::sqrt(radius);
+	if (radius == 0) radius = 1;
+
+	scalar_t c = 1 / std::sqrt(3.0);
+	ctrl_t view{-c, -c, -c};
+	ctrl_t right{std::sqrt(0.5), -std::sqrt(0.5), 0};
+	ctrl_t up{view[1] * right[2] - view[2] * right[1],
+		view[2] * right[0] - view[0] * right[2],
+		view[0] * right[1] - view[1] * right[0]};
+
+	scalar_t aspect = scalar_t(width) / height;
+	std::vector<ctrl_t> origins, directions;
+	for (size_t py = 0; py < height; py++) {
+		for (size_t px = 0; px < width; px++) {
+			scalar_t sx = ((px + 0.5) / width * 2 - 1) * radius * std::max<scalar_t>(aspect, 1);
+			scalar_t sy = (1 - (py + 0.5) / height * 2) * radius / std::min<scalar_t>(aspect, 1);
+			ctrl_t o(3);
+			for (size_t r = 0; r < 3; r++) {
+				o[r] = center[r] - 2 * radius * view[r] + sx * right[r] + sy * up[r];
+			}
+			origins.push_back(o);
+			directions.push_back(view);
+		}
+	}
+
+	std::vector<RayHit> hits = intersect_rays(geometry, bvh, origins, directions);
+	std::vector<unsigned char> rgb(3 * width * height, 255);
+	for (size_t i = 0; i < hits.size(); i++) {
+		if (!hits[i].hit) continue;
+		/* Lambertian shading with a headlight */
+		ctrl_t const& n = hits[i].normal;
+		scalar_t shade = 0.2 + 0.8 * std::fabs(n[0] * view[0] + n[1] * view[1] + n[2] * view[2]);
+		rgb[3 * i] = static_cast<unsigned char>(70 * shade);
+		rgb[3 * i + 1] = static_cast<unsigned char>(130 * shade);
+		rgb[3 * i + 2] = static_cast<unsigned char>(220 * shade);
+	}
+	return rgb;
+}
+
+bool write_ppm(std::string const& filename, size_t width, size_t height,
+		std::vector<unsigned char> const& rgb)
+{
+	std::ofstream file(filename, std::ios::binary);
+	if (!file.is_open()) {
+		return false;
+	}
+	file << "P6\n" << width << " " << height << "\n255\n";
+	file.write(reinterpret_cast<char const*>(rgb.data()), rgb.size());
+	return file.good();
+}
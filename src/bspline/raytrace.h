@@ -0,0 +1,54 @@
+#ifndef BSPLINE_RAYTRACE_H
+#define BSPLINE_RAYTRACE_H
+
+#include "bvh.h"
+#include "geometry.h"
+#include <cstddef>
+#include <string>
+#include <vector>
+
+/* The first intersection of a ray with a geometry */
+struct RayHit {
+	bool hit;
+	/* Ray parameter, parametric and physical point of the hit */
+	scalar_t t;
+	knot_t x;
+	ctrl_t y;
+	/* Unit surface normal at the hit, facing the ray origin */
+	ctrl_t normal;
+	/* The element hit (numbered as in ElementBVH) */
+	size_t element;
+};
+
+/*
+ * Intersect rays origins[i] + t * directions[i], t > 0, with a
+ * geometry in three dimensional space (n_cdims = 3): a surface
+ * (n_kdims = 2) or the boundary of a volume (n_kdims = 3).
+ *
+ * For each ray, the BVH yields the elements whose boxes it crosses,
+ * nearest first. Each element is a single Bezier patch; on each of
+ * its faces that lie on the boundary of the geometry, Newton's method
+ * solves S(x) = origin + t * direction from five starting points
+ * (the center of the face and the centers of its quarters), keeping
+ * the nearest solution inside the face. Elements whose boxes start
+ * beyond the nearest hit found so far are skipped.
+ *
+ * Rays are processed in parallel with geometry.get_n_threads() threads.
+ */
+std::vector<RayHit> intersect_rays(BSplineGeometry const& geometry, ElementBVH const& bvh,
+		std::vector<ctrl_t> const& origins, std::vector<ctrl_t> const& directions);
+
+/*
+ * Render a shaded preview of the geometry by casting one ray per
+ * pixel from a camera looking at the center of the geometry along
+ * the direction (-1, -1, -1). The result holds width * height RGB
+ * triples, row by row from the top.
+ */
+std::vector<unsigned char> render_preview(BSplineGeometry const& geometry, ElementBVH const& bvh,
+		size_t width, size_t height);
+
+/* Write an RGB image as a binary PPM file. Returns false on failure. */
+bool write_ppm(std::string const& filename, size_t width, size_t height,
+		std::vector<unsigned char> const& rgb);
+
+#endif
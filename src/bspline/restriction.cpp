@@ -0,0 +1,247 @@
+#include "restriction.h"
+#include "parallel.h"
+#include <cstddef>
+#include <map>
+#include <vector>
+
+/* The unpadded knots of dimension s, as passed to the constructor */
+static std::vector<scalar_t> unpadded_knots(BSplineGeometry const& g, size_t s)
+{
+	std::vector<scalar_t> const& t = g.get_knot_vector(s);
+	size_t p = g.get_degree(s);
+	return std::vector<scalar_t>(t.begin() + p, t.end() - p);
+}
+
+BSplineGeometry restrict_dimension(BSplineGeometry const& geometry, size_t s, scalar_t u)
+{
+	size_t k = geometry.get_n_kdims(), n_cdims = geometry.get_n_cdims();
+	if (k < 2) {
+		error("cannot restrict a spline with one parametric dimension");
+	}
+	if (s >= k) {
+		error("restricted dimension out of range");
+	}
+
+	std::vector<std::vector<scalar_t>> ders;
+	size_t p = geometry.get_degree(s);
+	size_t span = geometry.find_span(s, u);
+	geometry.basis_derivatives(s, span, u, 0, ders);
+
+	/* Control points before, along and after dimension s */
+	size_t outer = 1, inner = 1, n = geometry.get_n_ctrl(s);
+	for (size_t r = 0; r < s; r++) outer *= geometry.get_n_ctrl(r);
+	for (size_t r = s + 1; r < k; r++) inner *= geometry.get_n_ctrl(r);
+
+	std::vector<ctrl_t> ctrl(outer * inner, ctrl_t(n_cdims, 0));
+	for (size_t o = 0; o < outer; o++) {
+		for (size_t q = 0; q <= p; q++) {
+			scalar_t N = ders[0][q];
+			size_t i = span - p + q;
+			for (size_t j = 0; j < inner; j++) {
+				scalar_t const* from = geometry.get_control_point((o * n + i) * inner + j);
+				ctrl_t& to = ctrl[o * inner + j];
+				for (size_t c = 0; c < n_cdims; c++) {
+					to[c] += N * from[c];
+				}
+			}
+		}
+	}
+
+	std::vector<size_t> degrees;
+	std::vector<std::vector<scalar_t>> knots;
+	for (size_t r = 0; r < k; r++) {
+		if (r == s) continue;
+		degrees.push_back(geometry.get_degree(r));
+		knots.push_back(unpadded_knots(geometry, r));
+	}
+	return BSplineGeometry(k - 1, n_cdims, degrees, knots, ctrl, geometry.get_n_threads());
+}
+
+BSplineGeometry isoparametric_curve(BSplineGeometry const& geometry, size_t s, knot_t const& x)
+{
+	size_t k = geometry.get_n_kdims(), n_cdims = geometry.get_n_cdims();
+	if (s >= k) {
+		error("curve dimension out of range");
+	}
+	if (x.size() != k) {
+		error("parametric point has incorrect dimension");
+	}
+
+	/* Basis functions of the fixed dimensions at x */
+	std::vector<std::vector<std::vector<scalar_t>>> ders(k);
+	std::vector<size_t> first(k, 0), count(k, 1);
+	for (size_t r = 0; r < k; r++) {
+		if (r == s) continue;
+		size_t span = geometry.find_span(r, x[r]);
+		geometry.basis_derivatives(r, span, x[r], 0, ders[r]);
+		first[r] = span - geometry.get_degree(r);
+		count[r] = geometry.get_degree(r) + 1;
+	}
+
+	size_t n = geometry.get_n_ctrl(s);
+	std::vector<ctrl_t> ctrl(n, ctrl_t(n_cdims, 0));
+	std::vector<size_t> q(k, 0);
+	while (true) {
+		scalar_t N = 1;
+		for (size_t r = 0; r < k; r++) {
+			if (r != s) N *= ders[r][0][q[r]];
+		}
+		for (size_t i = 0; i < n; i++) {
+			size_t I = 0;
+			for (size_t r = 0; r < k; r++) {
+				I = (r == s ? i : first[r] + q[r]) + geometry.get_n_ctrl(r) * I;
+			}
+			for (size_t c = 0; c < n_cdims; c++) {
+				ctrl[i][c] += N * geometry.get_control_point(I)[c];
+			}
+		}
+		size_t r = k;
+		for (; r > 0; r--) {
+			if (++q[r - 1] < count[r - 1]) break;
+			q[r - 1] = 0;
+		}
+		if (r == 0) break;
+	}
+
+	return BSplineGeometry(1, n_cdims, {geometry.get_degree(s)}, {unpadded_knots(geometry, s)}, ctrl);
+}
+
+TessellationMesh wireframe(BSplineGeometry const& geometry, size_t n_per_span)
+{
+	size_t k = geometry.get_n_kdims();
+	TessellationMesh mesh;
+	mesh.n_kdims = 1;
+
+	std::vector<std::vector<scalar_t>> breakpoints(k);
+	for (size_t s = 0; s < k; s++) {
+		breakpoints[s] = geometry.get_breakpoints(s);
+		mesh.samples.push_back(uniform_samples(geometry, s, n_per_span));
+	}
+
+	/* The curves: a dimension and a point fixing the other coordinates */
+	std::vector<size_t> dims;
+	std::vector<knot_t> through;
+	for (size_t s = 0; s < k; s++) {
+		std::vector<size_t> b(k, 0);
+		while (true) {
+			knot_t x(k);
+			for (size_t r = 0; r < k; r++) {
+				x[r] = r == s ? 0 : breakpoints[r][b[r]];
+			}
+			dims.push_back(s);
+			through.push_back(x);
+			size_t r = k;
+			for (; r > 0; r--) {
+				if (r - 1 == s) continue;
+				if (++b[r - 1] < breakpoints[r - 1].size()) break;
+				b[r - 1] = 0;
+			}
+			if (r == 0) break;
+		}
+	}
+
+	/* Each curve's vertices start after those of the previous curves */
+	std::vector<size_t> offset(dims.size() + 1, 0);
+	for (size_t c = 0; c < dims.size(); c++) {
+		offset[c + 1] = offset[c] + mesh.samples[dims[c]].size();
+	}
+	mesh.params.resize(offset.back());
+	mesh.points.resize(offset.back());
+
+	parallel_for(geometry.get_n_threads(), dims.size(), [&](size_t, size_t c) {
+		BSplineGeometry curve = isoparametric_curve(geometry, dims[c], through[c]);
+		std::vector<scalar_t> const& u = mesh.samples[dims[c]];
+		for (size_t i = 0; i < u.size(); i++) {
+			knot_t x = through[c];
+			x[dims[c]] = u[i];
+			mesh.params[offset[c] + i] = x;
+			mesh.points[offset[c] + i] = curve.evaluate(knot_t{u[i]});
+		}
+	});
+
+	for (size_t c = 0; c < dims.size(); c++) {
+		for (size_t i = offset[c]; i + 1 < offset[c + 1]; i++) {
+			mesh.cells.push_back({i, i + 1});
+		}
+	}
+	return mesh;
+}
+
+TessellationMesh boundary_tessellate(BSplineGeometry const& geometry,
+		std::vector<std::vector<scalar_t>> const& samples)
+{
+	if (geometry.get_n_kdims() != 3) {
+		error("boundary sampling requires a trivariate spline");
+	}
+	if (samples.size() != 3) {
+		error("incorrect number of sample axes");
+	}
+	std::vector<size_t> n(3);
+	for (size_t s = 0; s < 3; s++) {
+		n[s] = samples[s].size();
+		if (n[s] < 2) {
+			error("too few samples to form boundary cells");
+		}
+	}
+
+	TessellationMesh mesh;
+	mesh.n_kdims = 2;
+	mesh.samples = samples;
+
+	/*
+	 * Number the boundary vertices face by face; a vertex already
+	 * numbered by an earlier face (on a shared edge) keeps its number
+	 * and is evaluated on that face.
+	 */
+	std::vector<BSplineGeometry> faces;
+	std::map<size_t, size_t> numbered;
+	std::vector<size_t> face_of;
+	std::vector<knot_t> face_params;
+	for (size_t s = 0; s < 3; s++) {
+		size_t a = s == 0 ? 1 : 0, b = s == 2 ? 1 : 2;
+		for (size_t side = 0; side < 2; side++) {
+			size_t f = faces.size();
+			size_t fixed = side == 0 ? 0 : n[s] - 1;
+			faces.push_back(restrict_dimension(geometry, s, samples[s][fixed]));
+
+			std::vector<size_t> ids(n[a] * n[b]);
+			std::vector<size_t> pos(3);
+			pos[s] = fixed;
+			for (size_t i = 0; i < n[a]; i++) {
+				for (size_t j = 0; j < n[b]; j++) {
+					pos[a] = i;
+					pos[b] = j;
+					size_t I = (pos[0] * n[1] + pos[1]) * n[2] + pos[2];
+					auto found = numbered.find(I);
+					if (found == numbered.end()) {
+						found = numbered.emplace(I, mesh.params.size()).first;
+						mesh.params.push_back({samples[0][pos[0]], samples[1][pos[1]], samples[2][pos[2]]});
+						face_of.push_back(f);
+						face_params.push_back({samples[a][i], samples[b][j]});
+					}
+					ids[i * n[b] + j] = found->second;
+				}
+			}
+
+			/* d_a x d_b is an outward normal on the upper faces of dimensions 0 and 2 */
+			bool flip = (side == 0) != (s % 2 == 1);
+			for (size_t i = 0; i + 1 < n[a]; i++) {
+				for (size_t j = 0; j + 1 < n[b]; j++) {
+					size_t v00 = ids[i * n[b] + j], v10 = ids[(i + 1) * n[b] + j];
+					size_t v11 = ids[(i + 1) * n[b] + j + 1], v01 = ids[i * n[b] + j + 1];
+					if (flip) {
+						mesh.cells.push_back({v00, v01, v11, v10});
+					} else {
+						mesh.cells.push_back({v00, v10, v11, v01});
+					}
+				}
+			}
+		}
+	}
+
+	mesh.points.resize(mesh.params.size());
+	parallel_for(geometry.get_n_threads(), mesh.points.size(), [&](size_t tid, size_t v) {
+		mesh.points[v] = faces[face_of[v]].evaluate(face_params[v], tid);
+	});
+	return mesh;
+}
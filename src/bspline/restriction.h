@@ -0,0 +1,55 @@
+#ifndef BSPLINE_RESTRICTION_H
+#define BSPLINE_RESTRICTION_H
+
+#include "geometry.h"
+#include "tessellation.h"
+#include <cstddef>
+#include <vector>
+
+/*
+ * The spline with parametric coordinate s fixed to u: a spline
+ * with n_kdims - 1 parametric dimensions (the others, in order),
+ * the same degrees and knots in those, and control points
+ * sum_i N_i(u) P_i along dimension s. Requires n_kdims >= 2.
+ */
+BSplineGeometry restrict_dimension(BSplineGeometry const& geometry, size_t s, scalar_t u);
+
+/*
+ * The isoparametric curve along dimension s through x (x[s] is
+ * ignored): a spline of one parametric dimension with the degree
+ * and knots of dimension s, whose control polygon is computed once
+ * from the (p + 1)^(k - 1) control points around x. Evaluating the
+ * curve then costs one univariate evaluation per point.
+ */
+BSplineGeometry isoparametric_curve(BSplineGeometry const& geometry, size_t s, knot_t const& x);
+
+/*
+ * The element edges of the geometry as a line mesh: the
+ * isoparametric curves along every dimension through all
+ * combinations of breakpoints of the other dimensions, each
+ * sampled with n_per_span segments per element. Curves are
+ * extracted and sampled in parallel with the geometry's threads.
+ * Vertices where curves cross are repeated for each curve.
+ */
+TessellationMesh wireframe(BSplineGeometry const& geometry, size_t n_per_span);
+
+/*
+ * Sample only the boundary of a trivariate geometry, on the
+ * tensor product of the given per-axis parameter values (whose
+ * first and last entries give the faces).
+ *
+ * Each of the six faces is reduced to a bivariate spline with
+ * restrict_dimension() and sampled on its grid, so the work is
+ * proportional to the number of boundary samples rather than to
+ * the whole grid. Vertices on edges and corners are shared by the
+ * faces meeting there, and are evaluated once, in parallel with
+ * the geometry's threads. The result is a quadrilateral surface
+ * mesh (n_kdims = 2) whose params hold the full parametric
+ * coordinates of each vertex. The quads of each face are ordered
+ * so that their normals point out of the volume when the Jacobian
+ * determinant is positive.
+ */
+TessellationMesh boundary_tessellate(BSplineGeometry const& geometry,
+		std::vector<std::vector<scalar_t>> const& samples);
+
+#endif
@@ -0,0 +1,774 @@
+#include "tessellation.h"
+#include "parallel.h"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <map>
+#include <vector>
+
+/*
+ * Euclidean distance between the physical point y and the
+ * linear interpolation (1 - w) * a + w * b.
+ */
+static scalar_t chord_distance(ctrl_t const& y, ctrl_t const& a, ctrl_t const& b, scalar_t w)
+{
+	scalar_t d2 = 0;
+	for (size_t r = 0; r < y.size(); r++) {
+		scalar_t d = y[r] - ((1 - w) * a[r] + w * b[r]);
+		d2 += d * d;
+	}
+	return std::sqrt(d2);
+}
+
+std::vector<scalar_t> uniform_samples(BSplineGeometry const& geometry, size_t s, size_t n_per_span)
+{
+	if (n_per_span == 0) {
+		error("at least one segment per span is needed");
+	}
+	std::vector<scalar_t> breaks = geometry.get_breakpoints(s);
+	std::vector<scalar_t> samples{breaks.front()};
+	for (size_t e = 0; e + 1 < breaks.size(); e++) {
+		scalar_t h = (breaks[e + 1] - breaks[e]) / n_per_span;
+		for (size_t j = 1; j < n_per_span; j++) {
+			samples.push_back(breaks[e] + j * h);
+		}
+		samples.push_back(breaks[e + 1]);
+	}
+	return samples;
+}
+
+typedef std::array<scalar_t, 3> vec3;
+
+static vec3 sub(vec3 const& a, vec3 const& b)
+{
+	return {a[0] - b[0], a[1] - b[1], a[2] - b[2]};
+}
+
+static vec3 cross(vec3 const& a, vec3 const& b)
+{
+	return {a[1] * b[2] - a[2] * b[1], a[2] * b[0] - a[0] * b[2], a[0] * b[1] - a[1] * b[0]};
+}
+
+static scalar_t dot(vec3 const& a, vec3 const& b)
+{
+	return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+static scalar_t norm(vec3 const& a)
+{
+	return std::sqrt(dot(a, a));
+}
+
+CellQuality cell_quality(std::vector<ctrl_t> const& vertices)
+{
+	size_t n = vertices.size();
+	std::vector<vec3> p(n, vec3{0, 0, 0});
+	for (size_t i = 0; i < n; i++) {
+		for (size_t r = 0; r < vertices[i].size() && r < 3; r++) {
+			p[i][r] = vertices[i][r];
+		}
+	}
+
+	CellQuality q;
+	if (n == 2) {
+		scalar_t len = norm(sub(p[1], p[0]));
+		q = {1, 1, len, len};
+		return q;
+	}
+
+	/*
+	 * Edges leaving each corner, in right-handed order
+	 * (Verdict's convention for VTK hexahedra and quads).
+	 */
+	static const size_t hex_edges[8][3] = {
+		{1, 3, 4}, {2, 0, 5}, {3, 1, 6}, {0, 2, 7},
+		{7, 5, 0}, {4, 6, 1}, {5, 7, 2}, {6, 4, 3}
+	};
+	static const size_t quad_edges[4][2] = {{1, 3}, {2, 0}, {3, 1}, {0, 2}};
+
+	/* Reference normal of a quadrilateral, for the sign of its corner Jacobians */
+	vec3 normal{0, 0, 0};
+	if (n == 4) {
+		for (size_t c = 0; c < 4; c++) {
+			vec3 a = cross(sub(p[quad_edges[c][0]], p[c]), sub(p[quad_edges[c][1]], p[c]));
+			for (size_t r = 0; r < 3; r++) normal[r] += a[r];
+		}
+		scalar_t len = norm(normal);
+		if (len > 0) {
+			for (size_t r = 0; r < 3; r++) normal[r] /= len;
+		}
+	}
+
+	q.scaled_jacobian = 1;
+	q.min_jacobian = HUGE_VAL;
+	q.max_jacobian = -HUGE_VAL;
+	scalar_t min_edge = HUGE_VAL, max_edge = 0;
+	for (size_t c = 0; c < n; c++) {
+		scalar_t jac, lengths;
+		if (n == 8) {
+			vec3 e1 = sub(p[hex_edges[c][0]], p[c]);
+			vec3 e2 = sub(p[hex_edges[c][1]], p[c]);
+			vec3 e3 = sub(p[hex_edges[c][2]], p[c]);
+			jac = dot(e1, cross(e2, e3));
+			lengths = norm(e1) * norm(e2) * norm(e3);
+			for (vec3 const& e : {e1, e2, e3}) {
+				min_edge = std::min(min_edge, norm(e));
+				max_edge = std::max(max_edge, norm(e));
+			}
+		}
+		else {
+			vec3 e1 = sub(p[quad_edges[c][0]], p[c]);
+			vec3 e2 = sub(p[quad_edges[c][1]], p[c]);
+			jac = dot(cross(e1, e2), normal);
+			lengths = norm(e1) * norm(e2);
+			min_edge = std::min(min_edge, norm(e1));
+			max_edge = std::max(max_edge, norm(e1));
+		}
+		q.min_jacobian = std::min(q.min_jacobian, jac);
+		q.max_jacobian = std::max(q.max_jacobian, jac);
+		scalar_t scaled = lengths > 0 ? jac / lengths : 0;
+		q.scaled_jacobian = std::min(q.scaled_jacobian, scaled);
+	}
+	q.edge_ratio = min_edge > 0 ? max_edge / min_edge : HUGE_VAL;
+	return q;
+}
+
+TessellationMesh tessellate(BSplineGeometry& geometry,
+		std::vector<std::vector<scalar_t>> const& samples, bool with_quality)
+{
+	JobStatus status;
+	return tessellate(geometry, samples, with_quality, CancellationToken(), status);
+}
+
+TessellationMesh tessellate(BSplineGeometry& geometry,
+		std::vector<std::vector<scalar_t>> const& samples, bool with_quality,
+		CancellationToken const& token, JobStatus& status)
+{
+	size_t n_kdims = geometry.get_n_kdims();
+	if (n_kdims < 1 || n_kdims > 3) {
+		error("only 1, 2 and 3 dimensional geometries can be tessellated");
+	}
+	if (samples.size() != n_kdims) {
+		error("incorrect number of sample vectors provided");
+	}
+	for (std::vector<scalar_t> const& u : samples) {
+		if (u.size() < 2) {
+			error("at least two samples are needed along each axis");
+		}
+	}
+
+	TessellationMesh mesh;
+	mesh.n_kdims = n_kdims;
+	mesh.samples = samples;
+
+	/* Vertices, last axis fastest */
+	std::vector<size_t> pos(n_kdims, 0);
+	while (true) {
+		knot_t x(n_kdims);
+		for (size_t r = 0; r < n_kdims; r++) {
+			x[r] = samples[r][pos[r]];
+		}
+		mesh.params.push_back(x);
+
+		size_t r = n_kdims;
+		while (r > 0) {
+			r--;
+			if (++pos[r] < samples[r].size()) break;
+			pos[r] = 0;
+		}
+		if (r == 0 && pos[0] == 0) break;
+	}
+	mesh.points.resize(mesh.params.size());
+
+	/* Whole layers along axis 0 per chunk, about 4096 vertices */
+	size_t n0 = samples[0].size();
+	size_t n1 = n_kdims > 1 ? samples[1].size() : 1;
+	size_t n2 = n_kdims > 2 ? samples[2].size() : 1;
+	size_t layer = n1 * n2;
+	size_t layers_per_chunk = std::max<size_t>(1, 4096 / layer);
+	size_t n_chunks = (n0 + layers_per_chunk - 1) / layers_per_chunk;
+	size_t completed = chunked_for(geometry.get_n_threads(), n_chunks, token, [&](size_t tid, size_t c) {
+		size_t end = std::min(n0, (c + 1) * layers_per_chunk) * layer;
+		for (size_t i = c * layers_per_chunk * layer; i < end; i++) {
+			mesh.points[i] = geometry.evaluate(mesh.params[i], tid);
+		}
+	});
+	status = JOB_COMPLETED;
+	if (completed < n_chunks) {
+		status = token.stop_reason();
+		n0 = completed * layers_per_chunk;
+		mesh.samples[0].resize(n0);
+		mesh.params.resize(n0 * layer);
+		mesh.points.resize(n0 * layer);
+	}
+
+	/* Cells */
+	auto index = [&](size_t i, size_t j, size_t k) {
+		return (i * n1 + j) * n2 + k;
+	};
+	for (size_t i = 0; i + 1 < n0; i++) {
+		if (n_kdims == 1) {
+			mesh.cells.push_back({i, i + 1});
+			continue;
+		}
+		for (size_t j = 0; j + 1 < n1; j++) {
+			if (n_kdims == 2) {
+				mesh.cells.push_back({index(i, j, 0), index(i + 1, j, 0),
+						index(i + 1, j + 1, 0), index(i, j + 1, 0)});
+				continue;
+			}
+			for (size_t k = 0; k + 1 < n2; k++) {
+				mesh.cells.push_back({
+						index(i, j, k), index(i + 1, j, k),
+						index(i + 1, j + 1, k), index(i, j + 1, k),
+						index(i, j, k + 1), index(i + 1, j, k + 1),
+						index(i + 1, j + 1, k + 1), index(i, j + 1, k + 1)});
+			}
+		}
+	}
+
+	if (with_quality && status == JOB_COMPLETED) {
+		mesh.quality.resize(mesh.cells.size());
+		size_t cells_per_chunk = 4096;
+		n_chunks = (mesh.cells.size() + cells_per_chunk - 1) / cells_per_chunk;
+		completed = chunked_for(geometry.get_n_threads(), n_chunks, token, [&](size_t, size_t c) {
+			size_t end = std::min(mesh.cells.size(), (c + 1) * cells_per_chunk);
+			for (size_t i = c * cells_per_chunk; i < end; i++) {
+				std::vector<ctrl_t> vertices;
+				for (size_t v : mesh.cells[i]) {
+					vertices.push_back(mesh.points[v]);
+				}
+				mesh.quality[i] = cell_quality(vertices);
+			}
+		});
+		if (completed < n_chunks) {
+			status = token.stop_reason();
+			mesh.quality.clear();
+		}
+	}
+	return mesh;
+}
+
+/*
+ * The parameter at m / full of the way from lo to hi, with both
+ * ends exact so that neighboring elements agree on their breakpoint.
+ */
+static scalar_t dyadic_param(scalar_t lo, scalar_t hi, size_t m, size_t full)
+{
+	if (m == 0) return lo;
+	if (m == full) return hi;
+	return lo + (hi - lo) * (scalar_t(m) / full);
+}
+
+/* The parametric box lo <= x <= hi of element e, given the breakpoints */
+static void element_domain(std::vector<std::vector<scalar_t>> const& breaks, size_t e,
+		std::vector<size_t>& elem, knot_t& lo, knot_t& hi)
+{
+	size_t k = breaks.size();
+	elem.resize(k);
+	lo.resize(k);
+	hi.resize(k);
+	for (size_t s = k, rest = e; s > 0; s--) {
+		size_t n_elem = breaks[s - 1].size() - 1;
+		elem[s - 1] = rest % n_elem;
+		rest /= n_elem;
+		lo[s - 1] = breaks[s - 1][elem[s - 1]];
+		hi[s - 1] = breaks[s - 1][elem[s - 1] + 1];
+	}
+}
+
+/*
+ * Call body(pos) for every pos with 0 <= pos[s] < n[s] (n has at
+ * most three entries), the last axis fastest, until body returns
+ * false. Returns whether all calls returned true.
+ */
+template <typename Body>
+static bool for_each_index(std::vector<size_t> const& n, Body body)
+{
+	std::array<size_t, 3> pos{0, 0, 0};
+	size_t k = n.size();
+	while (true) {
+		if (!body(pos)) return false;
+		size_t r = k;
+		while (r > 0) {
+			r--;
+			if (++pos[r] < n[r]) break;
+			pos[r] = 0;
+		}
+		if (r == 0 && pos[0] == 0) return true;
+	}
+}
+
+/*
+ * The number of bisections along each axis of one element, refined
+ * until the chordal deviation is within tolerance.
+ *
+ * Chordal deviation shrinks by about 4 per bisection, so an axis
+ * whose deviation exceeds tolerance by a factor f is bisected
+ * floor(log4(f)) times at once (at least once), and then checked
+ * again, if its segments or lines have changed. The lines the
+ * deviation is measured on run through the vertices and cell
+ * midpoints of the other axes, but through at most
+ * 2^transverse_level + 1 positions along each of them.
+ */
+static std::vector<size_t> element_levels(BSplineGeometry& geometry, knot_t const& lo, knot_t const& hi,
+		scalar_t tolerance, size_t max_level, size_t tid)
+{
+	const size_t transverse_level = 3;
+	size_t k = lo.size();
+	size_t full = size_t(1) << (max_level + 2);
+	knot_t x(k);
+	auto at = [&](std::array<size_t, 3> const& u) {
+		for (size_t s = 0; s < k; s++) {
+			x[s] = dyadic_param(lo[s], hi[s], u[s], full);
+		}
+		return geometry.evaluate(x, tid);
+	};
+
+	/* The largest deviation along axis s, at 1/4, 1/2 and 3/4 of each segment */
+	std::vector<size_t> level(k, 0);
+	auto deviation_along = [&](size_t s) {
+		std::vector<size_t> n(k, 1), step(k, 0);
+		for (size_t r = 0; r < k; r++) {
+			if (r == s) continue;
+			size_t l = std::min(level[r] + 1, transverse_level);
+			step[r] = full >> l;
+			n[r] = (size_t(1) << l) + 1;
+		}
+		size_t segments = size_t(1) << level[s], h = full >> level[s];
+		scalar_t deviation = 0;
+		for_each_index(n, [&](std::array<size_t, 3> const& pos) {
+			std::array<size_t, 3> u{0, 0, 0};
+			for (size_t r = 0; r < k; r++) {
+				u[r] = pos[r] * step[r];
+			}
+			ctrl_t a = at(u);
+			for (size_t j = 0; j < segments; j++) {
+				u[s] = (j + 1) * h;
+				ctrl_t b = at(u);
+				for (size_t q = 1; q < 4; q++) {
+					u[s] = j * h + q * h / 4;
+					deviation = std::max(deviation, chord_distance(at(u), a, b, q * 0.25));
+				}
+				a.swap(b);
+			}
+			return true;
+		});
+		return deviation;
+	};
+
+	/* An axis is checked again only if its lines or segments have changed */
+	std::vector<bool> check(k, true);
+	while (true) {
+		std::vector<size_t> more(k, 0);
+		bool refined = false;
+		for (size_t s = 0; s < k; s++) {
+			if (level[s] == max_level || !check[s]) continue;
+			scalar_t deviation = deviation_along(s);
+			for (scalar_t excess = deviation / tolerance; excess > 1; excess /= 4) {
+				if (more[s] > 0 && excess < 4) break;
+				more[s]++;
+			}
+			refined = refined || more[s] > 0;
+		}
+		if (!refined) break;
+		std::vector<size_t> old = level;
+		for (size_t s = 0; s < k; s++) {
+			level[s] = std::min(max_level, level[s] + more[s]);
+		}
+		for (size_t s = 0; s < k; s++) {
+			check[s] = level[s] != old[s];
+			for (size_t r = 0; r < k; r++) {
+				if (r != s && std::min(level[r] + 1, transverse_level) != std::min(old[r] + 1, transverse_level)) {
+					check[s] = true;
+				}
+			}
+		}
+	}
+	return level;
+}
+
+TessellationMesh adaptive_tessellate(BSplineGeometry& geometry,
+		scalar_t tolerance, size_t max_level, bool with_quality)
+{
+	JobStatus status;
+	return adaptive_tessellate(geometry, tolerance, max_level, with_quality, CancellationToken(), status);
+}
+
+TessellationMesh adaptive_tessellate(BSplineGeometry& geometry,
+		scalar_t tolerance, size_t max_level, bool with_quality,
+		CancellationToken const& token, JobStatus& status)
+{
+	size_t k = geometry.get_n_kdims();
+	if (k < 1 || k > 3) {
+		error("only 1, 2 and 3 dimensional geometries can be tessellated");
+	}
+	if (!(tolerance > 0)) {
+		error("chordal tolerance must be positive");
+	}
+	if (max_level > 30) {
+		error("at most 30 levels of refinement are supported");
+	}
+
+	std::vector<std::vector<scalar_t>> breaks(k);
+	size_t total_elem = 1;
+	for (size_t s = 0; s < k; s++) {
+		breaks[s] = geometry.get_breakpoints(s);
+		total_elem *= breaks[s].size() - 1;
+	}
+
+	/* One element per chunk; after a stop, keep the leading completed elements */
+	std::vector<std::vector<size_t>> levels(total_elem);
+	size_t n_done = chunked_for(geometry.get_n_threads(), total_elem, token, [&](size_t tid, size_t e) {
+		std::vector<size_t> elem;
+		knot_t lo, hi;
+		element_domain(breaks, e, elem, lo, hi);
+		levels[e] = element_levels(geometry, lo, hi, tolerance, max_level, tid);
+	});
+	status = n_done < total_elem ? token.stop_reason() : JOB_COMPLETED;
+
+	/* Once stopped, the completed elements are meshed without further checks */
+	CancellationToken unstoppable;
+	CancellationToken const& checked = status == JOB_COMPLETED ? token : unstoppable;
+
+	/*
+	 * 2:1 balance: refine until the levels of face neighbors differ
+	 * by at most one along every axis.
+	 */
+	std::vector<size_t> n_elem(k), stride(k, 1);
+	for (size_t s = k; s > 0; s--) {
+		n_elem[s - 1] = breaks[s - 1].size() - 1;
+		if (s < k) stride[s - 1] = stride[s] * n_elem[s];
+	}
+	std::vector<size_t> pending(n_done);
+	std::vector<bool> is_pending(n_done, true);
+	for (size_t e = 0; e < n_done; e++) {
+		pending[e] = n_done - 1 - e;
+	}
+	while (!pending.empty()) {
+		size_t e = pending.back();
+		pending.pop_back();
+		is_pending[e] = false;
+		for (size_t s = 0; s < k; s++) {
+			size_t i = e / stride[s] % n_elem[s];
+			for (size_t j : {i - 1, i + 1}) {
+				if (j >= n_elem[s]) continue;
+				size_t f = e + j * stride[s] - i * stride[s];
+				if (f >= n_done) continue;
+				bool raised = false;
+				for (size_t r = 0; r < k; r++) {
+					if (levels[e][r] > levels[f][r] + 1) {
+						levels[f][r] = levels[e][r] - 1;
+						raised = true;
+					}
+				}
+				if (raised && !is_pending[f]) {
+					pending.push_back(f);
+					is_pending[f] = true;
+				}
+			}
+		}
+	}
+
+	/*
+	 * Vertices in element order, shared between elements by their
+	 * global position in units of 1 / 2^max_level of an element.
+	 */
+	TessellationMesh mesh;
+	mesh.n_kdims = k;
+	size_t full = size_t(1) << max_level;
+	std::map<std::array<size_t, 3>, size_t> vertex;
+	std::vector<std::array<size_t, 3>> keys;
+	std::vector<size_t> vertex_end(n_done), cell_end(n_done);
+	for (size_t e = 0; e < n_done; e++) {
+		if (checked.stop_requested()) {
+			status = token.stop_reason();
+			n_done = e;
+			break;
+		}
+		std::vector<size_t> elem, n(k, 1);
+		knot_t lo, hi;
+		element_domain(breaks, e, elem, lo, hi);
+		for (size_t s = 0; s < k; s++) {
+			n[s] = (size_t(1) << levels[e][s]) + 1;
+		}
+
+		std::vector<size_t> local;
+		for_each_index(n, [&](std::array<size_t, 3> const& pos) {
+			std::array<size_t, 3> key{0, 0, 0};
+			knot_t x(k);
+			for (size_t s = 0; s < k; s++) {
+				size_t m = pos[s] << (max_level - levels[e][s]);
+				key[s] = elem[s] * full + m;
+				x[s] = dyadic_param(lo[s], hi[s], m, full);
+			}
+			auto found = vertex.emplace(key, mesh.params.size());
+			if (found.second) {
+				mesh.params.push_back(x);
+				keys.push_back(key);
+			}
+			local.push_back(found.first->second);
+			return true;
+		});
+
+		size_t n1 = k > 1 ? n[1] : 1, n2 = k > 2 ? n[2] : 1;
+		auto index = [&](size_t i, size_t j, size_t l) {
+			return local[(i * n1 + j) * n2 + l];
+		};
+		for (size_t i = 0; i + 1 < n[0]; i++) {
+			if (k == 1) {
+				mesh.cells.push_back({index(i, 0, 0), index(i + 1, 0, 0)});
+				continue;
+			}
+			for (size_t j = 0; j + 1 < n1; j++) {
+				if (k == 2) {
+					mesh.cells.push_back({index(i, j, 0), index(i + 1, j, 0),
+							index(i + 1, j + 1, 0), index(i, j + 1, 0)});
+					continue;
+				}
+				for (size_t l = 0; l + 1 < n2; l++) {
+					mesh.cells.push_back({
+							index(i, j, l), index(i + 1, j, l),
+							index(i + 1, j + 1, l), index(i, j + 1, l),
+							index(i, j, l + 1), index(i + 1, j, l + 1),
+							index(i + 1, j + 1, l + 1), index(i, j + 1, l + 1)});
+				}
+			}
+		}
+		vertex_end[e] = keys.size();
+		cell_end[e] = mesh.cells.size();
+	}
+
+	/*
+	 * A vertex strictly inside the elements around it along axis r
+	 * is hanging if it is not on the grid of the coarsest of them
+	 * along r. It is placed on the multilinear interpolant of that
+	 * grid, from the vertices of the enclosing coarse cell, so that
+	 * the cells on both sides of a face meet exactly. Those vertices
+	 * lie on element boundaries along more axes, and are placed first.
+	 */
+	size_t n_vertices = keys.size();
+	std::vector<std::array<size_t, 3>> coarse(n_vertices);
+	std::vector<size_t> hanging, exact;
+	std::vector<size_t> n_bounds(n_vertices, 0);
+	for (size_t v = 0; v < n_vertices; v++) {
+		std::vector<size_t> first(k), count(k, 1);
+		for (size_t r = 0; r < k; r++) {
+			size_t i = keys[v][r] / full;
+			first[r] = i;
+			if (keys[v][r] % full == 0) {
+				n_bounds[v]++;
+				first[r] = i > 0 ? i - 1 : 0;
+				count[r] = (i > 0) + (i < n_elem[r]);
+			}
+		}
+		coarse[v] = {max_level, max_level, max_level};
+		for_each_index(count, [&](std::array<size_t, 3> const& pos) {
+			size_t e = 0;
+			for (size_t r = 0; r < k; r++) {
+				e += (first[r] + pos[r]) * stride[r];
+			}
+			if (e >= n_done) return true;
+			for (size_t r = 0; r < k; r++) {
+				coarse[v][r] = std::min(coarse[v][r], levels[e][r]);
+			}
+			return true;
+		});
+		bool on_grid = true;
+		for (size_t r = 0; r < k; r++) {
+			on_grid = on_grid && keys[v][r] % (full >> coarse[v][r]) == 0;
+		}
+		(on_grid ? exact : hanging).push_back(v);
+	}
+
+	mesh.points.resize(n_vertices);
+	size_t vertices_per_chunk = 4096;
+	size_t n_chunks = (exact.size() + vertices_per_chunk - 1) / vertices_per_chunk;
+	size_t completed = chunked_for(geometry.get_n_threads(), n_chunks, checked, [&](size_t tid, size_t c) {
+		size_t end = std::min(exact.size(), (c + 1) * vertices_per_chunk);
+		for (size_t i = c * vertices_per_chunk; i < end; i++) {
+			mesh.points[exact[i]] = geometry.evaluate(mesh.params[exact[i]], tid);
+		}
+	});
+
+	/*
+	 * After a stop, keep the leading elements whose vertices are all
+	 * evaluated; the corners of their hanging vertices are vertices
+	 * of the same elements, so they are kept as well.
+	 */
+	if (completed < n_chunks) {
+		status = token.stop_reason();
+		size_t evaluated = exact[completed * vertices_per_chunk];
+		size_t n_keep = 0;
+		while (n_keep < n_done && vertex_end[n_keep] <= evaluated) {
+			n_keep++;
+		}
+		n_vertices = n_keep > 0 ? vertex_end[n_keep - 1] : 0;
+		mesh.params.resize(n_vertices);
+		mesh.points.resize(n_vertices);
+		mesh.cells.resize(n_keep > 0 ? cell_end[n_keep - 1] : 0);
+		hanging.erase(std::remove_if(hanging.begin(), hanging.end(),
+				[&](size_t v) { return v >= n_vertices; }), hanging.end());
+	}
+	std::stable_sort(hanging.begin(), hanging.end(), [&](size_t a, size_t b) {
+		return n_bounds[a] > n_bounds[b];
+	});
+	for (size_t v : hanging) {
+		std::vector<size_t> n(k, 1);
+		std::array<size_t, 3> base = keys[v];
+		std::vector<scalar_t> t(k, 0);
+		for (size_t r = 0; r < k; r++) {
+			size_t h = full >> coarse[v][r];
+			if (keys[v][r] % h == 0) continue;
+			base[r] = keys[v][r] / h * h;
+			t[r] = scalar_t(keys[v][r] - base[r]) / h;
+			n[r] = 2;
+		}
+		ctrl_t point(geometry.get_n_cdims(), 0);
+		for_each_index(n, [&](std::array<size_t, 3> const& pos) {
+			std::array<size_t, 3> corner = base;
+			scalar_t w = 1;
+			for (size_t r = 0; r < k; r++) {
+				if (n[r] == 1) continue;
+				corner[r] += pos[r] * (full >> coarse[v][r]);
+				w *= pos[r] ? t[r] : 1 - t[r];
+			}
+			ctrl_t const& P = mesh.points[vertex.at(corner)];
+			for (size_t c = 0; c < point.size(); c++) {
+				point[c] += w * P[c];
+			}
+			return true;
+		});
+		mesh.points[v] = point;
+	}
+
+	if (with_quality && status == JOB_COMPLETED) {
+		mesh.quality.resize(mesh.cells.size());
+		size_t cells_per_chunk = 4096;
+		n_chunks = (mesh.cells.size() + cells_per_chunk - 1) / cells_per_chunk;
+		completed = chunked_for(geometry.get_n_threads(), n_chunks, token, [&](size_t, size_t c) {
+			size_t end = std::min(mesh.cells.size(), (c + 1) * cells_per_chunk);
+			for (size_t i = c * cells_per_chunk; i < end; i++) {
+				std::vector<ctrl_t> vertices;
+				for (size_t v : mesh.cells[i]) {
+					vertices.push_back(mesh.points[v]);
+				}
+				mesh.quality[i] = cell_quality(vertices);
+			}
+		});
+		if (completed < n_chunks) {
+			status = token.stop_reason();
+			mesh.quality.clear();
+		}
+	}
+	return mesh;
+}
+
+size_t vector_bytes(size_t n, size_t element_size)
+{
+	/* The vector object, and its heap block with the usual 16 byte granularity and header of malloc */
+	size_t block = std::max(size_t(32), (n * element_size + 8 + 15) / 16 * 16);
+	return sizeof(std::vector<scalar_t>) + block;
+}
+
+size_t vtk_output_bytes(size_t n_points, size_t n_cells, size_t n_corners)
+{
+	/* VTK stores 3 coordinates per point, and connectivity, offsets and types per cell */
+	return n_points * 3 * sizeof(double) + n_cells * ((n_corners + 1) * sizeof(long long) + 1);
+}
+
+/* The size terms of TessellationCost for the given numbers of samples */
+static TessellationCost tessellation_bytes(size_t n_cdims, std::vector<size_t> const& n_samples,
+		bool with_quality)
+{
+	size_t k = n_samples.size();
+	TessellationCost cost = {1, 1, 0, 0, 0, 0};
+	size_t sample_bytes = 0;
+	for (size_t n : n_samples) {
+		cost.n_points *= n;
+		cost.n_cells *= n - 1;
+		sample_bytes += vector_bytes(n, sizeof(scalar_t));
+	}
+	size_t corners = size_t(1) << k;
+
+	cost.mesh_bytes = sample_bytes
+		+ cost.n_points * (vector_bytes(k, sizeof(scalar_t)) + vector_bytes(n_cdims, sizeof(scalar_t)))
+		+ cost.n_cells * vector_bytes(corners, sizeof(size_t))
+		+ (with_quality ? cost.n_cells * sizeof(CellQuality) : 0);
+
+	cost.output_bytes = vtk_output_bytes(cost.n_points, cost.n_cells, corners)
+		+ (with_quality ? cost.n_cells * 4 * sizeof(double) : 0);
+	cost.peak_bytes = cost.mesh_bytes + cost.output_bytes;
+	return cost;
+}
+
+TessellationCost estimate_tessellation(BSplineGeometry& geometry,
+		std::vector<std::vector<scalar_t>> const& samples, bool with_quality)
+{
+	size_t k = samples.size();
+	if (k != geometry.get_n_kdims()) {
+		error("incorrect number of sample vectors provided");
+	}
+	std::vector<size_t> n_samples;
+	for (std::vector<scalar_t> const& u : samples) {
+		if (u.size() < 2) {
+			error("at least two samples are needed along each axis");
+		}
+		n_samples.push_back(u.size());
+	}
+	TessellationCost cost = tessellation_bytes(geometry.get_n_cdims(), n_samples, with_quality);
+
+	/* Time evaluations at sample points spread over the grid */
+	size_t n_probes = std::min(cost.n_points, size_t(64));
+	std::vector<knot_t> probes(n_probes, knot_t(k));
+	for (size_t i = 0; i < n_probes; i++) {
+		for (size_t s = 0; s < k; s++) {
+			probes[i][s] = samples[s][(i * 7919 + s * 104729) % samples[s].size()];
+		}
+	}
+	auto start = std::chrono::steady_clock::now();
+	for (knot_t const& x : probes) {
+		geometry.evaluate(x);
+	}
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+	cost.seconds = elapsed.count() / n_probes * cost.n_points / geometry.get_n_threads();
+	return cost;
+}
+
+size_t tessellate_chunks(BSplineGeometry& geometry,
+		std::vector<std::vector<scalar_t>> const& samples, size_t max_bytes, bool with_quality,
+		std::function<void(TessellationMesh const&, size_t)> const& emit)
+{
+	if (samples.empty()) {
+		error("incorrect number of sample vectors provided");
+	}
+
+	/* The most layers of samples along axis 0 that fit in max_bytes */
+	std::vector<size_t> n_samples;
+	for (std::vector<scalar_t> const& u : samples) {
+		n_samples.push_back(u.size());
+	}
+	size_t n = samples[0].size(), layers = 1;
+	while (layers < n) {
+		n_samples[0] = layers + 1;
+		if (tessellation_bytes(geometry.get_n_cdims(), n_samples, with_quality).peak_bytes > max_bytes) {
+			break;
+		}
+		layers++;
+	}
+	if (layers < 2) {
+		return 0;
+	}
+
+	size_t n_chunks = 0;
+	std::vector<std::vector<scalar_t>> slab = samples;
+	for (size_t first = 0; first + 1 < n; first += layers - 1) {
+		size_t last = std::min(first + layers, n);
+		slab[0].assign(samples[0].begin() + first, samples[0].begin() + last);
+		emit(tessellate(geometry, slab, with_quality), n_chunks);
+		n_chunks++;
+	}
+	return n_chunks;
+}
@@ -0,0 +1,191 @@
+#ifndef BSPLINE_TESSELLATION_H
+#define BSPLINE_TESSELLATION_H
+
+#include "cancellation.h"
+#include "geometry.h"
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
+
+/*
+ * A mesh produced by sampling a BSplineGeometry on a
+ * tensor product of parameter values.
+ *
+ * The vertices are ordered lexicographically in the same way
+ * as the control points of the geometry (the last parametric
+ * dimension varies fastest). Cells are lines, quadrilaterals
+ * or hexahedra for 1, 2 and 3 parametric dimensions, and their
+ * vertices are listed in VTK order (VTK_LINE, VTK_QUAD,
+ * VTK_HEXAHEDRON), taking parametric axis s as axis s of the cell.
+ */
+/*
+ * Quality measures of a linear mesh cell, as in the Verdict
+ * library (used by ParaView's Mesh Quality filter).
+ *
+ * The Jacobian at a corner is the determinant of the three edge
+ * vectors leaving that corner (for quadrilaterals, the normal
+ * component of the cross product of the two edge vectors; for
+ * lines, the length). The scaled Jacobian divides it by the
+ * product of the edge lengths, and is 1 for a perfect cube and
+ * negative for inverted corners. The edge ratio is the length
+ * of the longest edge divided by that of the shortest (Verdict's
+ * edge ratio, not its aspect ratio).
+ */
+struct CellQuality {
+	scalar_t scaled_jacobian;
+	scalar_t edge_ratio;
+	scalar_t min_jacobian;
+	scalar_t max_jacobian;
+};
+
+/* A named scalar field with one value per mesh vertex */
+struct PointField {
+	std::string name;
+	std::vector<scalar_t> values;
+};
+
+struct TessellationMesh {
+	size_t n_kdims;
+	/* The sampled parameter values along each parametric axis (empty from adaptive_tessellate()) */
+	std::vector<std::vector<scalar_t>> samples;
+	/* Parametric and physical coordinates of each vertex */
+	std::vector<knot_t> params;
+	std::vector<ctrl_t> points;
+	/* Vertex indices of each cell */
+	std::vector<std::vector<size_t>> cells;
+	/* Quality of each cell, if requested (otherwise empty) */
+	std::vector<CellQuality> quality;
+	/* Additional per-vertex fields to output with the mesh */
+	std::vector<PointField> point_fields;
+};
+
+/* The quality of a cell with the given vertices, listed in VTK order */
+CellQuality cell_quality(std::vector<ctrl_t> const& vertices);
+
+/*
+ * Sample parameters along axis s placing n_per_span evenly spaced
+ * segments in every element (nonempty knot span).
+ */
+std::vector<scalar_t> uniform_samples(BSplineGeometry const& geometry, size_t s, size_t n_per_span);
+
+/*
+ * Sample the geometry on the tensor product of the given
+ * per-axis parameter values and connect the samples into cells.
+ * Only geometries with 1, 2 or 3 parametric dimensions can be
+ * tessellated.
+ *
+ * The points are evaluated in parallel with the geometry's
+ * threads. If with_quality is set, the cell quality measures
+ * are computed in parallel as well, right after the points.
+ */
+TessellationMesh tessellate(BSplineGeometry& geometry,
+		std::vector<std::vector<scalar_t>> const& samples, bool with_quality = false);
+
+/*
+ * tessellate(), stopping early when the token asks to. The
+ * vertices are evaluated a few layers (along parametric axis 0)
+ * at a time, checking the token in between. If the job is
+ * stopped, the mesh covers the layers completed so far, with
+ * samples[0] shortened to match and without cell quality, and
+ * status tells why; otherwise status is JOB_COMPLETED.
+ */
+TessellationMesh tessellate(BSplineGeometry& geometry,
+		std::vector<std::vector<scalar_t>> const& samples, bool with_quality,
+		CancellationToken const& token, JobStatus& status);
+
+/*
+ * Tessellate the geometry with a grid per element whose resolution
+ * follows the local curvature.
+ *
+ * Each element is bisected along every axis on which its chordal
+ * deviation exceeds tolerance, until none does or max_level
+ * bisections have been applied along that axis. The deviation along
+ * an axis is measured at 1/4, 1/2 and 3/4 of every segment, on the
+ * lines through the vertices and the cell midpoints of the other
+ * axes (at most 9 per axis and element); it is not guaranteed
+ * between those lines. Elements are refined in parallel with the
+ * geometry's threads. Elements are then refined further until the
+ * levels of elements sharing a face differ by at most one along
+ * every axis (2:1 balance).
+ *
+ * The mesh is conforming: vertices at the same parameters are
+ * shared, and where elements of different resolution meet, the
+ * vertices of the finer one that are not vertices of the coarser one
+ * (hanging nodes) are placed on the (bi)linear interpolant of the
+ * coarser one's cell face or edge, instead of on the geometry, so
+ * the cells on both sides of every face coincide. Their points are
+ * therefore not the geometry evaluated at their params. The
+ * vertices do not form a tensor grid, so samples is left empty.
+ */
+TessellationMesh adaptive_tessellate(BSplineGeometry& geometry,
+		scalar_t tolerance, size_t max_level = 10, bool with_quality = false);
+
+/*
+ * adaptive_tessellate(), stopping early when the token asks to. The
+ * token is checked between elements while refining, and then
+ * between elements and chunks of vertices while meshing. If the job
+ * is stopped, the mesh covers the leading elements (last axis
+ * fastest) that were completed, conforming among themselves and
+ * without cell quality, and status tells why; otherwise status is
+ * JOB_COMPLETED. A stop while refining still meshes the elements
+ * refined so far, which takes about as long as evaluating their
+ * vertices; a stop while meshing keeps the elements whose vertices
+ * were evaluated.
+ */
+TessellationMesh adaptive_tessellate(BSplineGeometry& geometry,
+		scalar_t tolerance, size_t max_level, bool with_quality,
+		CancellationToken const& token, JobStatus& status);
+
+/*
+ * The predicted size and cost of tessellate() on a tensor
+ * product of samples, for deciding whether a job fits in memory.
+ */
+struct TessellationCost {
+	size_t n_points;
+	size_t n_cells;
+	/* The memory held by the TessellationMesh (with allocator overhead) */
+	size_t mesh_bytes;
+	/* The size of the mesh as binary VTK arrays (points, cells, cell quality) */
+	size_t output_bytes;
+	/* The peak memory while writing: the mesh plus a copy of the arrays */
+	size_t peak_bytes;
+	/* The time to evaluate the points, from timing a few evaluations */
+	double seconds;
+};
+
+/*
+ * The memory of a std::vector of n elements of the given size held
+ * by another container, with allocator overhead, as counted in
+ * TessellationCost::mesh_bytes.
+ */
+size_t vector_bytes(size_t n, size_t element_size);
+
+/*
+ * The size of n_points points and n_cells cells of n_corners points
+ * each as binary VTK arrays, as counted in TessellationCost::output_bytes.
+ */
+size_t vtk_output_bytes(size_t n_points, size_t n_cells, size_t n_corners);
+
+/*
+ * Predict the cost of tessellate(geometry, samples, with_quality)
+ * without running it. The time estimate evaluates up to 64 sample
+ * points and assumes the geometry's threads share the work evenly.
+ */
+TessellationCost estimate_tessellation(BSplineGeometry& geometry,
+		std::vector<std::vector<scalar_t>> const& samples, bool with_quality = false);
+
+/*
+ * Tessellate in slabs along parametric axis 0, each predicted to
+ * need at most max_bytes at its peak (see TessellationCost), and
+ * pass every slab to emit(mesh, slab index) as soon as it is done,
+ * so that only one slab is in memory at a time. Consecutive slabs
+ * share a layer of samples, so together they cover the same cells
+ * as tessellate(). Returns the number of slabs, or zero (without
+ * tessellating) if even a slab one cell thick is too large.
+ */
+size_t tessellate_chunks(BSplineGeometry& geometry,
+		std::vector<std::vector<scalar_t>> const& samples, size_t max_bytes, bool with_quality,
+		std::function<void(TessellationMesh const&, size_t)> const& emit);
+
+#endif
@@ -1,5 +1,25 @@
 #include "geometry.h"
+#include "tessellation.h"
+#include "quadrature.h"
+#include "inversion.h"
+#include "curvature.h"
+#include "bvh.h"
+#include "raytrace.h"
+#include "fitting.h"
+#include "knotremoval.h"
+#include "hierarchical.h"
+#include "restriction.h"
+#include "autotune.h"
+#include "contour.h"
+#include "hodograph.h"
+#include "mapped.h"
+#include "cancellation.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
 #include <iostream>
+#include <string>
 
 using namespace std;
 
@@ -161,4 +181,1019 @@ int main()
 		}
 		cout << "\n";
 	}
+
+	{
+		// adaptive tessellation, n_kdims = 2, n_cdims = 3, degrees = 1, 2
+		// flat in the first dimension, curved in the second
+		std::vector<size_t> degrees{1, 2};
+		std::vector<std::vector<double>> knots{{0, 0.5, 1}, {0, 1}};
+		std::vector<std::vector<double>> control_points{
+			{0, 0, 0}, {0, 0.5, 1}, {0, 1, 0},
+			{0.5, 0, 0}, {0.5, 0.5, 1}, {0.5, 1, 0},
+			{1, 0, 0}, {1, 0.5, 1}, {1, 1, 0}
+		};
+		auto spline = BSplineGeometry(2, 3, degrees, knots, control_points);
+
+		for (double tolerance : {0.1, 0.01, 0.001}) {
+			TessellationMesh mesh = adaptive_tessellate(spline, tolerance);
+			cout << mesh.points.size() << " " << mesh.cells.size() << "\n";
+		}
+
+		// a vertex on the closed parametric box of a cell it does not
+		// belong to is a hanging node, and must lie on the multilinear
+		// interpolant of the cell; returns the number of hanging nodes
+		// and whether they all do
+		auto conforming = [](TessellationMesh const& mesh, size_t& hanging) {
+			size_t k = mesh.n_kdims;
+			bool conforms = true;
+			hanging = 0;
+			for (std::vector<size_t> const& cell : mesh.cells) {
+				knot_t const& lo = mesh.params[cell[0]];
+				knot_t const& hi = mesh.params[cell[k == 1 ? 1 : k == 2 ? 2 : 6]];
+				for (size_t v = 0; v < mesh.params.size(); v++) {
+					if (std::find(cell.begin(), cell.end(), v) != cell.end()) continue;
+					bool inside = true;
+					for (size_t s = 0; s < k; s++) {
+						inside = inside && mesh.params[v][s] >= lo[s] && mesh.params[v][s] <= hi[s];
+					}
+					if (!inside) continue;
+					hanging++;
+					ctrl_t y(mesh.points[v].size(), 0);
+					for (size_t c : cell) {
+						double w = 1;
+						for (size_t s = 0; s < k; s++) {
+							double t = (mesh.params[v][s] - lo[s]) / (hi[s] - lo[s]);
+							w *= mesh.params[c][s] == lo[s] ? 1 - t : t;
+						}
+						for (size_t r = 0; r < y.size(); r++) {
+							y[r] += w * mesh.points[c][r];
+						}
+					}
+					for (size_t r = 0; r < y.size(); r++) {
+						conforms = conforms && std::fabs(y[r] - mesh.points[v][r]) < 1e-12;
+					}
+				}
+			}
+			return conforms;
+		};
+
+		// a bump over the corner 2 x 2 elements of 4 x 4, curved across
+		// their shared edges: elements of different levels meet there,
+		// and the hanging nodes keep the mesh conforming
+		knots = {{0, 0.25, 0.5, 0.75, 1}, {0, 0.25, 0.5, 0.75, 1}};
+		std::vector<double> greville{0, 0.125, 0.375, 0.625, 0.875, 1};
+		std::vector<ctrl_t> bump;
+		for (size_t i = 0; i < 6; i++) {
+			for (size_t j = 0; j < 6; j++) {
+				bump.push_back({greville[i], greville[j], i == 1 && j == 1 ? 1.0 : 0.0});
+			}
+		}
+		auto corner = BSplineGeometry(2, 3, {2, 2}, knots, bump, 2);
+		TessellationMesh mesh = adaptive_tessellate(corner, 0.003);
+		size_t hanging = 0;
+		bool conforms = conforming(mesh, hanging);
+		cout << mesh.points.size() << " " << mesh.cells.size() << " " << hanging << " " << conforms << "\n";
+
+		// the same bump on a slab, n_kdims = 3, degrees = 2, 2, 1: hanging
+		// nodes on element faces and edges
+		std::vector<ctrl_t> slab;
+		for (size_t i = 0; i < 6; i++) {
+			for (size_t j = 0; j < 6; j++) {
+				for (double z : {0.0, 0.5}) {
+					slab.push_back({greville[i], greville[j], z + (i == 1 && j == 1 ? 1.0 : 0.0)});
+				}
+			}
+		}
+		auto volume = BSplineGeometry(3, 3, {2, 2, 1}, {knots[0], knots[1], {0, 1}}, slab, 2);
+		mesh = adaptive_tessellate(volume, 0.003);
+		conforms = conforming(mesh, hanging);
+		cout << mesh.points.size() << " " << mesh.cells.size() << " " << hanging << " " << conforms << "\n";
+		cout << "\n";
+	}
+
+	{
+		// Gauss quadrature, n_kdims = 3, n_cdims = 3, degrees = 1, 2, 1
+		// the box [0, 2] x [0, 1] x [0, 3], expected volume 6
+		std::vector<size_t> degrees{1, 2, 1};
+		std::vector<std::vector<double>> knots{{0, 1}, {0, 0.5, 1}, {0, 1}};
+		std::vector<std::vector<double>> control_points;
+		for (double x : {0.0, 2.0}) {
+			for (double y : {0.0, 0.25, 0.75, 1.0}) {
+				for (double z : {0.0, 3.0}) {
+					control_points.push_back({x, y, z});
+				}
+			}
+		}
+		auto spline = BSplineGeometry(3, 3, degrees, knots, control_points, 2);
+		cout << measure(spline) << "\n";
+
+		// first moment, x-coordinate of the centroid should be 1
+		auto moment = [](knot_t const&, ctrl_t const& y, std::vector<ctrl_t> const&,
+				double weight, std::vector<double>& f) {
+			f[0] += weight * y[0];
+		};
+		cout << integrate(spline, 1, moment)[0] / 6 << "\n";
+		cout << "\n";
+	}
+
+	{
+		// Jacobian check, n_kdims = 2, n_cdims = 2, degrees = 2, 1
+		// a valid curved strip, then the same strip with a control point
+		// pulled across the opposite edge of the first element
+		std::vector<size_t> degrees{2, 1};
+		std::vector<std::vector<double>> knots{{0, 0.5, 1}, {0, 1}};
+		std::vector<std::vector<double>> control_points{
+			{0, 0}, {0, 1}, {1, 0.2}, {1, 1.2}, {2, 0.2}, {2, 1.2}, {3, 0}, {3, 1}
+		};
+		auto spline = BSplineGeometry(2, 2, degrees, knots, control_points, 2);
+		JacobianCheck check = check_jacobian(spline);
+		cout << check.valid() << " " << check.inverted.size() << " " << check.uncertain.size() << "\n";
+
+		control_points[1] = {0, -1.5};
+		auto folded = BSplineGeometry(2, 2, degrees, knots, control_points, 2);
+		check = check_jacobian(folded);
+		cout << check.valid() << " " << (check.min_bound < 0) << " ";
+		for (size_t e : check.inverted) {
+			cout << e << " ";
+		}
+		cout << "\n\n";
+	}
+
+	{
+		// Jacobian check, n_kdims = 1, n_cdims = 1, degree = 1
+		// det J is constant on each element: a monotone polyline,
+		// then the same polyline doubling back on its second element
+		std::vector<size_t> degrees{1};
+		std::vector<std::vector<double>> knots{{0, 0.5, 1}};
+		std::vector<std::vector<double>> control_points{{0}, {1}, {3}};
+		auto line = BSplineGeometry(1, 1, degrees, knots, control_points);
+		JacobianCheck check = check_jacobian(line);
+		cout << check.valid() << " " << check.min_bound << " " << check.uncertain.size() << "\n";
+
+		control_points[2] = {0.5};
+		auto back = BSplineGeometry(1, 1, degrees, knots, control_points);
+		check = check_jacobian(back);
+		cout << check.valid() << " " << check.min_bound << " ";
+		for (size_t e : check.inverted) {
+			cout << e << " ";
+		}
+		cout << "\n\n";
+	}
+
+	{
+		// tessellation with cell quality, n_kdims = 3, n_cdims = 3, degrees = 1
+		// a trilinearly distorted box, split into two cells
+		std::vector<size_t> degrees{1, 1, 1};
+		std::vector<std::vector<double>> knots{{0, 1}, {0, 1}, {0, 1}};
+		std::vector<std::vector<double>> control_points{
+			{0, 0, 0}, {0, 0, 1}, {0, 1, 0}, {0, 1, 1},
+			{2, 0, 0}, {2, 0, 1}, {2, 3, 2}, {2, 3, 3}
+		};
+		auto spline = BSplineGeometry(3, 3, degrees, knots, control_points, 2);
+		std::vector<std::vector<double>> samples{
+			uniform_samples(spline, 0, 2), uniform_samples(spline, 1, 1), uniform_samples(spline, 2, 1)};
+		TessellationMesh mesh = tessellate(spline, samples, true);
+		for (CellQuality const& q : mesh.quality) {
+			cout << q.scaled_jacobian << " " << q.edge_ratio << " " 
+				<< q.min_jacobian << " " << q.max_jacobian << "\n";
+		}
+		cout << "\n";
+	}
+
+	{
+		// curvature, n_kdims = 2, n_cdims = 3, degrees = 2
+		// the paraboloid z = x^2 + y^2: K = 4, H = 2 at the origin
+		std::vector<size_t> degrees{2, 2};
+		std::vector<std::vector<double>> knots{{0, 1}, {0, 1}};
+		std::vector<std::vector<double>> control_points;
+		double c[3] = {0, 0, 1};
+		for (size_t a = 0; a < 3; a++) {
+			for (size_t b = 0; b < 3; b++) {
+				control_points.push_back({0.5 * a, 0.5 * b, c[a] + c[b]});
+			}
+		}
+		auto spline = BSplineGeometry(2, 3, degrees, knots, control_points, 2);
+
+		std::vector<knot_t> x{{0, 0}, {0.5, 0.5}, {1, 0}};
+		for (SurfaceCurvature const& k : evaluate_curvature(spline, x)) {
+			cout << k.gaussian << " " << k.mean << " " << k.k1 << " " << k.k2 << "\n";
+		}
+		std::vector<SurfaceCurvature> grid = evaluate_curvature_grid(spline, {{0, 0.5, 1}, {0, 0.5}});
+		cout << grid[3].gaussian << " " << grid[4].gaussian << "\n";
+		cout << "\n";
+	}
+
+	{
+		// element BVH, n_kdims = 1, n_cdims = 2, degree = 2
+		std::vector<size_t> degrees{2};
+		std::vector<std::vector<double>> knots{{0, 1, 2, 3, 4, 5, 6, 7, 8}};
+		std::vector<std::vector<double>> control_points;
+		for (int i = 0; i < 10; i++) {
+			control_points.push_back({double(i), double(i % 2)});
+		}
+		auto spline = BSplineGeometry(1, 2, degrees, knots, control_points);
+		ElementBVH bvh(spline);
+
+		AABB const& extent = bvh.extent();
+		cout << bvh.n_elements() << " " << extent.lo[0] << " " << extent.hi[0] << "\n";
+		for (size_t e : bvh.overlapping(AABB{{3.5, 0}, {4.5, 1}})) {
+			cout << e << " ";
+		}
+		cout << "\n";
+		double d;
+		size_t e = bvh.nearest({20, 0.5}, &d);
+		cout << e << " " << d << "\n";
+
+		// move the last control point far away and refit
+		spline.set_control_point(9, {30, 0.5});
+		bvh.refit(spline, {9});
+		e = bvh.nearest({20, 0.5}, &d);
+		cout << e << " " << d << " " << bvh.extent().hi[0] << "\n";
+		cout << "\n";
+	}
+
+	{
+		// ray intersection, n_kdims = 2, n_cdims = 3, degrees = 2
+		// the paraboloid z = x^2 + y^2 over [0, 1]^2, hit from above
+		std::vector<size_t> degrees{2, 2};
+		std::vector<std::vector<double>> knots{{0, 0.5, 1}, {0, 1}};
+		std::vector<std::vector<double>> control_points;
+		double c[4] = {0, 0, 0.5, 1};
+		double x[4] = {0, 0.25, 0.75, 1};
+		double d[3] = {0, 0, 1};
+		for (size_t a = 0; a < 4; a++) {
+			for (size_t b = 0; b < 3; b++) {
+				control_points.push_back({x[a], 0.5 * b, c[a] + d[b]});
+			}
+		}
+		auto spline = BSplineGeometry(2, 3, degrees, knots, control_points, 2);
+		ElementBVH bvh(spline);
+
+		std::vector<ctrl_t> origins{{0.5, 0.5, 5}, {0.9, 0.2, 5}, {2, 2, 5}};
+		std::vector<ctrl_t> directions{{0, 0, -1}, {0, 0, -1}, {0, 0, -1}};
+		for (RayHit const& h : intersect_rays(spline, bvh, origins, directions)) {
+			cout << h.hit;
+			if (h.hit) {
+				cout << " " << h.y[0] << " " << h.y[1] << " " << h.y[2] << " " << h.element;
+			}
+			cout << "\n";
+		}
+
+		// the parabolic trough z = (2x - 1)^2 as one element, crossed
+		// twice by horizontal rays; the nearer crossing is reported
+		auto trough = BSplineGeometry(2, 3, {2, 1}, {{0, 1}, {0, 1}}, 
+				std::vector<ctrl_t>{{0, 0, 1}, {0, 1, 1}, {0.5, 0, -1}, {0.5, 1, -1}, {1, 0, 1}, {1, 1, 1}});
+		ElementBVH trough_bvh(trough);
+		origins = {{-1, 0.5, 0.64}, {2, 0.5, 0.64}};
+		directions = {{1, 0, 0}, {-1, 0, 0}};
+		for (RayHit const& h : intersect_rays(trough, trough_bvh, origins, directions)) {
+			cout << h.hit << " " << h.y[0] << " " << h.t << "\n";
+		}
+		cout << "\n";
+	}
+
+	{
+		// interpolation, n_kdims = 2, n_cdims = 3, degrees = 2, 3
+		// points sampled from (u, v, u^2 + v^3) at the Greville abscissae
+		// are reproduced exactly, since the function is in the spline space
+		std::vector<size_t> degrees{2, 3};
+		std::vector<std::vector<double>> knots{{0, 0.3, 0.5, 1}, {0, 0.25, 0.5, 0.75, 1}};
+		auto layout = BSplineGeometry(2, 3, degrees, knots, 
+				std::vector<ctrl_t>(5 * 7, ctrl_t(3, 0)));
+		std::vector<double> gu = greville_abscissae(layout.get_knot_vector(0), 2);
+		std::vector<double> gv = greville_abscissae(layout.get_knot_vector(1), 3);
+		std::vector<ctrl_t> points;
+		for (double u : gu) {
+			for (double v : gv) {
+				points.push_back({u, v, u * u + v * v * v});
+			}
+		}
+		auto spline = interpolate_grid(degrees, knots, points, 2);
+
+		std::vector<knot_t> x{{0.1, 0.2}, {0.45, 0.9}, {1, 1}};
+		for (ctrl_t const& y : spline.evaluate(x)) {
+			cout << y[0] << " " << y[1] << " " << y[2] << "\n";
+		}
+
+		// uniform knots chosen from the grid size
+		auto uniform = interpolate_grid({5, 7}, degrees, points);
+		cout << uniform.evaluate({1, 0})[2] << "\n";
+		cout << "\n";
+	}
+
+	{
+		// least squares, n_kdims = 2, n_cdims = 1, degrees = 2, 3
+		// scattered samples of u^2 + v^3 lie in the spline space, so the
+		// fit reproduces them; 1 and 3 threads, and streaming the same
+		// samples from a file in small chunks, give the same result
+		std::vector<size_t> degrees{2, 3};
+		std::vector<std::vector<double>> knots{{0, 0.5, 1}, {0, 0.5, 1}};
+		std::vector<knot_t> x;
+		std::vector<ctrl_t> y;
+		for (size_t i = 0; i < 400; i++) {
+			double u = std::fmod(i * 0.6180339887, 1.0);
+			double v = std::fmod(i * 0.7548776662, 1.0);
+			x.push_back({u, v});
+			y.push_back({u * u + v * v * v});
+		}
+
+		LeastSquaresFitter serial(1, degrees, knots);
+		serial.add_samples(x, y);
+		LeastSquaresFitter threaded(1, degrees, knots, 3);
+		threaded.add_samples(x, y);
+
+		std::ofstream file("least_squares_samples.txt");
+		for (size_t i = 0; i < x.size(); i++) {
+			file << x[i][0] << " " << x[i][1] << " " << y[i][0] << "\n";
+		}
+		file.close();
+		LeastSquaresFitter streamed(1, degrees, knots, 2);
+		cout << streamed.add_samples_from_file("least_squares_samples.txt", 64) << "\n";
+		std::remove("least_squares_samples.txt");
+
+		std::vector<knot_t> p{{0.1, 0.2}, {0.45, 0.9}, {1, 1}};
+		for (LeastSquaresFitter const* f : {&serial, &threaded, &streamed}) {
+			for (ctrl_t const& q : f->solve().evaluate(p)) {
+				cout << q[0] << " ";
+			}
+			cout << "\n";
+		}
+
+		// batches of several sample blocks, added twice, sum to the
+		// same normal equations for any number of threads
+		std::vector<knot_t> many_x;
+		std::vector<ctrl_t> many_y;
+		for (size_t i = 0; i < 3 * LeastSquaresFitter::sample_block + 100; i++) {
+			double u = std::fmod(i * 0.6180339887, 1.0);
+			double v = std::fmod(i * 0.7548776662, 1.0);
+			many_x.push_back({u, v});
+			many_y.push_back({std::sin(3 * u) + v * v * v});
+		}
+		std::vector<ctrl_t> fitted[3];
+		for (size_t t = 1; t <= 3; t++) {
+			LeastSquaresFitter fitter(1, degrees, knots, t);
+			fitter.add_samples(many_x, many_y);
+			fitter.add_samples(many_x, many_y);
+			fitted[t - 1] = fitter.solve().get_control_points();
+		}
+		cout << (fitted[0] == fitted[1]) << " " << (fitted[0] == fitted[2]) << "\n";
+
+		// n_kdims = 3, degrees = 1, 1, 2, four elements per axis:
+		// u v + w^2 lies in the spline space and is reproduced
+		std::vector<std::vector<double>> fine(3, {0, 0.25, 0.5, 0.75, 1});
+		LeastSquaresFitter volume(1, {1, 1, 2}, fine, 2);
+		std::vector<knot_t> volume_x;
+		std::vector<ctrl_t> volume_y;
+		for (size_t i = 0; i < 5000; i++) {
+			double u = std::fmod(i * 0.8191725134, 1.0);
+			double v = std::fmod(i * 0.6710436067, 1.0);
+			double w = std::fmod(i * 0.5497004779, 1.0);
+			volume_x.push_back({u, v, w});
+			volume_y.push_back({u * v + w * w});
+		}
+		volume.add_samples(volume_x, volume_y);
+		cout << volume.solve().evaluate({0.3, 0.6, 0.9})[0] << "\n";
+		cout << "\n";
+	}
+
+	{
+		// knot removal, n_kdims = 2, n_cdims = 3, degrees = 2, 3
+		// (u, v, u^2 + v^3) interpolated over refined knots lies in the
+		// space without interior knots, so all 7 of them are removed
+		std::vector<size_t> degrees{2, 3};
+		std::vector<std::vector<double>> knots{{0, 0.25, 0.5, 0.75, 1}, {0, 0.2, 0.4, 0.6, 0.8, 1}};
+		auto layout = BSplineGeometry(2, 3, degrees, knots, 
+				std::vector<ctrl_t>(6 * 8, ctrl_t(3, 0)));
+		std::vector<double> gu = greville_abscissae(layout.get_knot_vector(0), 2);
+		std::vector<double> gv = greville_abscissae(layout.get_knot_vector(1), 3);
+		std::vector<ctrl_t> points;
+		for (double u : gu) {
+			for (double v : gv) {
+				points.push_back({u, v, u * u + v * v * v});
+			}
+		}
+		auto spline = interpolate_grid(degrees, knots, points);
+
+		KnotRemoval report;
+		auto reduced = remove_knots(spline, 1e-9, &report);
+		cout << report.n_removed << " " << (report.max_deviation < 1e-9) << " ";
+		cout << reduced.get_n_ctrl(0) << " " << reduced.get_n_ctrl(1) << "\n";
+		cout << reduced.evaluate({0.45, 0.9})[2] << "\n";
+
+		// a perturbed net keeps its knots at a tight tolerance
+		points[20][2] += 0.01;
+		auto bumped = interpolate_grid(degrees, knots, points);
+		remove_knots(bumped, 1, 1e-6, &report);
+		cout << report.n_removed << "\n";
+		cout << "\n";
+	}
+
+	{
+		// hierarchical spline, n_kdims = 2, n_cdims = 3, degrees = 2, 3
+		// refining two nested regions does not change the spline, the
+		// truncated basis is a partition of unity, and moving a control
+		// point of the finest level only changes the spline inside it
+		std::vector<size_t> degrees{2, 3};
+		std::vector<std::vector<double>> knots{{0, 0.25, 0.5, 1}, {0, 0.5, 1}};
+		std::vector<ctrl_t> control_points;
+		for (size_t i = 0; i < 5; i++) {
+			for (size_t j = 0; j < 5; j++) {
+				control_points.push_back({double(i), double(j), double((i * j) % 3)});
+			}
+		}
+		auto spline = BSplineGeometry(2, 3, degrees, knots, control_points);
+		HierarchicalBSpline thb(spline);
+		thb.refine(1, {0.1, 0.2}, {0.6, 0.7});
+		thb.refine(2, {0.3, 0.2}, {0.55, 0.7});
+		cout << thb.get_n_levels() << " " << thb.get_n_active() << "\n";
+
+		std::vector<knot_t> x{{0, 0}, {0.4, 0.45}, {0.5, 0.65}, {0.9, 0.1}, {1, 1}};
+		std::vector<ctrl_t> y = thb.evaluate(x);
+		for (size_t i = 0; i < x.size(); i++) {
+			ctrl_t expected = spline.evaluate(x[i]);
+			double sum = 0;
+			for (ActiveFunction const& f : thb.active_basis(x[i])) {
+				sum += f.value;
+			}
+			cout << (std::fabs(y[i][2] - expected[2]) < 1e-12) << " " << sum << "\n";
+		}
+
+		cout << thb.get_active(2).size() << "\n";
+		auto first = thb.get_active(2).begin();
+		ctrl_t P = first->second;
+		P[2] += 1;
+		thb.set_control_point(2, first->first, P);
+		cout << thb.evaluate(knot_t{0.35, 0.35})[2] - spline.evaluate(knot_t{0.35, 0.35})[2] << " ";
+		cout << thb.evaluate(knot_t{0.9, 0.1})[2] - spline.evaluate(knot_t{0.9, 0.1})[2] << "\n";
+		cout << "\n";
+	}
+
+	{
+		// isoparametric curves and restriction, n_kdims = 3, n_cdims = 3
+		// the trilinearly distorted box from the quadrature test
+		std::vector<size_t> degrees{1, 2, 1};
+		std::vector<std::vector<double>> knots{{0, 0.5, 1}, {0, 1}, {0, 1}};
+		std::vector<ctrl_t> control_points;
+		for (size_t i = 0; i < 3; i++) {
+			for (size_t j = 0; j < 3; j++) {
+				for (size_t l = 0; l < 2; l++) {
+					control_points.push_back({double(i), double(j) + 0.1 * i * l, double(l) * (1 + 0.2 * j)});
+				}
+			}
+		}
+		auto spline = BSplineGeometry(3, 3, degrees, knots, control_points);
+		knot_t x{0.3, 0.6, 0.8};
+
+		auto curve = isoparametric_curve(spline, 1, x);
+		auto face = restrict_dimension(spline, 0, x[0]);
+		ctrl_t expected = spline.evaluate(x);
+		ctrl_t on_curve = curve.evaluate(knot_t{x[1]});
+		ctrl_t on_face = face.evaluate(knot_t{x[1], x[2]});
+		for (size_t c = 0; c < 3; c++) {
+			cout << expected[c] << " " << on_curve[c] << " " << on_face[c] << "\n";
+		}
+
+		// 4 + 6 + 6 curves along the three dimensions, 4 segments per element
+		TessellationMesh lines = wireframe(spline, 4);
+		cout << lines.points.size() << " " << lines.cells.size() << "\n";
+		cout << "\n";
+	}
+
+	{
+		// boundary sampling, n_kdims = 3, n_cdims = 3, degrees = 1, 2, 1
+		// a 5 x 4 x 3 grid has 60 - 3 * 2 * 1 = 54 boundary vertices and
+		// 2 * (4 * 3 + 4 * 2 + 3 * 2) = 52 quads, all facing outwards
+		std::vector<size_t> degrees{1, 2, 1};
+		std::vector<std::vector<double>> knots{{0, 0.5, 1}, {0, 1}, {0, 1}};
+		std::vector<ctrl_t> control_points;
+		for (size_t i = 0; i < 3; i++) {
+			for (size_t j = 0; j < 3; j++) {
+				for (size_t l = 0; l < 2; l++) {
+					control_points.push_back({double(i), double(j) + 0.1 * i * l, double(l) * (1 + 0.2 * j)});
+				}
+			}
+		}
+		auto spline = BSplineGeometry(3, 3, degrees, knots, control_points, 2);
+		std::vector<std::vector<double>> samples{
+			{0, 0.25, 0.5, 0.75, 1}, {0, 0.5, 1}, {0, 0.5, 1}};
+		samples[1].insert(samples[1].begin() + 1, 0.3);
+		TessellationMesh surface = boundary_tessellate(spline, samples);
+		cout << surface.points.size() << " " << surface.cells.size() << "\n";
+
+		// the signed volume enclosed by the quads (divergence theorem)
+		// is positive when they face outwards
+		double enclosed = 0;
+		for (std::vector<size_t> const& q : surface.cells) {
+			for (size_t t = 1; t + 1 < 4; t++) {
+				ctrl_t const& a = surface.points[q[0]];
+				ctrl_t const& b = surface.points[q[t]];
+				ctrl_t const& c = surface.points[q[t + 1]];
+				enclosed += (a[0] * (b[1] * c[2] - b[2] * c[1]) 
+						- a[1] * (b[0] * c[2] - b[2] * c[0])
+						+ a[2] * (b[0] * c[1] - b[1] * c[0])) / 6;
+			}
+		}
+		cout << (enclosed > 0) << "\n";
+
+		ctrl_t expected = spline.evaluate(knot_t{0.75, 1, 0.5});
+		for (size_t v = 0; v < surface.params.size(); v++) {
+			if (surface.params[v] == knot_t{0.75, 1, 0.5}) {
+				double d = 0;
+				for (size_t c = 0; c < 3; c++) {
+					d += std::fabs(surface.points[v][c] - expected[c]);
+				}
+				cout << (d < 1e-12) << "\n";
+			}
+		}
+		cout << "\n";
+	}
+
+	{
+		// preview mode, n_kdims = 2, n_cdims = 3, degrees = 2, 3
+		// the observed error is within the estimate, which shrinks
+		// quadratically with the table resolution
+		std::vector<size_t> degrees{2, 3};
+		std::vector<std::vector<double>> knots{{0, 0.25, 0.5, 1}, {0, 0.5, 1}};
+		std::vector<ctrl_t> control_points;
+		for (size_t i = 0; i < 5; i++) {
+			for (size_t j = 0; j < 5; j++) {
+				control_points.push_back({double(i), double(j), double((i * j) % 3)});
+			}
+		}
+		auto spline = BSplineGeometry(2, 3, degrees, knots, control_points);
+		std::vector<knot_t> x;
+		for (size_t i = 0; i <= 40; i++) {
+			x.push_back({i / 40.0, std::fmod(i * 0.618034, 1.0)});
+		}
+		std::vector<ctrl_t> exact = spline.evaluate(x);
+
+		for (size_t resolution : {8, 32}) {
+			spline.set_preview(resolution);
+			std::vector<ctrl_t> approx = spline.evaluate(x);
+			double max_error = 0;
+			for (size_t i = 0; i < x.size(); i++) {
+				double d2 = 0;
+				for (size_t c = 0; c < 3; c++) {
+					d2 += (approx[i][c] - exact[i][c]) * (approx[i][c] - exact[i][c]);
+				}
+				max_error = std::max(max_error, std::sqrt(d2));
+			}
+			cout << spline.get_preview() << " " << (max_error <= spline.get_preview_error()) << " ";
+			cout << spline.get_preview_error() << "\n";
+		}
+
+		spline.set_preview(0);
+		cout << spline.get_preview_error() << " " << (spline.evaluate(x[7]) == exact[7]) << "\n";
+		cout << "\n";
+	}
+
+	{
+		// blocked control point storage, n_kdims = 3, n_cdims = 3
+		// blocks of 2 (with partial blocks for the 3 and 5 layer
+		// dimensions) give the same values and derivatives as the
+		// lexicographic order, also after moving a control point; the
+		// lexicographic indices are translated to the blocked storage
+		std::vector<size_t> degrees{1, 2, 2};
+		std::vector<std::vector<double>> knots{{0, 0.5, 1}, {0, 1}, {0, 0.3, 0.6, 1}};
+		std::vector<ctrl_t> control_points;
+		for (size_t i = 0; i < 3; i++) {
+			for (size_t j = 0; j < 3; j++) {
+				for (size_t l = 0; l < 5; l++) {
+					control_points.push_back({double(i), double(j) + 0.1 * l, double(l) * (1 + 0.2 * i)});
+				}
+			}
+		}
+		auto spline = BSplineGeometry(3, 3, degrees, knots, control_points);
+		std::vector<knot_t> x{{0, 0, 0}, {0.3, 0.6, 0.8}, {0.7, 0.2, 0.45}, {1, 1, 1}};
+		std::vector<ctrl_t> expected = spline.evaluate(x);
+		std::vector<ctrl_t> jacobian = spline.jacobian(x[2]);
+
+		spline.set_block_size(2);
+		cout << spline.get_block_size() << " " << (spline.evaluate(x) == expected) << " "
+			<< (spline.jacobian(x[2]) == jacobian) << " "
+			<< (spline.get_control_points() == control_points) << "\n";
+
+		spline.set_control_point(23, {1, 1, 1});
+		ctrl_t blocked = spline.evaluate(x[1]);
+		spline.set_block_size(3);
+		cout << (spline.get_control_point(23)[0] == 1 && spline.get_control_point(23)[2] == 1) << " ";
+		spline.set_block_size(0);
+		cout << (spline.evaluate(x[1]) == blocked) << " " << (blocked == expected[1]) << "\n";
+		cout << "\n";
+	}
+
+	{
+		// pipelined map operation, n_kdims = 3, n_cdims = 3
+		// a batch longer than the prefetch ring agrees with evaluating
+		// the points one by one, in both storage orders
+		std::vector<size_t> degrees{1, 2, 2};
+		std::vector<std::vector<double>> knots{{0, 0.5, 1}, {0, 1}, {0, 0.3, 0.6, 1}};
+		std::vector<ctrl_t> control_points;
+		for (size_t i = 0; i < 3; i++) {
+			for (size_t j = 0; j < 3; j++) {
+				for (size_t l = 0; l < 5; l++) {
+					control_points.push_back({double(i), double(j) + 0.1 * l, double(l) * (1 + 0.2 * i)});
+				}
+			}
+		}
+		auto spline = BSplineGeometry(3, 3, degrees, knots, control_points);
+		std::vector<knot_t> x;
+		for (size_t i = 0; i < 50; i++) {
+			x.push_back({std::fmod(i * 0.618034, 1.0), std::fmod(i * 0.754878, 1.0), i / 49.0});
+		}
+		for (size_t block_size : {0, 2}) {
+			spline.set_block_size(block_size);
+			std::vector<ctrl_t> y = spline.evaluate(x);
+			size_t same = 0;
+			for (size_t i = 0; i < x.size(); i++) {
+				same += y[i] == spline.evaluate(x[i]);
+			}
+			cout << same << "\n";
+		}
+		cout << "\n";
+	}
+
+	{
+		// autotuning, n_kdims = 3, n_cdims = 3
+		// every candidate plan gives the same values; the choice is
+		// written to the cache file and read back by a second tuner
+		std::vector<size_t> degrees{1, 2, 2};
+		std::vector<std::vector<double>> knots{{0, 0.5, 1}, {0, 1}, {0, 0.3, 0.6, 1}};
+		std::vector<ctrl_t> control_points;
+		for (size_t i = 0; i < 3; i++) {
+			for (size_t j = 0; j < 3; j++) {
+				for (size_t l = 0; l < 5; l++) {
+					control_points.push_back({double(i), double(j) + 0.1 * l, double(l) * (1 + 0.2 * i)});
+				}
+			}
+		}
+		auto spline = BSplineGeometry(3, 3, degrees, knots, control_points, 2);
+		std::vector<knot_t> x;
+		for (size_t i = 0; i < 500; i++) {
+			x.push_back({std::fmod(i * 0.618034, 1.0), std::fmod(i * 0.754878, 1.0), i / 499.0});
+		}
+		std::vector<ctrl_t> expected;
+		for (knot_t const& point : x) {
+			expected.push_back(spline.evaluate(point));
+		}
+
+		size_t agree = 0;
+		for (size_t n_threads : {1, 2}) {
+			for (size_t block_size : {0, 4}) {
+				for (bool group_by_span : {false, true}) {
+					for (bool pipelined : {false, true}) {
+						EvaluationPlan plan{n_threads, block_size, group_by_span, pipelined};
+						agree += evaluate_with_plan(spline, x, plan) == expected;
+					}
+				}
+			}
+		}
+		cout << agree << "\n";
+
+		std::remove("tuning_test.txt");
+		EvaluationTuner tuner("tuning_test.txt");
+		cout << (tuner.evaluate(spline, x) == expected) << " ";
+		EvaluationPlan chosen = tuner.plan(spline, x);
+		EvaluationPlan cached = EvaluationTuner("tuning_test.txt").plan(spline, x);
+		cout << (chosen.n_threads == cached.n_threads && chosen.block_size == cached.block_size 
+				&& chosen.group_by_span == cached.group_by_span 
+				&& chosen.pipelined == cached.pipelined) << "\n";
+		std::ifstream cache("tuning_test.txt");
+		std::string line;
+		size_t lines = 0;
+		while (std::getline(cache, line)) {
+			lines++;
+		}
+		cout << lines << "\n";
+		std::remove("tuning_test.txt");
+
+		size_t layout = spline.get_block_size();
+		EvaluationTuner("tuning_test.txt").plan(spline, x);
+		cout << (spline.get_block_size() == layout) << "\n";
+		std::remove("tuning_test.txt");
+		cout << "\n";
+	}
+
+	{
+		// cost estimate and chunked tessellation, n_kdims = 2, n_cdims = 3
+		// the predicted counts match tessellate(), and slabs under a
+		// small budget cover the same cells
+		std::vector<size_t> degrees{2, 3};
+		std::vector<std::vector<double>> knots{{0, 0.25, 0.5, 1}, {0, 0.5, 1}};
+		std::vector<ctrl_t> control_points;
+		for (size_t i = 0; i < 5; i++) {
+			for (size_t j = 0; j < 5; j++) {
+				control_points.push_back({double(i), double(j), double((i * j) % 3)});
+			}
+		}
+		auto spline = BSplineGeometry(2, 3, degrees, knots, control_points);
+		std::vector<std::vector<double>> samples{uniform_samples(spline, 0, 10), uniform_samples(spline, 1, 10)};
+		TessellationCost cost = estimate_tessellation(spline, samples, true);
+		TessellationMesh mesh = tessellate(spline, samples, true);
+		cout << cost.n_points << " " << mesh.points.size() << " ";
+		cout << cost.n_cells << " " << mesh.cells.size() << " ";
+		cout << (cost.peak_bytes > cost.mesh_bytes) << " " << (cost.seconds >= 0) << "\n";
+
+		size_t cells = 0;
+		size_t chunks = tessellate_chunks(spline, samples, cost.peak_bytes / 4, true, 
+				[&](TessellationMesh const& slab, size_t) {
+			cells += slab.cells.size();
+		});
+		cout << (chunks > 1) << " " << cells << "\n";
+		cout << tessellate_chunks(spline, samples, 1000, true, 
+				[](TessellationMesh const&, size_t) {}) << "\n";
+		cout << "\n";
+	}
+
+	{
+		// plane slice of a volume, n_kdims = 3, n_cdims = 4
+		// S(u, v, w) = (u + 0.2 v^2, v, w, u): the plane x = 0.45 cuts
+		// the unit square in y, z out of the volume, on which the
+		// field component equals 0.45 - 0.2 y^2
+		std::vector<size_t> degrees{1, 2, 1};
+		std::vector<std::vector<double>> knots{{0, 0.5, 1}, {0, 0.5, 1}, {0, 0.5, 1}};
+		std::vector<double> lin{0, 0.5, 1}, greville{0, 0.25, 0.75, 1}, square{0, 0, 0.5, 1};
+		std::vector<ctrl_t> control_points;
+		for (size_t i = 0; i < 3; i++) {
+			for (size_t j = 0; j < 4; j++) {
+				for (size_t l = 0; l < 3; l++) {
+					control_points.push_back({lin[i] + 0.2 * square[j], greville[j], lin[l], lin[i]});
+				}
+			}
+		}
+		auto spline = BSplineGeometry(3, 4, degrees, knots, control_points, 2);
+		ElementBVH bvh(spline);
+		ctrl_t origin{0.45, 0, 0}, normal{1, 0, 0};
+		PolygonMesh slice = slice_plane(spline, bvh, origin, normal, 4);
+		cout << bvh.crossing_plane(origin, normal).size() << " " << bvh.n_elements() << "\n";
+
+		double area = 0, max_dev = 0, max_field_err = 0;
+		bool facing = true;
+		for (size_t v = 0; v < slice.points.size(); v++) {
+			ctrl_t const& y = slice.points[v];
+			max_dev = std::max(max_dev, std::fabs(y[0] - 0.45));
+			max_field_err = std::max(max_field_err, 
+					std::fabs(slice.point_fields[0].values[v] - (0.45 - 0.2 * y[1] * y[1])));
+		}
+		for (std::vector<size_t> const& polygon : slice.polygons) {
+			// area of the projection to the y, z plane (x component of the normal)
+			double a = 0;
+			for (size_t v = 0; v < polygon.size(); v++) {
+				ctrl_t const& p = slice.points[polygon[v]];
+				ctrl_t const& q = slice.points[polygon[(v + 1) % polygon.size()]];
+				a += 0.5 * (p[1] * q[2] - p[2] * q[1]);
+			}
+			facing = facing && a > 0;
+			area += a;
+		}
+		cout << slice.point_fields.size() << " " << slice.point_fields[0].name << "\n";
+		cout << (std::fabs(area - 1) < 1e-12) << " " << (max_dev < 1e-12) << " " 
+			<< (max_field_err < 1e-12) << " " << facing << "\n";
+		cout << "\n";
+	}
+
+	{
+		// isosurface of a field, n_kdims = 3, n_cdims = 4
+		// the unit cube carrying the field x^2 + y^2 + z^2: the
+		// isosurface 0.2 is an eighth of the sphere of radius sqrt(0.2)
+		std::vector<size_t> degrees{2, 2, 2};
+		std::vector<std::vector<double>> knots{{0, 0.5, 1}, {0, 0.5, 1}, {0, 0.5, 1}};
+		std::vector<double> greville{0, 0.25, 0.75, 1}, square{0, 0, 0.5, 1};
+		std::vector<ctrl_t> control_points;
+		for (size_t i = 0; i < 4; i++) {
+			for (size_t j = 0; j < 4; j++) {
+				for (size_t l = 0; l < 4; l++) {
+					control_points.push_back({greville[i], greville[j], greville[l], 
+							square[i] + square[j] + square[l]});
+				}
+			}
+		}
+		auto spline = BSplineGeometry(3, 4, degrees, knots, control_points, 2);
+		PolygonMesh surface = isosurface(spline, 3, 0.2, 8);
+		double area = 0, max_err = 0;
+		bool outward = true;
+		for (ctrl_t const& y : surface.points) {
+			max_err = std::max(max_err, std::fabs(y[0] * y[0] + y[1] * y[1] + y[2] * y[2] - 0.2));
+		}
+		for (std::vector<size_t> const& polygon : surface.polygons) {
+			ctrl_t const& o = surface.points[polygon[0]];
+			double n[3] = {0, 0, 0};
+			for (size_t v = 1; v + 1 < polygon.size(); v++) {
+				ctrl_t const& p = surface.points[polygon[v]];
+				ctrl_t const& q = surface.points[polygon[v + 1]];
+				double a[3] = {p[0] - o[0], p[1] - o[1], p[2] - o[2]};
+				double b[3] = {q[0] - o[0], q[1] - o[1], q[2] - o[2]};
+				n[0] += 0.5 * (a[1] * b[2] - a[2] * b[1]);
+				n[1] += 0.5 * (a[2] * b[0] - a[0] * b[2]);
+				n[2] += 0.5 * (a[0] * b[1] - a[1] * b[0]);
+			}
+			area += std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+			outward = outward && n[0] * o[0] + n[1] * o[1] + n[2] * o[2] > 0;
+		}
+		cout << (max_err < 1e-12) << " " << outward << " " << (std::fabs(area / (M_PI * 0.1) - 1) < 1e-2) << "\n";
+		cout << isosurface(spline, 3, 5).polygons.size() << "\n";
+		cout << "\n";
+	}
+
+	{
+		// hodographs, n_kdims = 3, n_cdims = 2
+		// the hodographs agree with evaluate_derivatives(), including
+		// across a double knot and for a second derivative
+		std::vector<size_t> degrees{2, 3, 1};
+		std::vector<std::vector<double>> knots{{0, 0.3, 0.3, 1}, {0, 0.25, 0.6, 1}, {0, 1}};
+		std::vector<ctrl_t> control_points;
+		for (size_t i = 0; i < 5; i++) {
+			for (size_t j = 0; j < 6; j++) {
+				for (size_t l = 0; l < 2; l++) {
+					control_points.push_back({double(i * i) + 0.5 * j, std::sin(double(i + 2 * j + 3 * l))});
+				}
+			}
+		}
+		auto spline = BSplineGeometry(3, 2, degrees, knots, control_points);
+		std::vector<BSplineGeometry> d{hodograph(spline, 0), hodograph(spline, 1), hodograph(spline, 2)};
+		BSplineGeometry d11 = hodograph(d[1], 1);
+		cout << d[0].get_degree(0) << d[0].get_n_ctrl(0) << " " << d[2].get_degree(2) << d[2].get_n_ctrl(2) << "\n";
+		double max_err = 0;
+		for (size_t i = 0; i < 200; i++) {
+			knot_t x{std::fmod(i * 0.618034, 1.0), std::fmod(i * 0.754878, 1.0), std::fmod(i * 0.569840, 1.0)};
+			std::vector<ctrl_t> expected = spline.evaluate_derivatives(x, {{1, 0, 0}, {0, 1, 0}, {0, 0, 1}, {0, 2, 0}});
+			std::vector<ctrl_t> got{d[0].evaluate(x), d[1].evaluate(x), d[2].evaluate(x), d11.evaluate(x)};
+			for (size_t a = 0; a < 4; a++) {
+				for (size_t c = 0; c < 2; c++) {
+					max_err = std::max(max_err, std::fabs(got[a][c] - expected[a][c]));
+				}
+			}
+		}
+		cout << (max_err < 1e-10) << "\n";
+		cout << "\n";
+	}
+
+	{
+		// adaptive arc length and surface area, n_cdims = 3
+		// the parabola (x, x^2) as a quadratic curve split at a knot,
+		// and the same parabola extruded by one along y as a surface
+		double exact = std::sqrt(5.0) / 2 + std::asinh(2.0) / 4;
+		std::vector<ctrl_t> curve_points{{0, 0, 0}, {0.25, 0, 0}, {0.75, 0.5, 0}, {1, 1, 0}};
+		auto curve = BSplineGeometry(1, 3, {2}, {{0, 0.5, 1}}, curve_points, 2);
+		std::vector<ctrl_t> surface_points;
+		for (ctrl_t const& P : curve_points) {
+			surface_points.push_back({P[0], 0, P[1]});
+			surface_points.push_back({P[0], 1, P[1]});
+		}
+		auto surface = BSplineGeometry(2, 3, {2, 1}, {{0, 0.5, 1}, {0, 1}}, surface_points, 2);
+		double error = 1;
+		double length = adaptive_measure(curve, 1e-12, 20, 10000000, &error);
+		double area = adaptive_measure(surface, 1e-12);
+		auto serial = BSplineGeometry(1, 3, {2}, {{0, 0.5, 1}}, curve_points, 1);
+		cout << (std::fabs(length - exact) < 1e-12) << " " << (error < 1e-12) << " " 
+			<< (std::fabs(area - exact) < 1e-12) << " " << (adaptive_measure(serial, 1e-12) == length) << "\n";
+
+		// the curve scaled by 1e8 cannot meet an absolute 1e-10 through
+		// rounding, and a budget of one evaluation leaves the elements whole
+		std::vector<ctrl_t> large_points;
+		for (ctrl_t const& P : curve_points) {
+			large_points.push_back({1e8 * P[0], 1e8 * P[1], 0});
+		}
+		auto large = BSplineGeometry(1, 3, {2}, {{0, 0.5, 1}}, large_points, 2);
+		double large_length = adaptive_measure(large, 1e-10, 20, 10000000, &error);
+		cout << (std::fabs(large_length / 1e8 - exact) < 1e-12) << " " << (error > 1e-10) << " ";
+		double coarse = adaptive_measure(surface, 1e-12, 20, 1, &error);
+		cout << (coarse == adaptive_measure(surface, 1e-12, 0)) << " " << (error > 1e-12) << "\n";
+		cout << "\n";
+	}
+
+	{
+		// image bounds of a parametric box, n_kdims = 2, n_cdims = 2
+		// all levels contain the sampled image and are nested, and
+		// subdivision closes in on the sampled extremes
+		std::vector<size_t> degrees{3, 2};
+		std::vector<std::vector<double>> knots{{0, 0.2, 0.5, 1}, {0, 0.4, 1}};
+		std::vector<ctrl_t> control_points;
+		for (size_t i = 0; i < 6; i++) {
+			for (size_t j = 0; j < 4; j++) {
+				control_points.push_back({double(i) + std::sin(double(3 * i + j)), double(j) + 0.5 * std::cos(double(i * j))});
+			}
+		}
+		auto spline = BSplineGeometry(2, 2, degrees, knots, control_points);
+		knot_t lo{0.1, 0.2}, hi{0.7, 0.65};
+		ctrl_t low{HUGE_VAL, HUGE_VAL}, high{-HUGE_VAL, -HUGE_VAL};
+		for (size_t i = 0; i <= 200; i++) {
+			for (size_t j = 0; j <= 200; j++) {
+				ctrl_t y = spline.evaluate(knot_t{lo[0] + (hi[0] - lo[0]) * i / 200, lo[1] + (hi[1] - lo[1]) * j / 200});
+				for (size_t r = 0; r < 2; r++) {
+					low[r] = std::min(low[r], y[r]);
+					high[r] = std::max(high[r], y[r]);
+				}
+			}
+		}
+		std::vector<AABB> levels{image_bounds(spline, lo, hi, 0), image_bounds(spline, lo, hi, 1), 
+			image_bounds(spline, lo, hi, 5)};
+		bool contains = true, nested = true;
+		for (size_t a = 0; a < levels.size(); a++) {
+			for (size_t r = 0; r < 2; r++) {
+				contains = contains && levels[a].lo[r] <= low[r] + 1e-12 && levels[a].hi[r] >= high[r] - 1e-12;
+				if (a > 0) {
+					nested = nested && levels[a].lo[r] >= levels[a - 1].lo[r] - 1e-12 
+						&& levels[a].hi[r] <= levels[a - 1].hi[r] + 1e-12;
+				}
+			}
+		}
+		double gap = 0;
+		for (size_t r = 0; r < 2; r++) {
+			gap = std::max({gap, low[r] - levels[2].lo[r], levels[2].hi[r] - high[r]});
+		}
+		knot_t point{0.5, 0.3};
+		AABB at = image_bounds(spline, point, point, 1);
+		ctrl_t y = spline.evaluate(point);
+		cout << contains << " " << nested << " " << (gap < 1e-3) << " " 
+			<< (std::fabs(at.lo[0] - y[0]) + std::fabs(at.hi[1] - y[1]) < 1e-12) << "\n";
+		cout << "\n";
+	}
+
+	{
+		// memory-mapped control points, n_kdims = 3, n_cdims = 2
+		// the mapped spline agrees with BSplineGeometry for single
+		// points and for a scattered batch evaluated out of order
+		std::vector<size_t> degrees{2, 1, 3};
+		std::vector<std::vector<double>> knots{{0, 0.3, 0.6, 1}, {0, 0.5, 1}, {0, 0.25, 0.5, 0.75, 1}};
+		std::vector<ctrl_t> control_points;
+		for (size_t i = 0; i < 5; i++) {
+			for (size_t j = 0; j < 3; j++) {
+				for (size_t l = 0; l < 7; l++) {
+					control_points.push_back({std::sin(double(i + 3 * j + 7 * l)), double(i * j) - 0.1 * l});
+				}
+			}
+		}
+		auto spline = BSplineGeometry(3, 2, degrees, knots, control_points);
+		cout << write_control_point_file("mapped_test.bin", control_points) << " ";
+		MappedBSplineGeometry mapped(3, 2, degrees, knots, "mapped_test.bin", 3);
+		cout << mapped.get_n_ctrl(2) << " " << (mapped.get_control_point(40) == control_points[40]) << "\n";
+
+		std::vector<knot_t> x;
+		for (size_t i = 0; i < 3000; i++) {
+			x.push_back({std::fmod(i * 0.618034, 1.0), std::fmod(i * 0.754878, 1.0), std::fmod(i * 0.569840, 1.0)});
+		}
+		x.push_back({1, 1, 1});
+		std::vector<ctrl_t> y = mapped.evaluate(x);
+		double max_err = 0;
+		for (size_t i = 0; i < x.size(); i++) {
+			ctrl_t expected = spline.evaluate(x[i]);
+			ctrl_t single = mapped.evaluate(x[i]);
+			for (size_t r = 0; r < 2; r++) {
+				max_err = std::max({max_err, std::fabs(y[i][r] - expected[r]), std::fabs(single[r] - expected[r])});
+			}
+		}
+		cout << (max_err < 1e-12) << "\n";
+		std::remove("mapped_test.bin");
+		cout << "\n";
+	}
+
+	{
+		// cancellation tokens and deadlines, n_kdims = 2, n_cdims = 3
+		// unstopped jobs match the plain ones; stopped jobs return the
+		// completed prefix with the reason
+		std::vector<size_t> degrees{2, 2};
+		std::vector<std::vector<double>> knots{{0, 0.5, 1}, {0, 1}};
+		std::vector<ctrl_t> control_points;
+		for (size_t i = 0; i < 4; i++) {
+			for (size_t j = 0; j < 3; j++) {
+				control_points.push_back({double(i), double(j), double(i * j)});
+			}
+		}
+		auto spline = BSplineGeometry(2, 3, degrees, knots, control_points, 2);
+		std::vector<knot_t> x;
+		for (size_t i = 0; i < 1000; i++) {
+			x.push_back({std::fmod(i * 0.618034, 1.0), std::fmod(i * 0.754878, 1.0)});
+		}
+		CancellationToken open, cancelled, expired;
+		cancelled.cancel();
+		expired.set_timeout(-1);
+		PartialEvaluation all = evaluate(spline, x, open, 64);
+		cout << (all.status == JOB_COMPLETED) << " " << (all.values == spline.evaluate(x)) << " ";
+		PartialEvaluation none = evaluate(spline, x, cancelled, 64);
+		cout << (none.status == JOB_CANCELLED) << none.values.size() << " ";
+		cout << (evaluate(spline, x, expired).status == JOB_DEADLINE_EXCEEDED) << "\n";
+
+		CancellationToken stop;
+		cout << chunked_for(1, 10, stop, [&](size_t, size_t c) {
+			if (c == 3) stop.cancel();
+		}) << "\n";
+
+		std::vector<std::vector<double>> samples{uniform_samples(spline, 0, 8), uniform_samples(spline, 1, 8)};
+		JobStatus status;
+		TessellationMesh mesh = tessellate(spline, samples, true, open, status);
+		TessellationMesh plain = tessellate(spline, samples, true);
+		cout << (status == JOB_COMPLETED) << " " << (mesh.points == plain.points) << " " 
+			<< (mesh.quality.size() == plain.cells.size()) << " ";
+		mesh = tessellate(spline, samples, true, cancelled, status);
+		cout << (status == JOB_CANCELLED) << mesh.samples[0].size() << mesh.points.size() << mesh.cells.size() << "\n";
+
+		mesh = adaptive_tessellate(spline, 1e-3, 10, true, open, status);
+		plain = adaptive_tessellate(spline, 1e-3, 10, true);
+		cout << (status == JOB_COMPLETED) << " " << (mesh.points == plain.points) << " "
+			<< (mesh.cells == plain.cells) << " " << (mesh.quality.size() == plain.cells.size()) << " ";
+		mesh = adaptive_tessellate(spline, 1e-3, 10, true, expired, status);
+		cout << (status == JOB_DEADLINE_EXCEEDED) << mesh.points.size() << mesh.cells.size() << mesh.quality.size() << "\n";
+		cout << "\n";
+	}
 }
@@ -1,23 +1,41 @@
+#include "bspline/contour.h"
+#include "bspline/curvature.h"
 #include "bspline/geometry.h"
+#include "bspline/inversion.h"
+#include "bspline/raytrace.h"
+#include "bspline/restriction.h"
+#include "bspline/quadrature.h"
+#include "bspline/tessellation.h"
 #include "json.hpp"
 #include <array>
+#include <cctype>
+#include <cerrno>
+#include <cmath>
 #include <codecvt>
 #include <cstddef>
 #include <cstdlib>
 #include <fstream>
 #include <iostream>
 #include <iterator>
+#include <optional>
 #include <string>
 #include <unordered_map>
 #include <vector>
 #include <set>
+#include <sstream>
 #include <vtkCellArray.h>
+#include <vtkCellData.h>
 #include <vtkCommonDataModelModule.h>
+#include <vtkDoubleArray.h>
 #include <vtkHexahedron.h>
 #include <vtkLine.h>
+#include <vtkPointData.h>
 #include <vtkPoints.h>
+#include <vtkPolyData.h>
+#include <vtkQuad.h>
 #include <vtkSmartPointer.h>
 #include <vtkUnstructuredGrid.h>
+#include <vtkXMLPolyDataWriter.h>
 #include <vtkXMLUnstructuredGridWriter.h>
 #include <vtkXMLUnstructuredGridReader.h>
 
@@ -37,11 +55,32 @@ void generateHexahedralGrid(int numX, int numY, int numZ,
                             const std::string filename);
 void generateWireframe(int numX, int numY, int numZ,
                             const std::string filename);
+TessellationCost estimateWireframe(int numX, int numY, int numZ);
 int generateWireframeForFile(const std::string filename, const std::string output_filename);
 int generateWireframeForFileWithConnectivity(const std::string filename, const std::string output_filename); // TEMPORARY: Testing extracting certain points
 
+std::optional<BSplineGeometry> loadSplineFromFiles(const std::string knotsPath,
+                                                   const std::string controlPointsPath,
+                                                   size_t threads = 1);
+void generateTessellationFile(const TessellationMesh &mesh,
+                              const std::string filename);
+void generatePolygonFile(const PolygonMesh &mesh, const std::string filename);
+std::vector<unsigned char> renderThumbnail(const BSplineGeometry &geometry);
+void generateThumbnail(const std::vector<unsigned char> &image,
+                       const std::string vtuFilename);
+
+bool parseNumber(const char *text, double &value);
+bool parseCount(const char *text, size_t &value);
+
 int getDegree(BSplineDataDict bsplineData);
 int upSample = 20;
+double chordalTolerance = 1e-3;
+size_t numThreads = 1;
+size_t previewResolution = 0;
+size_t memoryBudgetMB = 4096;
+std::optional<double> isoValue;
+std::optional<size_t> isoField;
+double timeLimit = 0;
 
 int main(int argc, char **argv) {
   // Retrieving the file path the of the users file
@@ -52,6 +91,53 @@ int main(int argc, char **argv) {
     return 0;
   }
 
+  // Optional flags following the path, each with a value
+  const std::set<std::string> flags{"--tolerance", "--threads", "--preview",
+                                    "--memory-budget", "--isovalue",
+                                    "--isofield", "--time-limit"};
+  for (int i = 2; i < argc; i += 2) {
+    const std::string flag = argv[i];
+    if (flags.count(flag) == 0) {
+      std::cout << "Unknown option: " << flag << std::endl;
+      return -1;
+    }
+    if (i + 1 == argc) {
+      std::cout << "Missing value for option: " << flag << std::endl;
+      return -1;
+    }
+    const char *value = argv[i + 1];
+    double number = 0;
+    size_t count = 0;
+    bool valid;
+    if (flag == "--tolerance") {
+      valid = parseNumber(value, number) && number > 0;
+      chordalTolerance = number;
+    } else if (flag == "--threads") {
+      valid = parseCount(value, count) && count > 0;
+      numThreads = count;
+    } else if (flag == "--preview") {
+      valid = parseCount(value, count);
+      previewResolution = count;
+    } else if (flag == "--memory-budget") {
+      valid = parseCount(value, count) && count > 0;
+      memoryBudgetMB = count;
+    } else if (flag == "--isovalue") {
+      valid = parseNumber(value, number);
+      isoValue = number;
+    } else if (flag == "--isofield") {
+      valid = parseCount(value, count);
+      isoField = count;
+    } else {
+      valid = parseNumber(value, number) && number >= 0;
+      timeLimit = number;
+    }
+    if (!valid) {
+      std::cout << "Invalid value for option " << flag << ": " << value
+                << std::endl;
+      return -1;
+    }
+  }
+
   // Parses the given file using the python parser
   const std::string commandToExecute =
       "python3 ./parser.py --path " + pathToParse;
@@ -101,12 +187,143 @@ int main(int argc, char **argv) {
   int numNodesY = 3;
   int numNodesZ = 2;
   //generateHexahedralGrid(numNodesX * upSample, numNodesY * upSample, numNodesZ * upSample, "hexahedral_mesh.vtu");
-  generateWireframe(numNodesX, numNodesY, numNodesZ, "wireframe_mesh.vtu");
+  TessellationCost wireframeCost = estimateWireframe(numNodesX, numNodesY, numNodesZ);
+  std::cout << "Wireframe mesh: " << wireframeCost.n_points << " points, "
+            << wireframeCost.n_cells << " cells, ~"
+            << (wireframeCost.peak_bytes >> 20) << " MB peak, ~"
+            << (wireframeCost.output_bytes >> 20) << " MB output" << std::endl;
+  if (wireframeCost.peak_bytes > (memoryBudgetMB << 20)) {
+    std::cout << "Skipping wireframe_mesh.vtu: exceeds the memory budget of "
+              << memoryBudgetMB << " MB" << std::endl;
+  } else {
+    generateWireframe(numNodesX, numNodesY, numNodesZ, "wireframe_mesh.vtu");
+  }
   generateWireframeForFile("quadratic_bspline_example_10x10x4.vtu", "wireframe_mesh_fromFile.vtu");
   generateWireframeForFileWithConnectivity("quadratic_bspline_example_10x10x4.vtu", "wireframe_mesh_fromFile_connectivity.vtu");
 
   /* ----- END NODE ORDERING / MESH CONNECTIVITY TESTING ----- */
 
+  // Adaptive (error-controlled) tessellation of the cubic flat plate
+  std::optional<BSplineGeometry> plate = loadSplineFromFiles(
+      "cubic_flat_plate_knots.txt", "cubic_flat_plate_control_points.txt",
+      numThreads);
+  if (plate) {
+    // Approximate (table lookup) evaluation for quick previews
+    if (previewResolution > 0) {
+      plate->set_preview(previewResolution);
+      std::cout << "Preview mode, estimated error " << plate->get_preview_error()
+                << std::endl;
+    }
+
+    // Rendered once, and saved next to every mesh file of the plate
+    const std::vector<unsigned char> thumbnail = renderThumbnail(*plate);
+
+    // With a time limit, keep whatever elements were meshed in time
+    CancellationToken adaptiveToken;
+    if (timeLimit > 0) {
+      adaptiveToken.set_timeout(timeLimit);
+    }
+    JobStatus adaptiveStatus;
+    TessellationMesh mesh = adaptive_tessellate(*plate, chordalTolerance, 10, false,
+                                                adaptiveToken, adaptiveStatus);
+    if (adaptiveStatus != JOB_COMPLETED) {
+      std::cout << "Adaptive mesh stopped after " << timeLimit << " s; writing "
+                << mesh.cells.size() << " cells" << std::endl;
+    }
+    generateTessellationFile(mesh, "adaptive_mesh.vtu");
+    generateThumbnail(thumbnail, "adaptive_mesh.vtu");
+
+    // Uniform hex mesh (upSample cells per knot span) with quality fields
+    std::vector<std::vector<double>> samples;
+    for (size_t s = 0; s < plate->get_n_kdims(); s++) {
+      samples.push_back(uniform_samples(*plate, s, upSample));
+    }
+    TessellationCost cost = estimate_tessellation(*plate, samples, true);
+    std::cout << "Uniform mesh: " << cost.n_points << " points, " << cost.n_cells
+              << " cells, ~" << (cost.peak_bytes >> 20) << " MB peak, ~"
+              << (cost.output_bytes >> 20) << " MB output, ~" << cost.seconds
+              << " s" << std::endl;
+    size_t budget = memoryBudgetMB << 20;
+    if (cost.peak_bytes <= budget) {
+      // With a time limit, keep whatever layers were sampled in time
+      CancellationToken token;
+      if (timeLimit > 0) {
+        token.set_timeout(timeLimit);
+      }
+      JobStatus status;
+      TessellationMesh uniform = tessellate(*plate, samples, true, token, status);
+      if (status != JOB_COMPLETED) {
+        std::cout << "Uniform mesh stopped after " << timeLimit << " s; writing "
+                  << uniform.samples[0].size() << " of " << samples[0].size()
+                  << " layers" << std::endl;
+      }
+      generateTessellationFile(uniform, "spline_hexahedral_mesh.vtu");
+      generateThumbnail(thumbnail, "spline_hexahedral_mesh.vtu");
+    } else {
+      // Too large to hold at once: write slabs along the first axis
+      size_t chunks = tessellate_chunks(
+          *plate, samples, budget, true,
+          [&thumbnail](const TessellationMesh &slab, size_t chunk) {
+            const std::string filename =
+                "spline_hexahedral_mesh_" + std::to_string(chunk) + ".vtu";
+            generateTessellationFile(slab, filename);
+            generateThumbnail(thumbnail, filename);
+          });
+      if (chunks == 0) {
+        std::cout << "Uniform mesh exceeds the memory budget of "
+                  << memoryBudgetMB << " MB even in slabs; skipped" << std::endl;
+      } else {
+        std::cout << "Uniform mesh written in " << chunks << " slabs" << std::endl;
+      }
+    }
+
+    // Element edges as isoparametric curves, without sampling the volume
+    generateTessellationFile(wireframe(*plate, upSample), "spline_wireframe.vtu");
+    generateThumbnail(thumbnail, "spline_wireframe.vtu");
+
+    // Boundary faces only: O(n^2) samples instead of the O(n^3) volume grid
+    if (plate->get_n_kdims() == 3) {
+      generateTessellationFile(boundary_tessellate(*plate, samples),
+                               "spline_boundary_mesh.vtu");
+      generateThumbnail(thumbnail, "spline_boundary_mesh.vtu");
+
+      // Curvature of the face at the upper end of the last axis (the top of the plate)
+      BSplineGeometry top = restrict_dimension(*plate, 2, samples[2].back());
+      TessellationMesh topMesh = tessellate(top, {samples[0], samples[1]});
+      add_curvature_fields(top, topMesh);
+      generateTessellationFile(topMesh, "spline_top_surface.vtu");
+      generateThumbnail(renderThumbnail(top), "spline_top_surface.vtu");
+    }
+    // Mid-plane cross section across the first axis, only through the elements it cuts
+    if (plate->get_n_kdims() == 3 && plate->get_n_cdims() >= 3) {
+      ElementBVH bvh(*plate);
+      const AABB &extent = bvh.extent();
+      std::vector<double> center{0.5 * (extent.lo[0] + extent.hi[0]),
+                                 0.5 * (extent.lo[1] + extent.hi[1]),
+                                 0.5 * (extent.lo[2] + extent.hi[2])};
+      generatePolygonFile(slice_plane(*plate, bvh, center, {1, 0, 0}, upSample),
+                          "spline_slice.vtp");
+    }
+
+    // Isosurface of a coordinate (by default the last one, e.g. a field)
+    if (isoValue && plate->get_n_kdims() == 3 && plate->get_n_cdims() >= 3) {
+      size_t component = isoField ? *isoField : plate->get_n_cdims() - 1;
+      generatePolygonFile(isosurface(*plate, component, *isoValue, upSample),
+                          "spline_isosurface.vtp");
+    }
+    std::cout << "Plate volume: " << measure(*plate) << std::endl;
+
+    JacobianCheck check = check_jacobian(*plate);
+    std::cout << "Plate Jacobian: " << (check.valid() ? "positive" : "NOT proven positive")
+              << " (lower bound " << check.min_bound << ")" << std::endl;
+    for (size_t element : check.inverted) {
+      std::cout << "  inverted element " << element << std::endl;
+    }
+    for (size_t element : check.uncertain) {
+      std::cout << "  uncertain element " << element << std::endl;
+    }
+  }
+
   // std::array<size_t, 2> degrees{2, 2};
   // std::array<std::vector<double>, 2> knot_vectors{std::vector<double>{1, 2,
   // 3, 4, 5}, std::vector<double>{1, 2, 3, 4, 5}};
@@ -128,6 +345,32 @@ int main(int argc, char **argv) {
   return 0;
 }
 
+/*
+ * Method used to parse a finite floating point option value
+ * Return: Whether the whole text is such a number
+ */
+bool parseNumber(const char *text, double &value) {
+  char *end = nullptr;
+  errno = 0;
+  value = std::strtod(text, &end);
+  return end != text && *end == '\0' && errno == 0 && std::isfinite(value);
+}
+
+/*
+ * Method used to parse a nonnegative integer option value
+ * Return: Whether the whole text is such a number (no sign allowed)
+ */
+bool parseCount(const char *text, size_t &value) {
+  if (!std::isdigit(static_cast<unsigned char>(text[0]))) {
+    return false;
+  }
+  char *end = nullptr;
+  errno = 0;
+  unsigned long long parsed = std::strtoull(text, &end, 10);
+  value = parsed;
+  return *end == '\0' && errno == 0 && parsed == value;
+}
+
 /*
  * Method used to extarct data from an existing file called 'data.json'
  * Should be called after input file is parsed through "parser.py"
@@ -154,6 +397,234 @@ int extractFileData(std::string filepathToExtract, BSplineDataDict *data) {
   return 0; // Successfully extracted data
 }
 
+/*
+ * Method used to build a BSplineGeometry from a pair of files
+ *
+ * knotsPath contains one clamped (end knots repeated degree + 1 times)
+ * knot vector per parametric dimension, as a JSON list of lists. The
+ * degree in each dimension is the multiplicity of its first knot
+ * minus one.
+ *
+ * controlPointsPath contains one control point per line, with
+ * whitespace separated coordinates, ordered with the last parametric
+ * dimension varying fastest.
+ *
+ * threads is the number of threads the geometry is prepared for.
+ *
+ * Return: The geometry, or an empty optional if a file cannot be read
+ */
+std::optional<BSplineGeometry> loadSplineFromFiles(const std::string knotsPath,
+                                                   const std::string controlPointsPath,
+                                                   size_t threads) {
+  std::ifstream knotsFile(knotsPath);
+  std::ifstream controlPointsFile(controlPointsPath);
+  if (!knotsFile.is_open() || !controlPointsFile.is_open()) {
+    std::cerr << "ERROR: Spline files do not exist or cannot be opened"
+              << std::endl;
+    return std::nullopt;
+  }
+
+  // Strip the repeated end knots, which BSplineGeometry adds itself
+  json knotsJson;
+  knotsFile >> knotsJson;
+  std::vector<size_t> degrees;
+  std::vector<std::vector<double>> knots;
+  for (auto knotList : knotsJson) {
+    std::vector<double> fullKnots = knotList.get<std::vector<double>>();
+    size_t multiplicity = 1;
+    while (multiplicity < fullKnots.size() &&
+           fullKnots[multiplicity] == fullKnots[0]) {
+      multiplicity++;
+    }
+    size_t degree = multiplicity - 1;
+    degrees.push_back(degree);
+    knots.push_back(std::vector<double>(fullKnots.begin() + degree,
+                                        fullKnots.end() - degree));
+  }
+
+  std::vector<std::vector<double>> controlPoints;
+  std::string line;
+  while (std::getline(controlPointsFile, line)) {
+    std::istringstream lineStream(line);
+    std::vector<double> point{std::istream_iterator<double>(lineStream),
+                              std::istream_iterator<double>()};
+    if (!point.empty()) {
+      controlPoints.push_back(point);
+    }
+  }
+  if (controlPoints.empty()) {
+    std::cerr << "ERROR: No control points in " << controlPointsPath
+              << std::endl;
+    return std::nullopt;
+  }
+
+  return BSplineGeometry(knots.size(), controlPoints[0].size(), degrees, knots,
+                         controlPoints, threads);
+}
+
+/*
+ * Method used to write a sampled spline mesh to a .vtu file
+ * Cells are written as lines, quads or hexahedra depending on the
+ * parametric dimension of the mesh. Physical points with fewer than
+ * three coordinates are padded with zeros. Cell quality measures are
+ * attached as cell data and point fields as point data when the mesh
+ * carries them.
+ */
+void generateTessellationFile(const TessellationMesh &mesh,
+                              const std::string filename) {
+  vtkSmartPointer<vtkUnstructuredGrid> grid =
+      vtkSmartPointer<vtkUnstructuredGrid>::New();
+
+  vtkSmartPointer<vtkPoints> points = vtkSmartPointer<vtkPoints>::New();
+  for (const std::vector<double> &point : mesh.points) {
+    double p[3] = {0, 0, 0};
+    for (size_t r = 0; r < point.size() && r < 3; r++) {
+      p[r] = point[r];
+    }
+    points->InsertNextPoint(p);
+  }
+  grid->SetPoints(points);
+
+  int cellType = mesh.n_kdims == 1   ? VTK_LINE
+                 : mesh.n_kdims == 2 ? VTK_QUAD
+                                     : VTK_HEXAHEDRON;
+  vtkSmartPointer<vtkCellArray> cells = vtkSmartPointer<vtkCellArray>::New();
+  for (const std::vector<size_t> &cell : mesh.cells) {
+    std::vector<vtkIdType> ids(cell.begin(), cell.end());
+    cells->InsertNextCell(static_cast<vtkIdType>(ids.size()), ids.data());
+  }
+  grid->SetCells(cellType, cells);
+
+  // Cell quality measures, if they were computed during sampling
+  if (!mesh.quality.empty()) {
+    const char *names[4] = {"Scaled Jacobian", "Edge Ratio", "Min Jacobian",
+                            "Max Jacobian"};
+    for (int m = 0; m < 4; m++) {
+      vtkSmartPointer<vtkDoubleArray> array =
+          vtkSmartPointer<vtkDoubleArray>::New();
+      array->SetName(names[m]);
+      array->SetNumberOfComponents(1);
+      array->SetNumberOfTuples(mesh.quality.size());
+      for (size_t c = 0; c < mesh.quality.size(); c++) {
+        const CellQuality &q = mesh.quality[c];
+        double values[4] = {q.scaled_jacobian, q.edge_ratio, q.min_jacobian,
+                            q.max_jacobian};
+        array->SetValue(c, values[m]);
+      }
+      grid->GetCellData()->AddArray(array);
+    }
+  }
+
+  // Additional per-point fields (e.g. curvatures)
+  for (const PointField &field : mesh.point_fields) {
+    vtkSmartPointer<vtkDoubleArray> array =
+        vtkSmartPointer<vtkDoubleArray>::New();
+    array->SetName(field.name.c_str());
+    array->SetNumberOfComponents(1);
+    array->SetNumberOfTuples(field.values.size());
+    for (size_t i = 0; i < field.values.size(); i++) {
+      array->SetValue(i, field.values[i]);
+    }
+    grid->GetPointData()->AddArray(array);
+  }
+
+  vtkSmartPointer<vtkXMLUnstructuredGridWriter> writer =
+      vtkSmartPointer<vtkXMLUnstructuredGridWriter>::New();
+  writer->SetFileName(filename.c_str());
+  writer->SetInputData(grid);
+  writer->Write();
+
+  std::cout << "VTU file saved as: " << filename << " (" << mesh.points.size()
+            << " points, " << mesh.cells.size() << " cells)" << std::endl;
+}
+
+/*
+ * Method used to write a polygon mesh (e.g. a slice) to a .vtp file.
+ * Physical points with more than three coordinates keep the first
+ * three; point fields are attached as point data.
+ */
+void generatePolygonFile(const PolygonMesh &mesh, const std::string filename) {
+  vtkSmartPointer<vtkPolyData> polyData = vtkSmartPointer<vtkPolyData>::New();
+
+  vtkSmartPointer<vtkPoints> points = vtkSmartPointer<vtkPoints>::New();
+  for (const std::vector<double> &point : mesh.points) {
+    double p[3] = {0, 0, 0};
+    for (size_t r = 0; r < point.size() && r < 3; r++) {
+      p[r] = point[r];
+    }
+    points->InsertNextPoint(p);
+  }
+  polyData->SetPoints(points);
+
+  vtkSmartPointer<vtkCellArray> polygons = vtkSmartPointer<vtkCellArray>::New();
+  for (const std::vector<size_t> &polygon : mesh.polygons) {
+    std::vector<vtkIdType> ids(polygon.begin(), polygon.end());
+    polygons->InsertNextCell(static_cast<vtkIdType>(ids.size()), ids.data());
+  }
+  polyData->SetPolys(polygons);
+
+  for (const PointField &field : mesh.point_fields) {
+    vtkSmartPointer<vtkDoubleArray> array =
+        vtkSmartPointer<vtkDoubleArray>::New();
+    array->SetName(field.name.c_str());
+    array->SetNumberOfComponents(1);
+    array->SetNumberOfTuples(field.values.size());
+    for (size_t i = 0; i < field.values.size(); i++) {
+      array->SetValue(i, field.values[i]);
+    }
+    polyData->GetPointData()->AddArray(array);
+  }
+
+  vtkSmartPointer<vtkXMLPolyDataWriter> writer =
+      vtkSmartPointer<vtkXMLPolyDataWriter>::New();
+  writer->SetFileName(filename.c_str());
+  writer->SetInputData(polyData);
+  writer->Write();
+
+  std::cout << "VTP file saved as: " << filename << " (" << mesh.points.size()
+            << " points, " << mesh.polygons.size() << " polygons)" << std::endl;
+}
+
+const size_t thumbnailWidth = 128;
+const size_t thumbnailHeight = 96;
+
+/*
+ * Method used to render a ray-cast preview image of a geometry
+ * Only surfaces and volumes in three dimensions can be previewed;
+ * for other geometries the image is empty.
+ */
+std::vector<unsigned char> renderThumbnail(const BSplineGeometry &geometry) {
+  size_t kdims = geometry.get_n_kdims();
+  if (geometry.get_n_cdims() != 3 || (kdims != 2 && kdims != 3)) {
+    return {};
+  }
+  ElementBVH bvh(geometry);
+  return render_preview(geometry, bvh, thumbnailWidth, thumbnailHeight);
+}
+
+/*
+ * Method used to write a preview image from renderThumbnail() next to a
+ * .vtu file, with the same name and the extension .ppm
+ * Empty images are not written.
+ */
+void generateThumbnail(const std::vector<unsigned char> &image,
+                       const std::string vtuFilename) {
+  if (image.empty()) {
+    return;
+  }
+  std::string filename = vtuFilename;
+  size_t extension = filename.rfind(".vtu");
+  if (extension != std::string::npos) {
+    filename.erase(extension);
+  }
+  filename += ".ppm";
+  if (write_ppm(filename, thumbnailWidth, thumbnailHeight, image)) {
+    std::cout << "Preview saved as: " << filename << std::endl;
+  } else {
+    std::cerr << "ERROR: Could not write " << filename << std::endl;
+  }
+}
+
 /*
  * Method is used to create a global points array
  * Creates a global points array for a cube
@@ -463,6 +934,26 @@ void generateWireframe(int numX, int numY, int numZ,
     std::cout << "Wireframe VTU file created.\n";
 }
 
+// The size of generateWireframe(numX, numY, numZ), counted as in TessellationCost
+TessellationCost estimateWireframe(int numX, int numY, int numZ) {
+  size_t numNodes[3] = {size_t(numX) * upSample, size_t(numY) * upSample,
+                        size_t(numZ) * upSample};
+  TessellationCost cost = {0, 0, 0, 0, 0, 0};
+  cost.n_points = (numNodes[0] + 1) * (numNodes[1] + 1) * (numNodes[2] + 1);
+
+  // Lines along each axis on the two faces normal to each other axis,
+  // without repeating the edges shared by those faces
+  cost.n_cells = 2 * numNodes[0] * (numZ + 1 + numY - 1) +
+                 2 * numNodes[1] * (numX + 1 + numZ - 1) +
+                 2 * numNodes[2] * (numX + 1 + numY - 1);
+
+  // createGlobalPoints holds every grid point in its own vector
+  cost.mesh_bytes = cost.n_points * vector_bytes(3, sizeof(double));
+  cost.output_bytes = vtk_output_bytes(cost.n_points, cost.n_cells, 2);
+  cost.peak_bytes = cost.mesh_bytes + cost.output_bytes;
+  return cost;
+}
+
 int generateWireframeForFile(const std::string filename, const std::string output_filename) {
     if (!(std::filesystem::exists(filename))) {
         std::cerr << "Error: File '" << filename << "' does not exist." << std::endl;